@@ -409,6 +409,114 @@ typedef enum
 
 } litton_charset_t;
 
+/**
+ * @brief Formats of input tape files.
+ */
+typedef enum
+{
+    /** Detect the format automatically from the contents of the file */
+    LITTON_TAPE_AUTO,
+
+    /** Text in ASCII, converted into the tape reader's character set */
+    LITTON_TAPE_TEXT,
+
+    /** Binary frames in the layout that is punched onto paper tape, with
+     *  the odd parity bit in the fifth track, like the .bin files in the
+     *  tapes directory */
+    LITTON_TAPE_PUNCHED,
+
+    /** Binary frames with one character code per byte; the high bit
+     *  may contain parity, which is ignored */
+    LITTON_TAPE_RAW
+
+} litton_tape_format_t;
+
+/**
+ * @brief Modes for simulating the time that a device takes to
+ * transfer a byte.
+ */
+typedef enum
+{
+    /** Use the machine-wide default timing */
+    LITTON_IO_DEFAULT,
+
+    /** Simulate the rate of the original device */
+    LITTON_IO_REALISTIC,
+
+    /** Transfer bytes immediately without using any machine time */
+    LITTON_IO_INSTANT,
+
+    /** Simulate a custom rate in characters per second */
+    LITTON_IO_CUSTOM
+
+} litton_io_mode_t;
+
+/**
+ * @brief Timing descriptor for an I/O device.
+ */
+typedef struct
+{
+    /** Timing mode for the device */
+    litton_io_mode_t mode;
+
+    /** Transfer rate in characters per second for LITTON_IO_CUSTOM */
+    unsigned rate;
+
+} litton_io_timing_t;
+
+/** Rate of the original printer in characters per second */
+#define LITTON_PRINTER_RATE 35
+
+/** Rate of the original tape reader and punch in characters per second */
+#define LITTON_TAPE_RATE 50
+
+typedef struct litton_sink_s litton_sink_t;
+
+/**
+ * @brief Destination for the output of a device.
+ *
+ * Devices like the printer and the tape punch convert their output into
+ * text and then write it to a sink in batches.  Sinks can write to files,
+ * file descriptors, pipes, memory buffers, or application callbacks.
+ */
+struct litton_sink_s
+{
+    /**
+     * @brief Writes a batch of data to the sink.
+     *
+     * @param[in,out] sink The sink to write to.
+     * @param[in] data Points to the data to write.
+     * @param[in] size Number of bytes of data to write.
+     */
+    void (*write)(litton_sink_t *sink, const char *data, size_t size);
+
+    /**
+     * @brief Flushes any data that is buffered by the sink.
+     *
+     * @param[in,out] sink The sink to flush.
+     *
+     * This may be NULL if the sink does not buffer its data.
+     */
+    void (*flush)(litton_sink_t *sink);
+
+    /**
+     * @brief Closes the sink and frees it.
+     *
+     * @param[in,out] sink The sink to close.
+     */
+    void (*close)(litton_sink_t *sink);
+};
+
+/**
+ * @brief Callback for a sink that is created with litton_create_callback_sink().
+ *
+ * @param[in] user_data User data that was supplied when the sink was created.
+ * @param[in] data Points to the data that was written to the sink.
+ * @param[in] size Number of bytes of data.
+ */
+typedef void (*litton_sink_callback_t)
+    (void *user_data, const char *data, size_t size);
+
 /**
  * @brief Information about an I/O device.
  */
@@ -429,6 +537,12 @@ struct litton_device_s
     /** Non-zero when this device is selected */
     uint8_t selected;
 
+    /** Next selected device that supports input */
+    litton_device_t *next_input;
+
+    /** Next selected device that supports output */
+    litton_device_t *next_output;
+
     /** Current print position */
     unsigned print_position;
 
@@ -438,6 +552,26 @@ struct litton_device_s
     /** Open tape file, or NULL */
     FILE *file;
 
+    /** Sink that receives the output of this device, or NULL to write
+     *  the output to stdout */
+    litton_sink_t *sink;
+
+    /** Decoded contents of the mounted input tape, or NULL if none */
+    uint8_t *tape_data;
+
+    /** Number of bytes in tape_data */
+    size_t tape_size;
+
+    /** Position of the next byte to read from tape_data */
+    size_t tape_posn;
+
+    /** Timing descriptor for transferring bytes to or from this device */
+    litton_io_timing_t timing;
+
+    /** Rate of the original device in characters per second, which is
+     *  used for LITTON_IO_REALISTIC */
+    unsigned realistic_rate;
+
     /**
      * @brief Closes the device prior to it being freed.
      *
@@ -514,6 +648,14 @@ struct litton_device_s
      */
     int (*status)(litton_state_t *state, litton_device_t *device,
                   uint8_t *value);
+
+    /**
+     * @brief Flushes any output that is buffered by this device.
+     *
+     * @param[in,out] state The state of the computer.
+     * @param[in,out] device The device to flush.
+     */
+    void (*flush)(litton_state_t *state, litton_device_t *device);
 };
 
 /** Standard device number for the printer */
@@ -621,6 +763,180 @@ int litton_input_from_device
  */
 int litton_input_device_status(litton_state_t *state, uint8_t *status);
 
+/**
+ * @brief Flushes any output that is buffered by the devices.
+ *
+ * @param[in,out] state The state of the computer.
+ *
+ * Devices like the printer buffer their output until the end of a line.
+ * This should be called when the computer halts, or periodically while
+ * it is running, to make any partial lines visible.
+ */
+void litton_flush_devices(litton_state_t *state);
+
+/**
+ * @brief Sets the sink that receives the output of a device.
+ *
+ * @param[in,out] device The device.
+ * @param[in] sink The new sink, or NULL to write the output to stdout.
+ *
+ * The device takes ownership of @a sink and closes it when the device is
+ * freed or when another sink is set.  Any previous sink is closed.
+ */
+void litton_set_device_sink(litton_device_t *device, litton_sink_t *sink);
+
+/**
+ * @brief Writes data to a sink.
+ *
+ * @param[in,out] sink The sink, or NULL to write to stdout.
+ * @param[in] data Points to the data to write.
+ * @param[in] size Number of bytes of data to write.
+ */
+void litton_sink_write(litton_sink_t *sink, const char *data, size_t size);
+
+/**
+ * @brief Flushes a sink.
+ *
+ * @param[in,out] sink The sink, or NULL to flush stdout.
+ */
+void litton_sink_flush(litton_sink_t *sink);
+
+/**
+ * @brief Closes a sink and frees it.
+ *
+ * @param[in,out] sink The sink, or NULL for stdout which is left open.
+ */
+void litton_sink_close(litton_sink_t *sink);
+
+/**
+ * @brief Creates a sink that writes to a stdio file.
+ *
+ * @param[in] file The file to write to.
+ * @param[in] close_file Non-zero to close @a file when the sink is closed.
+ *
+ * @return The new sink.
+ */
+litton_sink_t *litton_create_file_sink(FILE *file, int close_file);
+
+/**
+ * @brief Creates a sink that writes to a file descriptor.
+ *
+ * @param[in] fd The file descriptor to write to.
+ * @param[in] close_fd Non-zero to close @a fd when the sink is closed.
+ *
+ * @return The new sink.
+ *
+ * The data is written to @a fd immediately without further buffering, so
+ * this is suitable for pipes and sockets that another process is reading.
+ */
+litton_sink_t *litton_create_fd_sink(int fd, int close_fd);
+
+/**
+ * @brief Creates a sink that writes to the standard input of a command.
+ *
+ * @param[in] command The shell command to run.
+ *
+ * @return The new sink, or NULL if the command could not be started.
+ *
+ * The sink waits for the command to exit when it is closed.
+ */
+litton_sink_t *litton_create_pipe_sink(const char *command);
+
+/**
+ * @brief Creates a sink that collects the data in a memory buffer.
+ *
+ * @return The new sink.
+ *
+ * Use litton_memory_sink_data() to get the data that was written.
+ */
+litton_sink_t *litton_create_memory_sink(void);
+
+/**
+ * @brief Gets the data that has been written to a memory sink.
+ *
+ * @param[in] sink The memory sink.
+ * @param[out] size Returns the number of bytes of data.
+ *
+ * @return A pointer to the data, which is always followed by a NUL
+ * terminator.  The pointer is valid until the next write to the sink.
+ */
+const char *litton_memory_sink_data(litton_sink_t *sink, size_t *size);
+
+/**
+ * @brief Discards the data that has been written to a memory sink.
+ *
+ * @param[in,out] sink The memory sink.
+ */
+void litton_memory_sink_clear(litton_sink_t *sink);
+
+/**
+ * @brief Creates a sink that passes the data to a callback function.
+ *
+ * @param[in] callback The callback function.
+ * @param[in] user_data User data to pass to @a callback.
+ *
+ * @return The new sink.
+ */
+litton_sink_t *litton_create_callback_sink
+    (litton_sink_callback_t callback, void *user_data);
+
+/**
+ * @brief Sets the I/O timing for a device.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] id Identifier of the device, or zero to set the machine-wide
+ * default for all devices that do not have their own timing.
+ * @param[in] timing The timing descriptor.
+ *
+ * The timing is recorded in the state and applies to the device if it has
+ * already been added, or when it is added later.  The time to transfer each
+ * byte is added to the machine's cycle counter, so the pacer slows the
+ * program down to the device's rate when running at 1x speed.
+ */
+void litton_set_io_timing
+    (litton_state_t *state, uint8_t id, const litton_io_timing_t *timing);
+
+/**
+ * @brief Gets the number of word times to transfer a byte to or from
+ * a device.
+ *
+ * @param[in] state The state of the computer.
+ * @param[in] device The device.
+ *
+ * @return The number of word times, or zero if the I/O is instant.
+ */
+unsigned litton_io_word_times
+    (const litton_state_t *state, const litton_device_t *device);
+
+/**
+ * @brief Gets an I/O timing descriptor from its name.
+ *
+ * @param[out] timing Returns the timing descriptor.
+ * @param[in] name Points to the name: "instant", "realistic", a rate in
+ * characters per second like "120" or "120cps", or a baud rate like
+ * "1200baud" with 10 bits per character.
+ * @param[in] name_len Length of the name.
+ *
+ * @return Non-zero if the name is valid, zero if not.
+ */
+int litton_io_timing_from_name
+    (litton_io_timing_t *timing, const char *name, size_t name_len);
+
+/**
+ * @brief Parses and applies an I/O timing specification.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] spec Points to the specification, of the form "TIMING" to set
+ * the machine-wide default or "DEVICE=TIMING" to set the timing of a single
+ * device.  DEVICE is "printer", "punch", "keyboard", "reader", or a device
+ * identifier in hexadecimal.
+ * @param[in] spec_len Length of the specification.
+ *
+ * @return Non-zero if the specification is valid, zero if not.
+ */
+int litton_parse_io_timing
+    (litton_state_t *state, const char *spec, size_t spec_len);
+
 /**
  * @brief Adds parity to a byte value.
  *
@@ -681,6 +997,63 @@ int litton_char_map_special(int ch);
 #define LITTON_SMALL_MEMORY 0
 #endif
 
+/**
+ * @brief Execution engines that can be used by litton_run().
+ */
+typedef enum
+{
+    /** Reference interpreter, which is the same as litton_step() */
+    LITTON_ENGINE_REFERENCE,
+
+    /** Interpreter that uses a cache of pre-decoded drum words */
+    LITTON_ENGINE_CACHED,
+
+    /** Interpreter that dispatches on CR using threaded code */
+    LITTON_ENGINE_THREADED,
+
+    /** Interpreter that records and replays traces of drum words */
+    LITTON_ENGINE_TRACE,
+
+    /** Trace engine that compiles hot traces into native x86-64 code.
+     *  Falls back to the reference interpreter if the JIT is not enabled
+     *  in the build or the host is not supported. */
+    LITTON_ENGINE_JIT
+
+} litton_engine_t;
+
+/** Cache of pre-decoded drum words, private to the core */
+typedef struct litton_decode_cache_s litton_decode_cache_t;
+
+/** Cache of recorded traces, private to the core */
+typedef struct litton_trace_cache_s litton_trace_cache_t;
+
+/** Maximum number of events that can be pending at once */
+#define LITTON_MAX_EVENTS 16
+
+/**
+ * @brief Handler for an event that has reached its deadline.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] arg The argument that was supplied when the event was scheduled.
+ */
+typedef void (*litton_event_handler_t)(litton_state_t *state, void *arg);
+
+/**
+ * @brief Event that is scheduled to occur at a specific machine time.
+ */
+typedef struct
+{
+    /** Value of the cycle counter when the event occurs */
+    uint64_t when;
+
+    /** Handler to call when the event occurs */
+    litton_event_handler_t handler;
+
+    /** Argument to pass to the handler */
+    void *arg;
+
+} litton_event_t;
+
 /**
  * @brief Full state of the Litton machine.
  */
@@ -763,15 +1136,31 @@ struct litton_state_s
     /** List of devices that are attached to the computer */
     litton_device_t *devices;
 
+    /** Devices that are attached to the computer, indexed by identifier */
+    litton_device_t *device_table[256];
+
+    /** List of the selected devices that support input */
+    litton_device_t *selected_inputs;
+
+    /** List of the selected devices that support output */
+    litton_device_t *selected_outputs;
+
+    /** Device select code that was used to build the selection lists */
+    uint8_t selection_code;
+
+    /** Non-zero if the selection lists are valid for selection_code */
+    uint8_t selection_valid;
+
+    /** Number of word times to transfer a byte to or from the selected
+     *  devices, which is set by the fastest device in the selection */
+    unsigned io_word_times;
+
     /** Number of cycles that have elapsed.
      *
      * Each cycle is one bit time which is approximately one microsecond.
      */
     uint64_t cycle_counter;
 
-    /** Cycle counter the last time we did I/O */
-    uint64_t last_io_counter;
-
     /** Predicted position on the drum */
     unsigned rotation_predictor;
 
@@ -784,10 +1173,82 @@ struct litton_state_s
      */
     unsigned spin_counter;
 
-    /** Counter that allows the emulator to temporarily accelerate when
+    /** Non-zero while the emulator is temporarily accelerating when
      *  input occurs to make sure we can keep up with pasted text. */
     unsigned acceleration_counter;
 
+    /** Value of the cycle counter when the acceleration will end */
+    uint64_t acceleration_end;
+
+    /** Pending events, in a binary min-heap ordered on their deadlines */
+    litton_event_t events[LITTON_MAX_EVENTS];
+
+    /** Number of pending events */
+    unsigned num_events;
+
+    /** Deadline of the earliest pending event, or UINT64_MAX if none.
+     *  The execution engines stop when the cycle counter reaches this. */
+    uint64_t next_event;
+
+    /** Non-zero if the last instruction loaded a new word into I by
+     *  way of a jump. */
+    uint8_t jumped;
+
+    /** Non-zero if the last instruction was an I/O instruction that
+     *  could not proceed because the device was not ready. */
+    uint8_t io_wait;
+
+    /** Non-zero while the selected output devices are busy with the
+     *  last byte; cleared by the event that marks them as ready. */
+    uint8_t output_busy;
+
+    /** Non-zero if litton_run() should stop when the program is
+     *  waiting for an I/O device. */
+    uint8_t stop_on_io_wait;
+
+    /** Non-zero if the last failed input poll was made from the same
+     *  state as the previous polls, meaning that the program is idle. */
+    uint8_t idle;
+
+    /** Non-zero if litton_run() should stop when the program is idle,
+     *  waiting for input from a device. */
+    uint8_t stop_on_idle;
+
+    /** Number of consecutive failed input polls that were made from the
+     *  same register state without any stores or other I/O in between. */
+    unsigned idle_polls;
+
+    /** Value of A at the last failed input poll */
+    litton_word_t idle_A;
+
+    /** Value of I at the last failed input poll */
+    litton_word_t idle_I;
+
+    /** Value of PC at the last failed input poll */
+    litton_drum_loc_t idle_PC;
+
+    /** Value of CR at the last failed input poll */
+    uint8_t idle_CR;
+
+    /** Value of B at the last failed input poll */
+    uint8_t idle_B;
+
+    /** Value of P at the last failed input poll */
+    uint8_t idle_P;
+
+    /** Bitmap of breakpoint addresses, or NULL if no breakpoints are set */
+    uint8_t *breakpoints;
+
+    /** Execution engine to use in litton_run() */
+    litton_engine_t engine;
+
+    /** Cache of pre-decoded drum words for LITTON_ENGINE_CACHED */
+    litton_decode_cache_t *decode_cache;
+
+    /** Cache of recorded traces for LITTON_ENGINE_TRACE and
+     *  LITTON_ENGINE_JIT */
+    litton_trace_cache_t *trace_cache;
+
     /** Non-zero to disasemble instructions to stderr as they are executed */
     int disassemble;
 
@@ -803,6 +1264,11 @@ struct litton_state_s
     /** Identifier for the keyboard character set */
     litton_charset_t keyboard_charset;
 
+    /** I/O timing descriptors by device identifier, which are applied to
+     *  devices as they are added.  Index 0 is the machine-wide default
+     *  for devices that do not have their own timing. */
+    litton_io_timing_t io_timing[256];
+
     /** State of the status lights on the front panel */
     uint32_t status_lights;
 
@@ -822,6 +1288,37 @@ typedef enum
 
 } litton_step_result_t;
 
+/**
+ * @brief Reason why litton_run() stopped running instructions.
+ */
+typedef enum
+{
+    LITTON_RUN_BUDGET,      /**< Cycle or instruction budget was used up */
+    LITTON_RUN_HALT,        /**< Processor has halted */
+    LITTON_RUN_ILLEGAL,     /**< Illegal instruction */
+    LITTON_RUN_SPINNING,    /**< Spinning out of control */
+    LITTON_RUN_IO_WAIT,     /**< Program is waiting for an I/O device */
+    LITTON_RUN_BREAKPOINT,  /**< Jumped to a word with a breakpoint set */
+    LITTON_RUN_IDLE         /**< Program is idle, waiting for input */
+
+} litton_run_reason_t;
+
+/**
+ * @brief Result of running a batch of instructions with litton_run().
+ */
+typedef struct
+{
+    /** Reason why execution stopped */
+    litton_run_reason_t reason;
+
+    /** Number of cycles that were consumed */
+    uint64_t cycles;
+
+    /** Number of instructions that were executed */
+    uint64_t instructions;
+
+} litton_run_result_t;
+
 /**
  * @brief Initialize the state of the Litton computer.
  *
@@ -868,6 +1365,128 @@ void litton_reset(litton_state_t *state);
  */
 litton_step_result_t litton_step(litton_state_t *state);
 
+/**
+ * @brief Runs instructions until a budget is used up or execution stops.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_cycles Maximum number of cycles to run for, or zero
+ * for no cycle limit.
+ * @param[in] max_instructions Maximum number of instructions to run,
+ * or zero for no instruction limit.
+ * @param[out] result Returns information about why execution stopped
+ * and how much was executed.  May be NULL.
+ *
+ * @return The reason why execution stopped.
+ *
+ * The budgets are checked after each instruction, so the cycle budget
+ * may be exceeded by the length of the final instruction.  If both
+ * budgets are zero, then this function will only return on a halt,
+ * illegal instruction, spin, I/O wait, idle, or breakpoint.
+ *
+ * I/O waits are only reported if the @a stop_on_io_wait field of
+ * @a state is non-zero.
+ *
+ * The program is idle if it keeps polling for input from the same
+ * register state, with no stores to memory or other I/O in between.
+ * Nothing will change until input arrives, so the caller can block
+ * waiting for the input device instead of running the polling loop.
+ * Idle stops are only reported if the @a stop_on_idle field of
+ * @a state is non-zero.
+ */
+litton_run_reason_t litton_run
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result);
+
+/**
+ * @brief Schedules an event to occur at a specific machine time.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] when Value of the cycle counter when the event should occur.
+ * @param[in] handler Handler to call when the event occurs.
+ * @param[in] arg Argument to pass to the handler.
+ *
+ * @return Non-zero if the event was scheduled, or zero if there are
+ * too many events pending.
+ *
+ * If an event with the same @a handler and @a arg is already pending,
+ * then it will be rescheduled to occur at @a when instead.
+ *
+ * Events are dispatched by litton_run() and litton_step() at instruction
+ * boundaries, once the cycle counter has reached @a when.  The run loops
+ * only need to check the cycle counter against the earliest deadline in
+ * next_event rather than doing bookkeeping for every instruction.
+ */
+int litton_schedule_event
+    (litton_state_t *state, uint64_t when,
+     litton_event_handler_t handler, void *arg);
+
+/**
+ * @brief Cancels a pending event.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] handler Handler for the event.
+ * @param[in] arg Argument for the event.
+ *
+ * Nothing happens if there is no such event pending.
+ */
+void litton_cancel_event
+    (litton_state_t *state, litton_event_handler_t handler, void *arg);
+
+/**
+ * @brief Sets or clears a breakpoint on a drum address.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] addr The address of the instruction word to break on.
+ * @param[in] enable Non-zero to set the breakpoint, zero to clear it.
+ *
+ * When a jump loads the instruction word at @a addr, litton_run() will
+ * stop with LITTON_RUN_BREAKPOINT before executing the word.
+ */
+void litton_set_breakpoint
+    (litton_state_t *state, litton_drum_loc_t addr, int enable);
+
+/**
+ * @brief Clears all breakpoints.
+ *
+ * @param[in,out] state The state of the computer.
+ */
+void litton_clear_breakpoints(litton_state_t *state);
+
+/**
+ * @brief Sets the execution engine to use in litton_run().
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] engine The engine to use.
+ *
+ * @return Non-zero if the engine was set, or zero if the engine is
+ * not supported on this system.  The engine is left unchanged if
+ * zero is returned.
+ *
+ * The reference interpreter is always available through litton_step().
+ */
+int litton_set_engine(litton_state_t *state, litton_engine_t engine);
+
+/**
+ * @brief Gets an execution engine from its name.
+ *
+ * @param[out] engine Returns the execution engine.
+ * @param[in] name Points to the name.
+ * @param[in] name_len Length of the name.
+ *
+ * @return Non-zero if the name is valid, zero if not.
+ */
+int litton_engine_from_name
+    (litton_engine_t *engine, const char *name, size_t name_len);
+
+/**
+ * @brief Converts an execution engine into a name.
+ *
+ * @param[in] engine The execution engine.
+ *
+ * @return The name of the execution engine.
+ */
+const char *litton_engine_to_name(litton_engine_t engine);
+
 /**
  * @brief Get the value of a memory location.
  *
@@ -1005,6 +1624,18 @@ void litton_add_printer
 void litton_add_keyboard
     (litton_state_t *state, uint8_t id, litton_charset_t charset);
 
+/**
+ * @brief Blocks until there is input available on the keyboard.
+ *
+ * @param[in,out] state The state of the computer.
+ *
+ * The keyboard that is created by litton_add_keyboard() reads stdin on a
+ * separate thread so that the program does not need to make system calls
+ * to check for keystrokes.  This function can be used when the program
+ * is idle to sleep until the next keystroke arrives.
+ */
+void litton_wait_for_keyboard(litton_state_t *state);
+
 /**
  * @brief Adds a tape punch device to the computer that writes the
  * punched data to standard output.
@@ -1036,14 +1667,47 @@ void litton_add_tape_reader
  * @return Non-zero if the file was opened and associated with the
  * tape reader, or zero if an error occurred.
  *
- * The tape data in the file is assumed to be in ASCII.  ASCII will be
- * converted into the tape reader's character set as the tape is read.
+ * The format of the tape is detected automatically.  Text tapes are
+ * assumed to be in ASCII, which is converted into the tape reader's
+ * character set when the tape is mounted.  Binary tapes contain one frame
+ * for each byte, in either the punched or raw layout.
  *
  * If there is already a tape file mounted on the tape reader, this
  * function will close the existing file and open a new one.
  */
 int litton_set_input_tape(litton_state_t *state, const char *filename);
 
+/**
+ * @brief Sets the tape reader to read from an input file with a specific
+ * format.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] filename The name of the file to pretend to be the input tape.
+ * @param[in] format The format of the file, or LITTON_TAPE_AUTO to detect
+ * the format from the contents of the file.
+ *
+ * @return Non-zero if the file was opened and associated with the
+ * tape reader, or zero if an error occurred.
+ *
+ * Blank leader and trailer frames are removed from binary tapes so that
+ * the tape is unmounted after the last frame of data has been read.
+ */
+int litton_set_input_tape_format
+    (litton_state_t *state, const char *filename,
+     litton_tape_format_t format);
+
+/**
+ * @brief Gets a tape format from its name.
+ *
+ * @param[out] format Returns the tape format.
+ * @param[in] name Points to the name: "auto", "text", "punched", or "raw".
+ * @param[in] name_len Length of the name.
+ *
+ * @return Non-zero if the name is valid, zero if not.
+ */
+int litton_tape_format_from_name
+    (litton_tape_format_t *format, const char *name, size_t name_len);
+
 /**
  * @brief Close the input tape file, if any.
  *
@@ -1060,6 +1724,21 @@ void litton_close_input_tape(litton_state_t *state);
  */
 int litton_has_input_tape(litton_state_t *state);
 
+/**
+ * @brief Reads the next byte from the input tape that is mounted on a device.
+ *
+ * @param[in,out] device The tape reader device.
+ * @param[out] value Returns the byte that was read.
+ * @param[in] parity The type of parity to add to the byte.
+ *
+ * @return Non-zero if a byte was read, or zero if there is no tape mounted.
+ *
+ * The tape is decoded into the device's character set when it is mounted.
+ * The tape is unmounted automatically once the last byte has been read.
+ */
+int litton_read_input_tape
+    (litton_device_t *device, uint8_t *value, litton_parity_t parity);
+
 /**
  * @brief Sets the tape punch to write to a specific output file.
  *
@@ -1073,6 +1752,9 @@ int litton_has_input_tape(litton_state_t *state);
  * The data written to the tape by the program is assumed to be in the
  * nominated character set.  It will be converted into ASCII before being
  * written to the file.
+ *
+ * The file replaces the tape punch's sink until the tape is closed, after
+ * which the punch writes to stdout again.
  */
 int litton_set_output_tape
     (litton_state_t *state, const char *filename, int append);
@@ -1294,6 +1976,173 @@ int litton_is_halted(litton_state_t *state);
  */
 void litton_update_status_lights(litton_state_t *state);
 
+/** Number of status lights that are tracked by the lamp sampler, which
+ *  covers LITTON_STATUS_POWER to LITTON_STATUS_ACCUM */
+#define LITTON_NUM_LAMPS 18
+
+/**
+ * @brief Accumulates how long each status light has been on for in
+ * emulated time, so that a front end can show the average brightness
+ * of lamps that flicker faster than its frame rate.
+ *
+ * The front end calls litton_sample_lamps() after each quantum that it
+ * runs, and then compares two copies of the sampler a frame apart with
+ * litton_lamp_brightness().
+ */
+typedef struct
+{
+    /** Number of cycles that each status light has been on for, indexed
+     *  by the bit number of the light in the LITTON_STATUS_* mask */
+    uint64_t on_cycles[LITTON_NUM_LAMPS];
+
+    /** Total number of cycles that have been sampled */
+    uint64_t total_cycles;
+
+    /** Value of the cycle counter at the last sample */
+    uint64_t last_cycle;
+
+} litton_lamp_sampler_t;
+
+/**
+ * @brief Initializes a lamp sampler.
+ *
+ * @param[out] sampler The lamp sampler to initialize.
+ * @param[in] state The state of the computer.
+ */
+void litton_lamp_sampler_init
+    (litton_lamp_sampler_t *sampler, const litton_state_t *state);
+
+/**
+ * @brief Updates the status lights and adds the cycles since the last
+ * sample to the on time of the lights that are currently lit.
+ *
+ * @param[in,out] sampler The lamp sampler.
+ * @param[in,out] state The state of the computer.
+ */
+void litton_sample_lamps(litton_lamp_sampler_t *sampler, litton_state_t *state);
+
+/**
+ * @brief Gets the average brightness of a status light between two
+ * copies of a lamp sampler.
+ *
+ * @param[in] current The current state of the lamp sampler.
+ * @param[in] previous An earlier copy of the lamp sampler.
+ * @param[in] lamp The status light; e.g. LITTON_STATUS_BIT_3.
+ * @param[in] max_level The brightness level of a lamp that is always on.
+ *
+ * @return The brightness between 0 and @a max_level, or -1 if no cycles
+ * have been sampled between @a previous and @a current.  In the latter
+ * case, the front end should show the current state of the light instead.
+ */
+int litton_lamp_brightness
+    (const litton_lamp_sampler_t *current,
+     const litton_lamp_sampler_t *previous,
+     uint32_t lamp, int max_level);
+
+/*----------------------------------------------------------------------*/
+
+/*
+ * Pacing execution to the speed of the original computer.
+ */
+
+/** Speed multiplier for running as fast as the host allows */
+#define LITTON_SPEED_UNLIMITED 0
+
+/** Default number of cycles to run in each pacing quantum at 1x speed */
+#define LITTON_PACER_QUANTUM 2000
+
+/**
+ * @brief State for pacing execution to real time.
+ *
+ * The front end runs a quantum of emulated time at full speed with
+ * litton_run() and then calls litton_pacer_wait() to sleep until real
+ * time catches up.  Deadlines are measured from a checkpoint rather than
+ * from the previous quantum so that errors do not accumulate into drift.
+ */
+typedef struct
+{
+    /** Speed multiplier relative to the original computer, or
+     *  LITTON_SPEED_UNLIMITED to run without pacing */
+    unsigned speed;
+
+    /** Number of cycles in each quantum at 1x speed */
+    uint64_t quantum;
+
+    /** Value of the cycle counter at the last checkpoint */
+    uint64_t checkpoint_cycles;
+
+    /** Host time at the last checkpoint, in nanoseconds */
+    uint64_t checkpoint_ns;
+
+    /** Number of times that the pacer slept until a deadline */
+    uint64_t sleeps;
+
+    /** Number of times that the pacer fell too far behind real time
+     *  and had to resynchronise on the current time */
+    uint64_t resyncs;
+
+    /** Total number of nanoseconds that sleeps overshot their deadlines */
+    uint64_t total_jitter_ns;
+
+    /** Maximum number of nanoseconds that a sleep overshot its deadline */
+    uint64_t max_jitter_ns;
+
+} litton_pacer_t;
+
+/**
+ * @brief Initializes a pacer.
+ *
+ * @param[out] pacer The pacer to initialize.
+ * @param[in] state The state of the computer.
+ * @param[in] speed The speed multiplier, or LITTON_SPEED_UNLIMITED.
+ */
+void litton_pacer_init
+    (litton_pacer_t *pacer, const litton_state_t *state, unsigned speed);
+
+/**
+ * @brief Resynchronises a pacer on the current time.
+ *
+ * @param[in,out] pacer The pacer.
+ * @param[in] state The state of the computer.
+ *
+ * This should be called after the computer has been stopped for a while,
+ * such as when halted or idle, so that it doesn't try to catch up.
+ */
+void litton_pacer_resync(litton_pacer_t *pacer, const litton_state_t *state);
+
+/**
+ * @brief Gets the number of cycles to run in the next quantum.
+ *
+ * @param[in] pacer The pacer.
+ *
+ * @return The number of cycles, or zero if the speed is unlimited.
+ */
+uint64_t litton_pacer_quantum_cycles(const litton_pacer_t *pacer);
+
+/**
+ * @brief Waits for real time to catch up with the computer.
+ *
+ * @param[in,out] pacer The pacer.
+ * @param[in] state The state of the computer.
+ *
+ * If the computer is more than a little behind real time, or it is
+ * temporarily accelerating to keep up with input, then this will
+ * resynchronise on the current time instead of sleeping.
+ */
+void litton_pacer_wait(litton_pacer_t *pacer, const litton_state_t *state);
+
+/**
+ * @brief Gets a speed multiplier from its name.
+ *
+ * @param[out] speed Returns the speed multiplier.
+ * @param[in] name Points to the name; e.g. "1", "2x", "10x", or "unlimited".
+ * @param[in] name_len Length of the name.
+ *
+ * @return Non-zero if the name is valid, zero if not.
+ */
+int litton_speed_from_name
+    (unsigned *speed, const char *name, size_t name_len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,778 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "litton/litton.h"
+#include "litton-internal.h"
+#include <stdlib.h>
+
+#if !LITTON_SMALL_MEMORY
+
+/*
+ * The decode cache converts each drum word into a short list of
+ * pre-decoded operations when it is first entered via a jump.
+ *
+ * After a jump to address X, the contents of CR and I are completely
+ * determined by X and the word at X.  Every operation within the word
+ * can therefore be decoded ahead of time, along with the contents of
+ * CR and I before and after the operation.
+ *
+ * When the engine enters a word, it compares CR and I against the "pre"
+ * values of the decoded operations.  If one matches, the operations from
+ * that point on are executed in sequence without looking at CR and I
+ * again until the next jump.  If none match (e.g. after a "JA" back into
+ * the middle of a word), the reference interpreter executes the next
+ * instruction and the engine looks again.
+ *
+ * As with the threaded engine, each handler dispatches the next operation
+ * directly with computed goto where the compiler supports it.  Operations
+ * that access the drum outside the scratchpad combine the seek, access,
+ * and opcode timing into a single update of the cycle counter.
+ *
+ * Words are invalidated when they are modified by litton_set_memory() or
+ * through a scratchpad register pointer.  The next time that the word is
+ * entered, it is only decoded again if CR and I no longer match.
+ */
+
+/**
+ * @brief Sets CR and I from a 48-bit value.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] cri The 48-bit value to set.
+ */
+static void litton_set_cri(litton_state_t *state, uint64_t cri)
+{
+    state->CR = (uint8_t)(cri >> LITTON_WORD_BITS);
+    state->I = cri & LITTON_WORD_MASK;
+}
+
+/**
+ * @brief Rotates a 48-bit CR/I value to the left.
+ *
+ * @param[in] cri The 48-bit value to rotate.
+ * @param[in] bits Number of bits to rotate by, 8 or 16.
+ *
+ * @return The rotated value.
+ */
+static uint64_t litton_rotate_cri(uint64_t cri, unsigned bits)
+{
+    return ((cri << bits) | (cri >> (48 - bits))) & LITTON_CRI_MASK;
+}
+
+/**
+ * @brief Adds the timing for an operation that accesses a drum address.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] op The operation, whose operand is the drum address.
+ * @param[in] before Number of opcode word times before the access.
+ * @param[in] after Number of opcode word times after the access.
+ *
+ * This has the same effect as litton_add_opcode_timing() for @a before,
+ * litton_add_memory_timing(), and then litton_add_opcode_timing() for
+ * @a after.  Outside the scratchpad, the three updates are combined
+ * into one because the drum will be just past the operand afterwards.
+ */
+static LITTON_INLINE void litton_op_timing
+    (litton_state_t *state, const litton_decoded_op_t *op,
+     unsigned before, unsigned after)
+{
+    unsigned word_times;
+    if (op->operand < LITTON_DRUM_RESERVED_SECTORS) {
+        litton_add_opcode_timing(state, before);
+        litton_add_memory_timing(state, op->operand);
+        litton_add_opcode_timing(state, after);
+        return;
+    }
+    state->last_address = op->operand;
+    word_times = (op->operand - (state->rotation_predictor + before)) &
+                 (LITTON_DRUM_NUM_SECTORS - 1);
+    word_times += before + 1 + after;
+    state->cycle_counter += word_times * LITTON_WORD_BITS;
+    state->rotation_predictor =
+        (op->operand + 1 + after) & (LITTON_DRUM_NUM_SECTORS - 1);
+}
+
+static LITTON_INLINE void litton_op_AK
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->A += state->K;
+    if (state->A > LITTON_WORD_MASK) {
+        state->A = 0;
+        state->K = 1;
+    } else {
+        state->K = 0;
+    }
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_CL
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->A = 0;
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_NN
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_CM
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->A = (-state->A) & LITTON_WORD_MASK;
+    state->K = (state->A != 0);
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_SK
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->K = 1;
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_TZ
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->K = (state->A == 0);
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_TH
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->K = ((state->A & LITTON_WORD_MSB) != 0);
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_RK
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->K = 0;
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_TP
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_opcode_timing(state, op->cost);
+    state->K = state->P;
+    state->P = 0;
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_LA
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_memory_timing(state, op->operand);
+    litton_add_opcode_timing(state, op->cost);
+    state->A &= litton_drum_word(state, op->operand);
+    state->K = (state->A == 0);
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_XC
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_word_t temp;
+    litton_add_memory_timing(state, op->operand);
+    litton_add_opcode_timing(state, op->cost);
+    temp = litton_drum_word(state, op->operand);
+    litton_write_drum(state, op->operand, state->A);
+    state->A = temp;
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_XT
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_word_t temp;
+    litton_add_memory_timing(state, op->operand);
+    litton_add_opcode_timing(state, op->cost);
+    temp = litton_drum_word(state, op->operand);
+    litton_write_drum(state, op->operand, temp & ~(state->A));
+    state->A &= temp;
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_TE
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_memory_timing(state, op->operand);
+    litton_add_opcode_timing(state, op->cost);
+    state->K = (state->A == litton_drum_word(state, op->operand));
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_TG
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_add_memory_timing(state, op->operand);
+    litton_add_opcode_timing(state, op->cost);
+    state->K = (state->A >= litton_drum_word(state, op->operand));
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE litton_step_result_t litton_op_binary_shift
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_step_result_t result = litton_binary_shift(state, op->operand);
+    litton_set_cri(state, op->post);
+    return result;
+}
+
+static LITTON_INLINE litton_step_result_t litton_op_decimal_shift
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_step_result_t result = litton_decimal_shift(state, op->operand);
+    litton_set_cri(state, op->post);
+    return result;
+}
+
+static LITTON_INLINE litton_step_result_t litton_op_io
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_step_result_t result = litton_perform_io(state, op->operand);
+    litton_set_cri(state, op->post);
+    return result;
+}
+
+static LITTON_INLINE void litton_op_CA
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_op_timing(state, op, 0, op->cost);
+    state->A = litton_drum_word(state, op->operand);
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_AD
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_op_timing(state, op, 0, op->cost);
+    state->A += litton_drum_word(state, op->operand);
+    state->K = (state->A > LITTON_WORD_MASK);
+    state->A &= LITTON_WORD_MASK;
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_ST
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    /* Storing to the word that is currently executing is safe because
+     * we already have a copy of it in CR and I */
+    litton_op_timing(state, op, op->cost, 0);
+    litton_write_drum(state, op->operand, state->A);
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_op_CD
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    if (state->K) {
+        litton_op_timing(state, op, 0, op->cost);
+        state->A += litton_drum_word(state, op->operand);
+        state->K = (state->A > LITTON_WORD_MASK);
+        state->A &= LITTON_WORD_MASK;
+    } else {
+        litton_add_opcode_timing(state, op->cost - 1);
+    }
+    litton_set_cri(state, op->post);
+}
+
+static LITTON_INLINE void litton_jump_to
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    state->I = litton_drum_word(state, op->operand);
+    state->PC = op->operand;
+    state->spin_counter = 0;
+    state->jumped = 1;
+    litton_rotate_8(state);
+    litton_rotate_8(state);
+}
+
+static LITTON_INLINE void litton_op_JM
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_op_timing(state, op, 0, op->cost);
+    state->CR = 0xE0 | (state->CR & 0x0F);
+    state->A = state->I;
+    litton_jump_to(state, op);
+}
+
+static LITTON_INLINE void litton_op_JU
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    litton_op_timing(state, op, 0, op->cost);
+    litton_jump_to(state, op);
+}
+
+static LITTON_INLINE void litton_op_JC
+    (litton_state_t *state, const litton_decoded_op_t *op)
+{
+    if (state->K) {
+        litton_op_timing(state, op, 0, op->cost);
+        state->CR = 0xE0 | (state->CR & 0x0F);
+        litton_jump_to(state, op);
+    } else {
+        litton_add_opcode_timing(state, op->cost - 1);
+        litton_set_cri(state, op->post);
+    }
+}
+
+/**
+ * @brief Decodes a single operation.
+ *
+ * @param[out] op The operation to fill in.
+ * @param[in] cri The contents of CR and I before the operation.
+ *
+ * @return Non-zero if decoding of the word should continue after this
+ * operation, or zero if the operation always transfers control elsewhere.
+ */
+static int litton_decode_op(litton_decoded_op_t *op, uint64_t cri)
+{
+    uint8_t CR = (uint8_t)(cri >> LITTON_WORD_BITS);
+    uint16_t insn;
+    op->handler = LITTON_OP_FALLBACK;
+    op->pre = cri;
+    op->operand = 0;
+    op->cost = 0;
+    if (CR < 0x40) {
+        /* Single-byte instruction */
+        op->post = litton_rotate_cri(cri, 8);
+        op->operand = CR & 0x07;
+        op->cost = 3;
+        switch (CR) {
+        case LOP_AK:    op->handler = LITTON_OP_AK; break;
+        case LOP_CL:    op->handler = LITTON_OP_CL; break;
+        case LOP_NN:    op->handler = LITTON_OP_NN; op->cost = 1; break;
+        case LOP_CM:    op->handler = LITTON_OP_CM; break;
+        case LOP_SK:    op->handler = LITTON_OP_SK; break;
+        case LOP_TZ:    op->handler = LITTON_OP_TZ; break;
+        case LOP_TH:    op->handler = LITTON_OP_TH; break;
+        case LOP_RK:    op->handler = LITTON_OP_RK; break;
+        case LOP_TP:    op->handler = LITTON_OP_TP; break;
+        case LOP_JA:
+            /* Jump to A is left to the reference interpreter */
+            return 0;
+        default:
+            switch (CR & 0xF8) {
+            case LOP_LA:    op->handler = LITTON_OP_LA; break;
+            case LOP_XC:    op->handler = LITTON_OP_XC; break;
+            case LOP_XT:    op->handler = LITTON_OP_XT; break;
+            case LOP_TE:    op->handler = LITTON_OP_TE; break;
+            case LOP_TG:    op->handler = LITTON_OP_TG; break;
+            default:
+                /* HH, BI, and illegal instructions are rare, so leave
+                 * them to the reference interpreter */
+                break;
+            }
+            break;
+        }
+        return 1;
+    }
+
+    /* Double-byte instruction */
+    insn = (uint16_t)(cri >> 32);
+    op->post = litton_rotate_cri(cri, 16);
+    op->operand = insn & 0x0FFF;
+    op->cost = 4;
+    switch (CR & 0xF0) {
+    case 0x40:
+        op->handler = LITTON_OP_BINARY_SHIFT;
+        op->operand = insn;
+        break;
+
+    case 0x50:
+    case 0x70:
+        op->handler = LITTON_OP_IO;
+        op->operand = insn;
+        break;
+
+    case 0x60:
+        op->handler = LITTON_OP_DECIMAL_SHIFT;
+        op->operand = insn;
+        break;
+
+    case 0x80:  op->handler = LITTON_OP_CA; break;
+    case 0x90:  op->handler = LITTON_OP_AD; break;
+    case 0xB0:  op->handler = LITTON_OP_ST; break;
+    case 0xC0:  op->handler = LITTON_OP_JM; return 0;
+    case 0xD0:  op->handler = LITTON_OP_CD; break;
+    case 0xE0:  op->handler = LITTON_OP_JU; return 0;
+    case 0xF0:  op->handler = LITTON_OP_JC; break;
+
+    default:
+        /* Illegal instruction; leave it to the reference interpreter */
+        break;
+    }
+    return 1;
+}
+
+/**
+ * @brief Decodes a drum word into the cache.
+ *
+ * @param[in] state The state of the computer.
+ * @param[out] word The cache entry to fill in.
+ * @param[in] addr The address of the word on the drum.
+ */
+static void litton_decode_word
+    (litton_state_t *state, litton_decoded_word_t *word,
+     litton_drum_loc_t addr)
+{
+    uint64_t cri;
+    unsigned bytes = 0;
+
+    /* Determine the contents of CR and I just after jumping to "addr".
+     * The jump instruction has been converted into "JU addr" in CR
+     * and the top byte of I before the word is loaded into I. */
+    cri = ((uint64_t)(0xE0 | (addr >> 8))) << LITTON_WORD_BITS;
+    cri |= litton_get_memory(state, addr);
+    cri = litton_rotate_cri(cri, 16);
+
+    /* Decode operations until we see an unconditional transfer of control
+     * or we have gone all the way around the 48-bit CR/I register */
+    word->count = 0;
+    while (word->count < LITTON_DECODE_MAX_OPS && bytes < 6) {
+        litton_decoded_op_t *op = &(word->ops[word->count]);
+        int more = litton_decode_op(op, cri);
+        ++(word->count);
+        if (!more) {
+            break;
+        }
+        if ((cri >> LITTON_WORD_BITS) < 0x40) {
+            bytes += 1;
+        } else {
+            bytes += 2;
+        }
+        cri = op->post;
+    }
+    word->ops[word->count].handler = LITTON_OP_FALLBACK;
+    word->ops[word->count].pre = LITTON_CRI_INVALID;
+    word->valid = 1;
+}
+
+/**
+ * @brief Finds the decoded operation that matches the contents of CR and I.
+ *
+ * @param[in,out] state The state of the computer.
+ *
+ * @return The operation to execute, or NULL if no decoded operation
+ * matches CR and I.
+ *
+ * Just after a jump, the first operation of the word at PC will match.
+ * Otherwise we are resuming part-way through a word after the engine
+ * stopped or after an operation that the reference interpreter handled.
+ */
+static const litton_decoded_op_t *litton_find_op(litton_state_t *state)
+{
+    litton_decoded_word_t *word;
+    uint64_t cri;
+    unsigned index;
+
+    /* Find the decoded word for the current program counter */
+    word = &(state->decode_cache->words[state->PC & (LITTON_DRUM_MAX_SIZE - 1)]);
+
+    /* Find the operation that matches the current contents of CR and I.
+     * Because the operation is completely determined by CR and I, a match
+     * means that the rest of the word can be executed from the decoded
+     * operations even if the word on the drum has been modified since it
+     * was decoded.  Programs often store the same instruction back into a
+     * word, so this avoids decoding it again. */
+    cri = (((uint64_t)(state->CR)) << LITTON_WORD_BITS) | state->I;
+    for (;;) {
+        for (index = 0; index < word->count; ++index) {
+            if (word->ops[index].pre == cri) {
+                return &(word->ops[index]);
+            }
+        }
+        if (word->valid) {
+            /* CR and I do not correspond to the word on the drum */
+            return 0;
+        }
+        litton_decode_word(state, word, state->PC);
+    }
+}
+
+litton_decode_cache_t *litton_decode_cache_create(void)
+{
+    return calloc(1, sizeof(litton_decode_cache_t));
+}
+
+#if LITTON_COMPUTED_GOTO
+#define LITTON_HANDLER(name) op_##name
+#define LITTON_DISPATCH() goto *handlers[op->handler]
+#else
+#define LITTON_HANDLER(name) case LITTON_OP_##name
+#define LITTON_DISPATCH() goto dispatch
+#endif
+
+/* Start the next operation, with the same prologue as litton_step()
+ * except that the spin check was done when the word was entered */
+#define LITTON_BEGIN() \
+    do { \
+        ++(state->spin_counter); \
+        state->io_wait = 0; \
+    } while (0)
+
+/* Finish the current operation and dispatch the next one in the same
+ * word if there is still some budget left */
+#define LITTON_NEXT() \
+    do { \
+        ++instructions; \
+        if (state->cycle_counter >= end_cycles || \
+                instructions >= max_instructions) { \
+            goto done; \
+        } \
+        ++op; \
+        LITTON_DISPATCH(); \
+    } while (0)
+
+/* Handler for an operation that always continues with the next one */
+#define LITTON_SIMPLE(name) \
+    LITTON_HANDLER(name): \
+        LITTON_BEGIN(); \
+        litton_op_##name(state, op); \
+        LITTON_NEXT()
+
+litton_run_reason_t litton_run_cached
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result)
+{
+    litton_run_reason_t reason = LITTON_RUN_BUDGET;
+    uint64_t start_cycles = state->cycle_counter;
+    uint64_t end_cycles;
+    uint64_t instructions = 0;
+    const litton_decoded_op_t *op;
+    litton_step_result_t step;
+#if LITTON_COMPUTED_GOTO
+    static void * const handlers[] = {
+        &&op_FALLBACK, &&op_AK, &&op_CL, &&op_NN, &&op_CM, &&op_SK,
+        &&op_TZ, &&op_TH, &&op_RK, &&op_TP, &&op_LA, &&op_XC, &&op_XT,
+        &&op_TE, &&op_TG, &&op_BINARY_SHIFT, &&op_DECIMAL_SHIFT, &&op_IO,
+        &&op_CA, &&op_AD, &&op_ST, &&op_CD, &&op_JM, &&op_JU, &&op_JC
+    };
+#endif
+
+    /* Convert the budgets into limits that can be checked quickly */
+    if (max_cycles && max_cycles <= (UINT64_MAX - start_cycles)) {
+        end_cycles = start_cycles + max_cycles;
+    } else {
+        end_cycles = UINT64_MAX;
+    }
+    end_cycles = litton_limit_to_events(state, end_cycles);
+    if (!max_instructions) {
+        max_instructions = UINT64_MAX;
+    }
+
+find:
+    /* Find where we are in the decoded version of the current word.
+     * CR and I only need to be compared when entering the word. */
+    op = litton_find_op(state);
+    if (!op) {
+        goto fallback;
+    }
+
+    /* Leave spin detection near the limit to the reference interpreter,
+     * so that the operations in the word do not need to check it */
+    if (state->spin_counter > (LITTON_DRUM_MAX_SIZE - LITTON_DECODE_MAX_OPS)) {
+        goto fallback;
+    }
+    state->jumped = 0;
+    LITTON_DISPATCH();
+
+#if !LITTON_COMPUTED_GOTO
+dispatch:
+    switch (op->handler) {
+#endif
+
+    LITTON_HANDLER(FALLBACK):
+        if (op->pre == LITTON_CRI_INVALID) {
+            /* End of the decoded operations, so look again */
+            goto find;
+        }
+        goto fallback;
+
+    LITTON_SIMPLE(AK);
+    LITTON_SIMPLE(CL);
+    LITTON_SIMPLE(NN);
+    LITTON_SIMPLE(CM);
+    LITTON_SIMPLE(SK);
+    LITTON_SIMPLE(TZ);
+    LITTON_SIMPLE(TH);
+    LITTON_SIMPLE(RK);
+    LITTON_SIMPLE(TP);
+    LITTON_SIMPLE(LA);
+    LITTON_SIMPLE(XC);
+    LITTON_SIMPLE(XT);
+    LITTON_SIMPLE(TE);
+    LITTON_SIMPLE(TG);
+    LITTON_SIMPLE(CA);
+    LITTON_SIMPLE(AD);
+    LITTON_SIMPLE(ST);
+    LITTON_SIMPLE(CD);
+
+    LITTON_HANDLER(BINARY_SHIFT):
+        LITTON_BEGIN();
+        step = litton_op_binary_shift(state, op);
+        if (step != LITTON_STEP_OK) {
+            goto stopped;
+        }
+        LITTON_NEXT();
+
+    LITTON_HANDLER(DECIMAL_SHIFT):
+        LITTON_BEGIN();
+        step = litton_op_decimal_shift(state, op);
+        if (step != LITTON_STEP_OK) {
+            goto stopped;
+        }
+        LITTON_NEXT();
+
+    LITTON_HANDLER(IO):
+        LITTON_BEGIN();
+        step = litton_op_io(state, op);
+        if (step != LITTON_STEP_OK) {
+            goto stopped;
+        }
+
+        /* Stop if the program is waiting for an I/O device or is idle */
+        if (state->io_wait) {
+            if (state->stop_on_io_wait) {
+                ++instructions;
+                reason = LITTON_RUN_IO_WAIT;
+                goto done;
+            }
+            if (state->idle && state->stop_on_idle) {
+                ++instructions;
+                reason = LITTON_RUN_IDLE;
+                goto done;
+            }
+        }
+
+        /* The instruction may have scheduled an event */
+        end_cycles = litton_limit_to_events(state, end_cycles);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(JM):
+        LITTON_BEGIN();
+        litton_op_JM(state, op);
+        ++instructions;
+        goto jumped;
+
+    LITTON_HANDLER(JU):
+        LITTON_BEGIN();
+        litton_op_JU(state, op);
+        ++instructions;
+        goto jumped;
+
+    LITTON_HANDLER(JC):
+        LITTON_BEGIN();
+        litton_op_JC(state, op);
+        if (state->jumped) {
+            ++instructions;
+            goto jumped;
+        }
+        LITTON_NEXT();
+
+#if !LITTON_COMPUTED_GOTO
+    default:
+        /* Not reachable; every decoded operation has a handler */
+        goto fallback;
+    }
+#endif
+
+fallback:
+    /* Execute the next instruction with the reference interpreter */
+    step = litton_step(state);
+    if (step != LITTON_STEP_OK) {
+        goto stopped;
+    }
+    ++instructions;
+    if (state->io_wait) {
+        if (state->stop_on_io_wait) {
+            reason = LITTON_RUN_IO_WAIT;
+            goto done;
+        }
+        if (state->idle && state->stop_on_idle) {
+            reason = LITTON_RUN_IDLE;
+            goto done;
+        }
+    }
+    end_cycles = litton_limit_to_events(state, end_cycles);
+    if (state->jumped) {
+        goto jumped;
+    }
+    if (state->cycle_counter >= end_cycles ||
+            instructions >= max_instructions) {
+        goto done;
+    }
+    goto find;
+
+jumped:
+    /* Stop if we jumped to a word with a breakpoint on it */
+    if (state->breakpoints && litton_is_breakpoint(state, state->PC)) {
+        reason = LITTON_RUN_BREAKPOINT;
+        goto done;
+    }
+
+    /* Skip over delay loops in one step */
+    if (litton_is_delay_loop(state)) {
+        instructions += litton_skip_delay_loop
+            (state, max_instructions - instructions, end_cycles);
+    }
+    if (state->cycle_counter >= end_cycles ||
+            instructions >= max_instructions) {
+        goto done;
+    }
+    goto find;
+
+stopped:
+    /* Halts and illegal instructions are executed, but a spinning
+     * instruction is not */
+    if (step == LITTON_STEP_HALT) {
+        reason = LITTON_RUN_HALT;
+        ++instructions;
+    } else if (step == LITTON_STEP_ILLEGAL) {
+        reason = LITTON_RUN_ILLEGAL;
+        ++instructions;
+    } else {
+        reason = LITTON_RUN_SPINNING;
+    }
+
+done:
+    if (result) {
+        result->reason = reason;
+        result->cycles = state->cycle_counter - start_cycles;
+        result->instructions = instructions;
+    }
+    return reason;
+}
+
+#endif /* !LITTON_SMALL_MEMORY */
@@ -21,6 +21,7 @@
  */
 
 #include "litton/litton.h"
+#include "litton-internal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,26 +29,42 @@
 #include <termios.h>
 #include <unistd.h>
 #include <poll.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #define LITTON_TERMIOS 1
 #endif
 
 void litton_add_device(litton_state_t *state, litton_device_t *device)
 {
     device->selected = 0;
+    device->next_input = 0;
+    device->next_output = 0;
     device->next = state->devices;
     state->devices = device;
+    state->device_table[device->id] = device;
+
+    /* Apply the I/O timing unless the device has its own */
+    if (device->timing.mode == LITTON_IO_DEFAULT) {
+        device->timing = state->io_timing[device->id];
+    }
+    if (device->realistic_rate == 0) {
+        if (device->id == LITTON_DEVICE_READER ||
+                device->id == LITTON_DEVICE_PUNCH) {
+            device->realistic_rate = LITTON_TAPE_RATE;
+        } else {
+            device->realistic_rate = LITTON_PRINTER_RATE;
+        }
+    }
+
+    /* Rebuild the selection lists on the next select instruction */
+    state->selection_valid = 0;
 }
 
 litton_device_t *litton_find_device(litton_state_t *state, uint8_t id)
 {
-    litton_device_t *device = state->devices;
-    while (device != 0) {
-        if (device->id == id) {
-            break;
-        }
-        device = device->next;
-    }
-    return device;
+    return state->device_table[id];
 }
 
 static void litton_deselect_device
@@ -70,11 +87,25 @@ static int litton_device_match
 int litton_select_device(litton_state_t *state, int device_select_code)
 {
     litton_device_t *device = state->devices;
+    litton_device_t **input_tail = &(state->selected_inputs);
+    litton_device_t **output_tail = &(state->selected_outputs);
     if (device_select_code == 0x09) {
         /* Blackjack uses 0x09 to select the keyboard and printer,
          * instead of the more correct 0x49.  Fix the code. */
         device_select_code |= 0x40;
     }
+
+    /* Programs tend to select the same devices over and over, so there
+     * is nothing to do if the selection has not changed */
+    if (state->selection_valid &&
+            state->selection_code == (uint8_t)device_select_code) {
+        return 0;
+    }
+    state->selection_code = (uint8_t)device_select_code;
+    state->selection_valid = 1;
+
+    /* Update the selection state of all devices and rebuild the lists
+     * of selected input and output devices */
     while (device != 0) {
         if (litton_device_match(device, device_select_code)) {
             /* If the device is not currently selected, then select it */
@@ -84,104 +115,296 @@ int litton_select_device(litton_state_t *state, int device_select_code)
                 }
                 device->selected = 1;
             }
+            if (device->supports_input) {
+                *input_tail = device;
+                input_tail = &(device->next_input);
+            }
+            if (device->supports_output) {
+                *output_tail = device;
+                output_tail = &(device->next_output);
+            }
         } else if (device->selected) {
             /* Device was selected, but it is not anymore */
             litton_deselect_device(state, device);
         }
         device = device->next;
     }
+    *input_tail = 0;
+    *output_tail = 0;
+    litton_update_io_word_times(state);
     return 0;
 }
 
 int litton_is_output_busy(litton_state_t *state)
 {
-    litton_device_t *device = state->devices;
+    litton_device_t *device = state->selected_outputs;
     while (device != 0) {
-        if (device->selected && device->supports_output) {
-            if (device->is_busy != 0 && (*(device->is_busy))(state, device)) {
-                return 1;
-            }
+        if (device->is_busy != 0 && (*(device->is_busy))(state, device)) {
+            return 1;
         }
-        device = device->next;
+        device = device->next_output;
     }
     return 0;
 }
 
-/** Temporarily allow the emulator to accelerate when text is pasted. */
-#define LITTON_ACCEL_COUNT 100
+/** Number of cycles to temporarily accelerate for when text is pasted. */
+#define LITTON_ACCEL_CYCLES 10000
+
+/** Maximum number of cycles to accelerate for ahead of the current time. */
+#define LITTON_ACCEL_MAX 1000000
 
-/** Maximum acceleration counter */
-#define LITTON_ACCEL_MAX 10000
+/**
+ * @brief Handles the end of an acceleration period.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] arg Not used.
+ */
+static void litton_acceleration_ended(litton_state_t *state, void *arg)
+{
+    (void)arg;
+    state->acceleration_counter = 0;
+}
 
 void litton_accelerate(litton_state_t *state)
 {
-    if (state->acceleration_counter < LITTON_ACCEL_MAX) {
-        state->acceleration_counter += LITTON_ACCEL_COUNT;
+    uint64_t end = state->cycle_counter;
+    if (state->acceleration_counter != 0 && state->acceleration_end > end) {
+        /* Extend the current acceleration period */
+        end = state->acceleration_end;
+    }
+    if (end < (state->cycle_counter + LITTON_ACCEL_MAX)) {
+        end += LITTON_ACCEL_CYCLES;
+    }
+    if (litton_schedule_event(state, end, litton_acceleration_ended, 0)) {
+        state->acceleration_counter = 1;
+        state->acceleration_end = end;
     }
 }
 
 void litton_accelerate_more(litton_state_t *state)
 {
-    if (state->acceleration_counter != 0 &&
-            state->acceleration_counter < LITTON_ACCEL_MAX) {
+    if (state->acceleration_counter != 0) {
         /* Stay in accelerated mode for a little longer */
-        state->acceleration_counter += LITTON_ACCEL_COUNT;
+        litton_accelerate(state);
     }
 }
 
 void litton_output_to_device
     (litton_state_t *state, uint8_t value, litton_parity_t parity)
 {
-    litton_device_t *device = state->devices;
+    litton_device_t *device = state->selected_outputs;
     while (device != 0) {
-        if (device->selected && device->supports_output) {
-            if (!(device->is_busy) || !((*device->is_busy))(state, device)) {
-                if (device->output != 0) {
-                    (*(device->output))(state, device, value, parity);
-                    litton_accelerate_more(state);
-                }
+        if (!(device->is_busy) || !((*device->is_busy))(state, device)) {
+            if (device->output != 0) {
+                (*(device->output))(state, device, value, parity);
+                litton_accelerate_more(state);
             }
         }
-        device = device->next;
+        device = device->next_output;
     }
 }
 
 int litton_input_from_device
     (litton_state_t *state, uint8_t *value, litton_parity_t parity)
 {
-    litton_device_t *device = state->devices;
+    litton_device_t *device = state->selected_inputs;
     while (device != 0) {
-        if (device->selected && device->supports_input) {
-            if (device->input != 0) {
-                if ((*(device->input))(state, device, value, parity)) {
-                    /* Allow faster processing of pasted text if we
-                     * got an input character from the paper tape. */
-                    if (device->id == LITTON_DEVICE_READER) {
-                        litton_accelerate(state);
-                    }
-                    return 1;
+        if (device->input != 0) {
+            if ((*(device->input))(state, device, value, parity)) {
+                /* Allow faster processing of pasted text if we
+                 * got an input character from the paper tape. */
+                if (device->id == LITTON_DEVICE_READER) {
+                    litton_accelerate(state);
                 }
+                return 1;
             }
         }
-        device = device->next;
+        device = device->next_input;
     }
     return 0;
 }
 
 int litton_input_device_status(litton_state_t *state, uint8_t *status)
+{
+    litton_device_t *device = state->selected_inputs;
+    while (device != 0) {
+        if (device->status != 0) {
+            if ((*(device->status))(state, device, status)) {
+                return 1;
+            }
+        }
+        device = device->next_input;
+    }
+    return 0;
+}
+
+void litton_flush_devices(litton_state_t *state)
 {
     litton_device_t *device = state->devices;
     while (device != 0) {
-        if (device->selected && device->supports_input) {
-            if (device->status != 0) {
-                if ((*(device->status))(state, device, status)) {
-                    return 1;
-                }
+        if (device->flush != 0) {
+            (*(device->flush))(state, device);
+        }
+        if (device->supports_output) {
+            litton_sink_flush(device->sink);
+        }
+        device = device->next;
+    }
+}
+
+/**
+ * @brief Number of word times in one second of machine time.
+ *
+ * Each word time is 40 bit times of approximately one microsecond each.
+ */
+#define LITTON_WORD_TIMES_PER_SECOND 25000
+
+void litton_set_io_timing
+    (litton_state_t *state, uint8_t id, const litton_io_timing_t *timing)
+{
+    litton_device_t *device = state->device_table[id];
+    state->io_timing[id] = *timing;
+    if (id != 0 && device != 0) {
+        device->timing = *timing;
+    }
+    litton_update_io_word_times(state);
+}
+
+/**
+ * @brief Gets the number of word times to transfer a byte with a
+ * specific timing descriptor.
+ *
+ * @param[in] state The state of the computer.
+ * @param[in] timing The timing descriptor.
+ * @param[in] realistic_rate Rate of the original device in characters
+ * per second.
+ *
+ * @return The number of word times, or zero if the I/O is instant.
+ */
+static unsigned litton_timing_word_times
+    (const litton_state_t *state, litton_io_timing_t timing,
+     unsigned realistic_rate)
+{
+    unsigned rate;
+    if (timing.mode == LITTON_IO_DEFAULT) {
+        timing = state->io_timing[0];
+    }
+    switch (timing.mode) {
+    case LITTON_IO_INSTANT:
+        return 0;
+
+    case LITTON_IO_CUSTOM:
+        rate = timing.rate;
+        break;
+
+    default:
+        rate = realistic_rate;
+        break;
+    }
+    return rate != 0 ? LITTON_WORD_TIMES_PER_SECOND / rate : 0;
+}
+
+unsigned litton_io_word_times
+    (const litton_state_t *state, const litton_device_t *device)
+{
+    return litton_timing_word_times
+        (state, device->timing, device->realistic_rate);
+}
+
+void litton_update_io_word_times(litton_state_t *state)
+{
+    litton_device_t *device = state->devices;
+    unsigned word_times;
+    int found = 0;
+
+    /* With no devices selected, output still waits on the printer */
+    state->io_word_times = litton_timing_word_times
+        (state, state->io_timing[0], LITTON_PRINTER_RATE);
+    while (device != 0) {
+        if (device->selected) {
+            word_times = litton_io_word_times(state, device);
+            if (!found || word_times < state->io_word_times) {
+                state->io_word_times = word_times;
+                found = 1;
             }
         }
         device = device->next;
     }
-    return 0;
+}
+
+int litton_io_timing_from_name
+    (litton_io_timing_t *timing, const char *name, size_t name_len)
+{
+    unsigned long rate = 0;
+    size_t posn = 0;
+    if (litton_name_match("instant", name, name_len)) {
+        timing->mode = LITTON_IO_INSTANT;
+        timing->rate = 0;
+        return 1;
+    }
+    if (litton_name_match("realistic", name, name_len)) {
+        timing->mode = LITTON_IO_REALISTIC;
+        timing->rate = 0;
+        return 1;
+    }
+    while (posn < name_len && name[posn] >= '0' && name[posn] <= '9') {
+        rate = rate * 10 + (name[posn] - '0');
+        if (rate > 10000000UL) {
+            return 0;
+        }
+        ++posn;
+    }
+    if (posn == 0) {
+        return 0;
+    }
+    if (litton_name_match("baud", name + posn, name_len - posn)) {
+        /* Start bit, 8 data bits, and a stop bit for each character */
+        rate /= 10;
+    } else if (posn != name_len &&
+               !litton_name_match("cps", name + posn, name_len - posn)) {
+        return 0;
+    }
+    if (rate == 0) {
+        return 0;
+    }
+    timing->mode = LITTON_IO_CUSTOM;
+    timing->rate = (unsigned)rate;
+    return 1;
+}
+
+int litton_parse_io_timing
+    (litton_state_t *state, const char *spec, size_t spec_len)
+{
+    const char *equals = memchr(spec, '=', spec_len);
+    litton_io_timing_t timing;
+    unsigned long id = 0;
+    size_t name_len;
+    char *end;
+    if (equals) {
+        name_len = (size_t)(equals - spec);
+        if (litton_name_match("printer", spec, name_len)) {
+            id = LITTON_DEVICE_PRINTER;
+        } else if (litton_name_match("punch", spec, name_len)) {
+            id = LITTON_DEVICE_PUNCH;
+        } else if (litton_name_match("keyboard", spec, name_len)) {
+            id = LITTON_DEVICE_KEYBOARD;
+        } else if (litton_name_match("reader", spec, name_len)) {
+            id = LITTON_DEVICE_READER;
+        } else {
+            id = strtoul(spec, &end, 16);
+            if (end != equals || id > 0xFF ||
+                    !litton_is_valid_device_id((uint8_t)id)) {
+                return 0;
+            }
+        }
+        spec_len -= name_len + 1;
+        spec = equals + 1;
+    }
+    if (!litton_io_timing_from_name(&timing, spec, spec_len)) {
+        return 0;
+    }
+    litton_set_io_timing(state, (uint8_t)id, &timing);
+    return 1;
 }
 
 static int litton_count_bits(uint8_t value)
@@ -236,11 +459,101 @@ uint8_t litton_remove_parity(uint8_t value, litton_parity_t parity)
     }
 }
 
+/** Size of the printer's output buffer */
+#define LITTON_PRINTER_BUFFER_SIZE 512
+
+/** Amount of space to keep free in the printer's buffer for one byte of
+ *  output, which may expand into an escape sequence */
+#define LITTON_PRINTER_BUFFER_SPACE 32
+
+typedef struct
+{
+    /** Parent class fields */
+    litton_device_t parent;
+
+    /** Number of bytes in the output buffer */
+    size_t length;
+
+    /** Buffer for output that has not been written to the sink yet */
+    char buffer[LITTON_PRINTER_BUFFER_SIZE];
+
+} litton_printer_info_t;
+
+static void litton_printer_flush
+    (litton_state_t *state, litton_device_t *device)
+{
+    litton_printer_info_t *printer = (litton_printer_info_t *)device;
+    (void)state;
+    if (printer->length > 0) {
+        litton_sink_write(device->sink, printer->buffer, printer->length);
+        litton_sink_flush(device->sink);
+        printer->length = 0;
+    }
+}
+
+static void litton_printer_putc(litton_printer_info_t *printer, char ch)
+{
+    printer->buffer[(printer->length)++] = ch;
+}
+
+static void litton_printer_puts(litton_printer_info_t *printer, const char *str)
+{
+    while (*str != '\0') {
+        printer->buffer[(printer->length)++] = *str++;
+    }
+}
+
+/**
+ * @brief Moves the print head of the printer from one column to another.
+ *
+ * @param[in,out] printer The printer.
+ * @param[in] from The column that the print head is currently in.
+ * @param[in] to The column to move the print head to.
+ *
+ * The move is done in one step with a single cursor escape sequence,
+ * rather than one step for each column.
+ */
+static void litton_printer_move
+    (litton_printer_info_t *printer, unsigned from, unsigned to)
+{
+#if defined(LITTON_TERMIOS)
+    char escape[16];
+    if (to > from + 1) {
+        /* Use "ESC [ n C" for non-destructive spacing */
+        snprintf(escape, sizeof(escape), "\033[%uC", to - from);
+        litton_printer_puts(printer, escape);
+    } else if (to == from + 1) {
+        litton_printer_puts(printer, "\033[C");
+    } else if (from > to + 1) {
+        snprintf(escape, sizeof(escape), "\033[%uD", from - to);
+        litton_printer_puts(printer, escape);
+    } else if (from == to + 1) {
+        litton_printer_putc(printer, '\b');
+    }
+#else
+    while (from < to) {
+        litton_printer_putc(printer, ' ');
+        ++from;
+    }
+    while (from > to) {
+        litton_printer_putc(printer, '\b');
+        --from;
+    }
+#endif
+}
+
 static void litton_printer_output
     (litton_state_t *state, litton_device_t *device,
      uint8_t value, litton_parity_t parity)
 {
-    (void)state;
+    litton_printer_info_t *printer = (litton_printer_info_t *)device;
+    int end_of_line = 0;
+
+    /* Make sure that there is enough room in the buffer for the output */
+    if (printer->length >
+            (LITTON_PRINTER_BUFFER_SIZE - LITTON_PRINTER_BUFFER_SPACE)) {
+        litton_printer_flush(state, device);
+    }
     if (device->charset == LITTON_CHARSET_EBS1231 &&
             parity == LITTON_PARITY_NONE) {
         /* Sometimes OPUS outputs a character with "OI" or "OA"
@@ -256,40 +569,20 @@ static void litton_printer_output
             /* Yes, so space forward or backspace back to put the
              * print head in the right column. */
             --position;
-            while (device->print_position < position) {
-#if defined(LITTON_TERMIOS)
-                /* Use "ESC [ C" for non-destructive spacing */
-                fputs("\033[C", stdout);
-#else
-                putc(' ', stdout);
-#endif
-                ++(device->print_position);
-            }
-            while (device->print_position > position) {
-                putc('\b', stdout);
-                --(device->print_position);
-            }
+            litton_printer_move(printer, device->print_position, position);
+            device->print_position = position;
         } else if (value == 075 || value == 055 || value == 054) {
             /* Line Feed Left / Line Feed Right / Line Feed Both */
-            unsigned col;
-            putc('\r', stdout);
-            putc('\n', stdout);
-            for (col = 0; col < device->print_position; ++col) {
-                /* Space back over to the current print column */
-#if defined(LITTON_TERMIOS)
-                /* Use "ESC [ C" for non-destructive spacing */
-                fputs("\033[C", stdout);
-#else
-                putc(' ', stdout);
-#endif
-            }
+            litton_printer_puts(printer, "\r\n");
+            litton_printer_move(printer, 0, device->print_position);
+            end_of_line = 1;
 #if defined(LITTON_TERMIOS)
         } else if (value == 056) {
             /* Black ribbon print */
-            fputs("\033[m", stdout);
+            litton_printer_puts(printer, "\033[m");
         } else if (value == 074) {
             /* Red ribbon print */
-            fputs("\033[31m", stdout);
+            litton_printer_puts(printer, "\033[31m");
 #endif
         } else {
             /* Convert the code into its ASCII form */
@@ -298,20 +591,20 @@ static void litton_printer_output
                 (value, device->charset, &string_form);
             if (ch == '\n' || ch == '\f') {
                 /* Output a carriage return and line feed */
-                putc('\r', stdout);
-                putc('\n', stdout);
+                litton_printer_puts(printer, "\r\n");
                 device->print_position = 0;
+                end_of_line = 1;
             } else if (ch == '\r') {
-                putc(ch, stdout);
+                litton_printer_putc(printer, ch);
                 device->print_position = 0;
             } else if (ch == '\b') {
-                putc('\b', stdout);
+                litton_printer_putc(printer, '\b');
                 if (device->print_position > 0) {
                     --(device->print_position);
                 }
             } else if (ch >= 0) {
                 /* Single character */
-                putc(ch, stdout);
+                litton_printer_putc(printer, ch);
                 ++(device->print_position);
             } else if (ch == -2) {
                 /* Multi-character string - don't print function keys */
@@ -321,20 +614,28 @@ static void litton_printer_output
         }
     } else if (device->charset == LITTON_CHARSET_HEX) {
         /* Output the bytes in hexadecimal */
+        static char const hex_digits[] = "0123456789ABCDEF";
         if (device->print_position > 0) {
-            putc(' ', stdout);
+            litton_printer_putc(printer, ' ');
         }
-        printf("%02X", value);
+        litton_printer_putc(printer, hex_digits[(value >> 4) & 0x0F]);
+        litton_printer_putc(printer, hex_digits[value & 0x0F]);
         ++(device->print_position);
         if (device->print_position >= 16) {
-            printf("\n");
+            litton_printer_putc(printer, '\n');
             device->print_position = 0;
+            end_of_line = 1;
         }
     } else {
         /* Assume plain ASCII codes as input */
-        putc(value, stdout);
+        litton_printer_putc(printer, value);
+        end_of_line = (value == '\n');
+    }
+
+    /* Flush the output at the end of each line */
+    if (end_of_line) {
+        litton_printer_flush(state, device);
     }
-    fflush(stdout);
 }
 
 void litton_create_default_devices(litton_state_t *state)
@@ -350,15 +651,26 @@ void litton_create_default_devices(litton_state_t *state)
 void litton_add_printer
     (litton_state_t *state, uint8_t id, litton_charset_t charset)
 {
-    litton_device_t *device = calloc(1, sizeof(litton_device_t));
-    device->id = id;
-    device->supports_input = 0;
-    device->supports_output = 1;
-    device->charset = charset;
-    device->output = litton_printer_output;
-    litton_add_device(state, device);
+    litton_printer_info_t *device = calloc(1, sizeof(litton_printer_info_t));
+    device->parent.id = id;
+    device->parent.supports_input = 0;
+    device->parent.supports_output = 1;
+    device->parent.charset = charset;
+    device->parent.output = litton_printer_output;
+    device->parent.close = litton_printer_flush;
+    device->parent.flush = litton_printer_flush;
+    litton_add_device(state, &(device->parent));
 }
 
+/** Size of the keyboard's ring buffer, which must be a power of two */
+#define LITTON_KEYBOARD_RING_SIZE 256
+
+/** Ring buffer entry that indicates end of file on the keyboard */
+#define LITTON_KEYBOARD_EOF 0x100
+
+/** Ring buffer entry that indicates CTRL-C on the keyboard */
+#define LITTON_KEYBOARD_INTERRUPT 0x101
+
 typedef struct
 {
     /** Parent class fields */
@@ -370,6 +682,30 @@ typedef struct
 #if defined(LITTON_TERMIOS)
     /** Saved termios to restore when the program shuts down */
     struct termios tio;
+
+    /** Character set to decode keystrokes into */
+    litton_charset_t charset;
+
+    /** Non-zero if the input reader thread is running */
+    int thread_running;
+
+    /** Input reader thread, which blocks on stdin and decodes keystrokes */
+    pthread_t thread;
+
+    /** Mutex for waiting on the input reader thread */
+    pthread_mutex_t mutex;
+
+    /** Condition that is signalled when a keystroke is added */
+    pthread_cond_t cond;
+
+    /** Ring buffer of keystrokes from the input reader thread */
+    uint16_t ring[LITTON_KEYBOARD_RING_SIZE];
+
+    /** Position to write the next keystroke, written by the reader thread */
+    unsigned head;
+
+    /** Position to read the next keystroke, written by the emulator */
+    unsigned tail;
 #endif
 
 } litton_keyboard_info_t;
@@ -380,6 +716,13 @@ static void litton_keyboard_close
     litton_keyboard_info_t *keyboard = (litton_keyboard_info_t *)device;
     (void)state;
 #if defined(LITTON_TERMIOS)
+    if (keyboard->thread_running) {
+        pthread_cancel(keyboard->thread);
+        pthread_join(keyboard->thread, NULL);
+        pthread_cond_destroy(&(keyboard->cond));
+        pthread_mutex_destroy(&(keyboard->mutex));
+        keyboard->thread_running = 0;
+    }
     if (keyboard->initialized > 0) {
         tcsetattr(0, TCSANOW, &(keyboard->tio));
         keyboard->initialized = 0;
@@ -456,6 +799,93 @@ static int litton_keyboard_read_escape(void)
     return -1;
 }
 
+/**
+ * @brief Adds a keystroke to the keyboard's ring buffer.
+ *
+ * @param[in,out] keyboard The keyboard device.
+ * @param[in] code The keystroke code, or one of the special markers.
+ *
+ * This is called from the input reader thread.
+ */
+static void litton_keyboard_push(litton_keyboard_info_t *keyboard, int code)
+{
+    unsigned head = keyboard->head;
+
+    /* Wait for the program to make room if the ring buffer is full */
+    while ((head - __atomic_load_n(&(keyboard->tail), __ATOMIC_ACQUIRE))
+                >= LITTON_KEYBOARD_RING_SIZE) {
+        usleep(1000);
+    }
+
+    /* Publish the keystroke and wake up the emulator if it is waiting */
+    keyboard->ring[head % LITTON_KEYBOARD_RING_SIZE] = (uint16_t)code;
+    __atomic_store_n(&(keyboard->head), head + 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&(keyboard->mutex));
+    pthread_cond_signal(&(keyboard->cond));
+    pthread_mutex_unlock(&(keyboard->mutex));
+}
+
+/**
+ * @brief Input reader thread for the keyboard.
+ *
+ * @param[in] arg Points to the keyboard device.
+ *
+ * @return Always NULL.
+ *
+ * Blocks on stdin, decodes escape sequences for special keys, and adds
+ * the decoded keystrokes to the keyboard's ring buffer.
+ */
+static void *litton_keyboard_reader(void *arg)
+{
+    litton_keyboard_info_t *keyboard = (litton_keyboard_info_t *)arg;
+    struct pollfd fd;
+    size_t posn;
+    int size;
+    int ch2;
+    char ch;
+    for (;;) {
+        size = read(0, &ch, 1);
+        if (size < 0 && (errno == EINTR || errno == EAGAIN)) {
+            /* Wait for stdin to become readable and try again */
+            fd.fd = 0;
+            fd.events = POLLIN;
+            fd.revents = 0;
+            poll(&fd, 1, -1);
+            continue;
+        } else if (size <= 0) {
+            /* Hangup on remote end of pipe probably */
+            litton_keyboard_push(keyboard, LITTON_KEYBOARD_EOF);
+            break;
+        }
+        if (ch == 0x03) {
+            /* Special case for CTRL-C to clean up and exit the program */
+            litton_keyboard_push(keyboard, LITTON_KEYBOARD_INTERRUPT);
+            continue;
+        } else if (ch == 0x1B && keyboard->charset == LITTON_CHARSET_EBS1231) {
+            /* May be an escape sequence for a special key */
+            ch2 = litton_keyboard_read_escape();
+            if (ch2 >= 0) {
+                /* Escape sequence was mapped to an EBS1231 code */
+                litton_keyboard_push(keyboard, ch2);
+                continue;
+            }
+        }
+        ch2 = litton_char_map_special(ch);
+        if (ch2 >= 0) {
+            /* Special control key */
+            litton_keyboard_push(keyboard, ch2);
+            continue;
+        }
+        posn = 0;
+        ch2 = litton_char_to_charset(&ch, &posn, 1, keyboard->charset);
+        if (ch2 >= 0) {
+            /* We have a valid character in the keyboard's character set */
+            litton_keyboard_push(keyboard, ch2);
+        }
+    }
+    return 0;
+}
+
 #endif /* LITTON_TERMIOS */
 
 int litton_char_map_special(int ch)
@@ -481,7 +911,8 @@ static int litton_keyboard_input
 {
 #if defined(LITTON_TERMIOS)
     litton_keyboard_info_t *keyboard = (litton_keyboard_info_t *)device;
-    struct pollfd fd;
+    unsigned tail;
+    int code;
 
     /* Initialize the device the first time the program asks for input */
     if (!keyboard->initialized) {
@@ -498,62 +929,85 @@ static int litton_keyboard_input
                 }
             }
         }
+
+        /* Start the input reader thread */
+        keyboard->charset = state->keyboard_charset;
+        pthread_mutex_init(&(keyboard->mutex), NULL);
+        pthread_cond_init(&(keyboard->cond), NULL);
+        if (pthread_create(&(keyboard->thread), NULL,
+                           litton_keyboard_reader, keyboard) == 0) {
+            keyboard->thread_running = 1;
+        } else {
+            pthread_cond_destroy(&(keyboard->cond));
+            pthread_mutex_destroy(&(keyboard->mutex));
+        }
     }
 
-    /* Is there input available? */
-    fd.fd = 0;
-    fd.events = POLLIN;
-    fd.revents = 0;
-    if (poll(&fd, 1, 0) > 0 || (fd.revents & (POLLIN | POLLHUP)) != 0) {
-        char ch;
-        int size = read(0, &ch, 1);
-        if (size > 0) {
-            size_t posn = 0;
-            int ch2;
-            if (ch == 0x03) {
-                /* Special case for CTRL-C to clean up and exit the program.
-                 * Otherwise we may have to kill it from another window. */
-                litton_keyboard_close(state, device);
-                putc('^', stdout);
-                putc('C', stdout);
-                putc('\n', stdout);
-                fflush(stdout);
-                exit(1);
-            } else if (ch == 0x1B &&
-                       state->keyboard_charset == LITTON_CHARSET_EBS1231) {
-                /* May be an escape sequence for a special key */
-                ch2 = litton_keyboard_read_escape();
-                if (ch2 >= 0) {
-                    /* Escape sequence was mapped to an EBS1231 code */
-                    *value = litton_add_parity(ch2, parity);
-                    return 1;
-                }
-            }
-            ch2 = litton_char_map_special(ch);
-            if (ch2 >= 0) {
-                /* Special control key */
-                *value = litton_add_parity(ch2, parity);
-                return 1;
-            }
-            ch2 = litton_char_to_charset
-                (&ch, &posn, 1, state->keyboard_charset);
-            if (ch2 >= 0) {
-                /* We have a valid character in the keyboard's character set */
-                *value = litton_add_parity(ch2, parity);
-                return 1;
-            }
-        } else if (size == 0) {
+    /* Make sure that the prompt is visible before we wait for input */
+    litton_flush_devices(state);
+
+    /* Is there input available in the ring buffer? */
+    tail = keyboard->tail;
+    if (tail != __atomic_load_n(&(keyboard->head), __ATOMIC_ACQUIRE)) {
+        code = keyboard->ring[tail % LITTON_KEYBOARD_RING_SIZE];
+        __atomic_store_n(&(keyboard->tail), tail + 1, __ATOMIC_RELEASE);
+        if (code == LITTON_KEYBOARD_INTERRUPT) {
+            /* CTRL-C, so clean up and exit the program.  Otherwise we
+             * may have to kill it from another window. */
+            litton_keyboard_close(state, device);
+            litton_flush_devices(state);
+            putc('^', stdout);
+            putc('C', stdout);
+            putc('\n', stdout);
+            fflush(stdout);
+            exit(1);
+        } else if (code == LITTON_KEYBOARD_EOF) {
             /* Hangup on remote end of pipe probably; exit the program */
             litton_keyboard_close(state, device);
+            litton_flush_devices(state);
             exit(1);
         }
+        *value = litton_add_parity(code, parity);
+        return 1;
     }
+#else
+    (void)state;
+    (void)device;
+    (void)value;
+    (void)parity;
 #endif
 
     /* No input available at this time */
     return 0;
 }
 
+void litton_wait_for_keyboard(litton_state_t *state)
+{
+#if defined(LITTON_TERMIOS)
+    litton_device_t *device = litton_find_device(state, LITTON_DEVICE_KEYBOARD);
+    litton_keyboard_info_t *keyboard = (litton_keyboard_info_t *)device;
+    if (device != 0 && device->input == litton_keyboard_input &&
+            keyboard->thread_running) {
+        /* Sleep until the input reader thread adds a keystroke */
+        pthread_mutex_lock(&(keyboard->mutex));
+        while (keyboard->tail ==
+                    __atomic_load_n(&(keyboard->head), __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&(keyboard->cond), &(keyboard->mutex));
+        }
+        pthread_mutex_unlock(&(keyboard->mutex));
+    } else {
+        /* No input reader thread, so wait on stdin directly */
+        struct pollfd fd;
+        fd.fd = 0;
+        fd.events = POLLIN;
+        fd.revents = 0;
+        poll(&fd, 1, -1);
+    }
+#else
+    (void)state;
+#endif
+}
+
 void litton_add_keyboard
     (litton_state_t *state, uint8_t id, litton_charset_t charset)
 {
@@ -572,20 +1026,20 @@ static void litton_tape_punch_output
      uint8_t value, litton_parity_t parity)
 {
     int ch;
+    char buffer;
     const char *string_form;
-    FILE *file = device->file;
-    if (!file) {
-        file = stdout;
+    if (!(device->sink)) {
+        /* Keep the punched data in order with the printer output */
+        litton_flush_devices(state);
     }
-    (void)state;
     value = litton_remove_parity(value, parity);
     ch = litton_char_from_charset(value, device->charset, &string_form);
     if (ch == -2) {
-        fputs(string_form, file);
+        litton_sink_write(device->sink, string_form, strlen(string_form));
     } else {
-        putc(ch, file);
+        buffer = (char)ch;
+        litton_sink_write(device->sink, &buffer, 1);
     }
-    fflush(file);
 }
 
 void litton_add_tape_punch
@@ -604,73 +1058,9 @@ static int litton_tape_reader_input
     (litton_state_t *state, litton_device_t *device,
      uint8_t *value, litton_parity_t parity)
 {
-    char buffer[16];
-    int ch, lastch;
-    size_t posn, len;
-
     /* Read from the tape input file if we have one */
-    if (device->file) {
-        ch = getc(device->file);
-        if (ch != EOF) {
-            if (device->charset == LITTON_CHARSET_EBS1231) {
-                buffer[0] = (char)ch;
-                len = 1;
-                if (ch == '[') {
-                    /* Special function key sequence [x] */
-                    lastch = ']';
-                } else if (ch == '{') {
-                    /* Printer position sequence {n} */
-                    lastch = '}';
-                } else {
-                    /* Singleton character */
-                    lastch = 0;
-                }
-                while (lastch && len < sizeof(buffer)) {
-                    ch = getc(device->file);
-                    if (ch == EOF) {
-                        break;
-                    } else if (ch == lastch) {
-                        buffer[len++] = (char)ch;
-                        break;
-                    }
-                    buffer[len++] = (char)ch;
-                }
-                posn = 0;
-                ch = litton_char_to_charset
-                    (buffer, &posn, len, LITTON_CHARSET_EBS1231);
-                if (ch >= 0) {
-                    /* Add parity and return the character to the caller */
-                    *value = litton_add_parity(ch, parity);
-
-                    /* Lookahead to the next input byte and close the file
-                     * now if we have reached EOF.  OPUS stops reading a
-                     * tape when it sees ',' and we don't want to leave the
-                     * file open if no more reading will occur. */
-                    ch = getc(device->file);
-                    if (ch == EOF) {
-                        fclose(device->file);
-                        device->file = 0;
-                    } else {
-                        ungetc(ch, device->file);
-                    }
-                    return 1;
-                }
-                return 0;
-            } else {
-                /* Plain ASCII tape */
-                if (device->charset == LITTON_CHARSET_UASCII) {
-                    if (ch >= 'a' && ch <= 'z') {
-                        ch = ch - 'a' + 'A';
-                    }
-                }
-                *value = litton_add_parity(ch, parity);
-                return 1;
-            }
-        }
-
-        /* File is exhausted, so close it and revert to the keyboard */
-        fclose(device->file);
-        device->file = 0;
+    if (litton_read_input_tape(device, value, parity)) {
+        return 1;
     }
 
     /* Find the keyboard device and read from that instead */
@@ -693,22 +1083,289 @@ void litton_add_tape_reader
     litton_add_device(state, device);
 }
 
+/**
+ * @brief Decodes the text of a tape into a sequence of byte codes.
+ *
+ * @param[out] output Buffer that receives the byte codes, which must be
+ * at least as long as the text.
+ * @param[in] text Points to the text of the tape.
+ * @param[in] size Size of the text.
+ * @param[in] charset Character set of the tape reader.
+ *
+ * @return The number of byte codes that were written to @a output.
+ */
+static size_t litton_decode_tape
+    (uint8_t *output, const char *text, size_t size, litton_charset_t charset)
+{
+    char buffer[16];
+    size_t count = 0;
+    size_t offset = 0;
+    size_t posn, len;
+    int ch, lastch;
+    while (offset < size) {
+        ch = (unsigned char)(text[offset++]);
+        if (charset == LITTON_CHARSET_EBS1231) {
+            buffer[0] = (char)ch;
+            len = 1;
+            if (ch == '[') {
+                /* Special function key sequence [x] */
+                lastch = ']';
+            } else if (ch == '{') {
+                /* Printer position sequence {n} */
+                lastch = '}';
+            } else {
+                /* Singleton character */
+                lastch = 0;
+            }
+            while (lastch && len < sizeof(buffer) && offset < size) {
+                ch = text[offset++];
+                buffer[len++] = (char)ch;
+                if (ch == lastch) {
+                    break;
+                }
+            }
+            posn = 0;
+            ch = litton_char_to_charset
+                (buffer, &posn, len, LITTON_CHARSET_EBS1231);
+            if (ch >= 0) {
+                output[count++] = (uint8_t)ch;
+            }
+        } else {
+            /* Plain ASCII tape */
+            if (charset == LITTON_CHARSET_UASCII) {
+                if (ch >= 'a' && ch <= 'z') {
+                    ch = ch - 'a' + 'A';
+                }
+            }
+            output[count++] = (uint8_t)ch;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Determine if a byte can appear in a text tape.
+ *
+ * @param[in] ch The byte.
+ *
+ * @return Non-zero if @a ch is printable ASCII or white space.
+ */
+static int litton_is_tape_text(uint8_t ch)
+{
+    return (ch >= 0x20 && ch <= 0x7E) || ch == '\r' || ch == '\n' ||
+           ch == '\t' || ch == '\f' || ch == '\b';
+}
+
+/**
+ * @brief Detects the format of a tape from its contents.
+ *
+ * @param[in] data Points to the contents of the tape file.
+ * @param[in] size Size of the tape file.
+ *
+ * @return The format of the tape.
+ *
+ * Tapes that only contain printable ASCII are text.  Text tapes are
+ * unlikely to contain control characters, but the frames of a binary tape
+ * do because the EBS1231 codes for digits and the tape leader are small.
+ * Every frame of a punched tape has odd parity, which distinguishes it
+ * from a raw tape.
+ */
+static litton_tape_format_t litton_detect_tape_format
+    (const uint8_t *data, size_t size)
+{
+    int binary = 0;
+    int all_odd = 1;
+    size_t posn;
+    for (posn = 0; posn < size; ++posn) {
+        if (!litton_is_tape_text(data[posn])) {
+            binary = 1;
+        }
+        if (((litton_count_bits(data[posn]) + (data[posn] >> 7)) & 1) == 0) {
+            all_odd = 0;
+        }
+        if (binary && !all_odd) {
+            return LITTON_TAPE_RAW;
+        }
+    }
+    if (!binary) {
+        return LITTON_TAPE_TEXT;
+    }
+    return LITTON_TAPE_PUNCHED;
+}
+
+/**
+ * @brief Decodes the frames of a binary tape into a sequence of byte codes.
+ *
+ * @param[out] output Buffer that receives the byte codes, which must be
+ * at least as long as the data.  This may be the same as @a data.
+ * @param[in] data Points to the frames of the tape.
+ * @param[in] size Number of frames.
+ * @param[in] format The binary format, LITTON_TAPE_PUNCHED or LITTON_TAPE_RAW.
+ *
+ * @return The number of byte codes that were written to @a output.
+ *
+ * Blank frames at the start and end of the tape are leader and trailer,
+ * which are skipped.
+ */
+static size_t litton_decode_binary_tape
+    (uint8_t *output, const uint8_t *data, size_t size,
+     litton_tape_format_t format)
+{
+    size_t start = 0;
+    size_t posn;
+    if (format == LITTON_TAPE_PUNCHED) {
+        /* The fifth track is the parity bit, and the upper bits of the
+         * code are punched in the sixth to eighth tracks */
+        while (start < size && (data[start] & 0xEF) == 0) {
+            ++start;
+        }
+        while (size > start && (data[size - 1] & 0xEF) == 0) {
+            --size;
+        }
+        for (posn = start; posn < size; ++posn) {
+            output[posn - start] = (data[posn] & 0x0F) |
+                                   ((data[posn] >> 1) & 0x70);
+        }
+    } else {
+        /* One code in each frame, with parity in the high bit */
+        while (start < size && (data[start] & 0x7F) == 0) {
+            ++start;
+        }
+        while (size > start && (data[size - 1] & 0x7F) == 0) {
+            --size;
+        }
+        for (posn = start; posn < size; ++posn) {
+            output[posn - start] = data[posn] & 0x7F;
+        }
+    }
+    return size - start;
+}
+
+/**
+ * @brief Decodes the contents of a tape file into a sequence of byte codes.
+ *
+ * @param[out] output Buffer that receives the byte codes, which must be
+ * at least as long as the data.  This may be the same as @a data.
+ * @param[in] data Points to the contents of the tape file.
+ * @param[in] size Size of the tape file.
+ * @param[in] format Format of the tape file.
+ * @param[in] charset Character set of the tape reader.
+ *
+ * @return The number of byte codes that were written to @a output.
+ */
+static size_t litton_decode_tape_file
+    (uint8_t *output, const uint8_t *data, size_t size,
+     litton_tape_format_t format, litton_charset_t charset)
+{
+    if (format == LITTON_TAPE_AUTO) {
+        format = litton_detect_tape_format(data, size);
+    }
+    if (format == LITTON_TAPE_TEXT) {
+        return litton_decode_tape
+            (output, (const char *)data, size, charset);
+    } else {
+        return litton_decode_binary_tape(output, data, size, format);
+    }
+}
+
+/**
+ * @brief Loads the contents of a tape file and decodes it.
+ *
+ * @param[in,out] device The tape reader device to load the tape into.
+ * @param[in] file The tape file.
+ * @param[in] format Format of the tape file.
+ *
+ * @return Non-zero if the tape was loaded, or zero on error.
+ */
+static int litton_load_tape
+    (litton_device_t *device, FILE *file, litton_tape_format_t format)
+{
+    char *text = 0;
+    size_t size = 0;
+    size_t max_size = 0;
+    size_t len;
+#if defined(LITTON_TERMIOS)
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size > 0) {
+        /* Map the file into memory and decode it in one pass */
+        void *map = mmap(0, (size_t)(st.st_size), PROT_READ,
+                         MAP_PRIVATE, fileno(file), 0);
+        if (map != MAP_FAILED) {
+            size = (size_t)(st.st_size);
+            device->tape_data = malloc(size);
+            if (!(device->tape_data)) {
+                munmap(map, size);
+                return 0;
+            }
+            device->tape_size = litton_decode_tape_file
+                (device->tape_data, (const uint8_t *)map, size,
+                 format, device->charset);
+            munmap(map, size);
+            return 1;
+        }
+    }
+#endif
+
+    /* Not a regular file, so read the contents in bulk into a buffer */
+    for (;;) {
+        if (size >= max_size) {
+            char *new_text;
+            max_size = max_size ? max_size * 2 : 4096;
+            new_text = realloc(text, max_size);
+            if (!new_text) {
+                free(text);
+                return 0;
+            }
+            text = new_text;
+        }
+        len = fread(text + size, 1, max_size - size, file);
+        if (len == 0) {
+            break;
+        }
+        size += len;
+    }
+    device->tape_size = litton_decode_tape_file
+        ((uint8_t *)text, (const uint8_t *)text, size,
+         format, device->charset);
+    device->tape_data = (uint8_t *)text;
+    return 1;
+}
+
 int litton_set_input_tape(litton_state_t *state, const char *filename)
+{
+    return litton_set_input_tape_format(state, filename, LITTON_TAPE_AUTO);
+}
+
+int litton_set_input_tape_format
+    (litton_state_t *state, const char *filename,
+     litton_tape_format_t format)
 {
     litton_device_t *device;
+    FILE *file;
+    int ok;
     device = litton_find_device(state, LITTON_DEVICE_READER);
     if (!device) {
         fprintf(stderr, "No tape reader device available\n");
         return 0;
     }
-    if (device->file) {
-        fclose(device->file);
-    }
-    device->file = fopen(filename, "r");
-    if (device->file == 0) {
+    litton_close_input_tape(state);
+    file = fopen(filename, "rb");
+    if (file == 0) {
         perror(filename);
         return 0;
     }
+    ok = litton_load_tape(device, file, format);
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "%s: out of memory\n", filename);
+        return 0;
+    }
+    device->tape_posn = 0;
+    if (device->tape_size == 0) {
+        /* Nothing on the tape, so there is nothing to read */
+        litton_close_input_tape(state);
+    }
     return 1;
 }
 
@@ -717,18 +1374,61 @@ void litton_close_input_tape(litton_state_t *state)
     litton_device_t *device;
     device = litton_find_device(state, LITTON_DEVICE_READER);
     if (device != 0) {
-        if (device->file) {
-            fclose(device->file);
-            device->file = 0;
-        }
+        free(device->tape_data);
+        device->tape_data = 0;
+        device->tape_size = 0;
+        device->tape_posn = 0;
+    }
+}
+
+int litton_tape_format_from_name
+    (litton_tape_format_t *format, const char *name, size_t name_len)
+{
+    if (litton_name_match("auto", name, name_len)) {
+        *format = LITTON_TAPE_AUTO;
+        return 1;
+    }
+    if (litton_name_match("text", name, name_len)) {
+        *format = LITTON_TAPE_TEXT;
+        return 1;
+    }
+    if (litton_name_match("punched", name, name_len)) {
+        *format = LITTON_TAPE_PUNCHED;
+        return 1;
     }
+    if (litton_name_match("raw", name, name_len)) {
+        *format = LITTON_TAPE_RAW;
+        return 1;
+    }
+    return 0;
 }
 
 int litton_has_input_tape(litton_state_t *state)
 {
     litton_device_t *device;
     device = litton_find_device(state, LITTON_DEVICE_READER);
-    return device != 0 && device->file != 0;
+    return device != 0 && device->tape_data != 0;
+}
+
+int litton_read_input_tape
+    (litton_device_t *device, uint8_t *value, litton_parity_t parity)
+{
+    if (!(device->tape_data)) {
+        return 0;
+    }
+    *value = litton_add_parity
+        (device->tape_data[(device->tape_posn)++], parity);
+
+    /* Unmount the tape once the last byte has been read.  OPUS stops
+     * reading a tape when it sees ',' and we don't want to leave the
+     * tape mounted if no more reading will occur. */
+    if (device->tape_posn >= device->tape_size) {
+        free(device->tape_data);
+        device->tape_data = 0;
+        device->tape_size = 0;
+        device->tape_posn = 0;
+    }
+    return 1;
 }
 
 int litton_set_output_tape
@@ -740,14 +1440,15 @@ int litton_set_output_tape
         fprintf(stderr, "No tape punch device available\n");
         return 0;
     }
-    if (device->file) {
-        fclose(device->file);
-    }
+    litton_close_output_tape(state);
     device->file = fopen(filename, append ? "a" : "w");
     if (device->file == 0) {
         perror(filename);
         return 0;
     }
+
+    /* The punch writes to the tape file until it is closed */
+    litton_set_device_sink(device, litton_create_file_sink(device->file, 0));
     return 1;
 }
 
@@ -757,6 +1458,7 @@ void litton_close_output_tape(litton_state_t *state)
     device = litton_find_device(state, LITTON_DEVICE_PUNCH);
     if (device != 0) {
         if (device->file) {
+            litton_set_device_sink(device, 0);
             fclose(device->file);
             device->file = 0;
         }
@@ -903,18 +1605,137 @@ static const char * const litton_EBS1231_to_ASCII[128] = {
     /* 177 */           "{190}"
 };
 
-static int litton_ebs1231_match
-    (const char *str, size_t *posn, size_t len, const char *sequence)
+/** Size of the hash table for multi-character EBS1231 sequences */
+#define LITTON_EBS1231_HASH_SIZE 256
+
+/** Maximum length of a multi-character EBS1231 sequence like "[IIII]" */
+#define LITTON_EBS1231_MAX_SEQUENCE 8
+
+/** Maps single ASCII characters to EBS1231 codes, or -1 if no mapping */
+static int8_t litton_EBS1231_single[256];
+
+/** Hash table of multi-character sequences; each entry is the EBS1231
+ *  code plus 1, or zero if the entry is empty */
+static uint8_t litton_EBS1231_multi[LITTON_EBS1231_HASH_SIZE];
+
+/** Non-zero once the EBS1231 lookup tables have been built */
+static uint8_t litton_EBS1231_ready;
+
+static unsigned litton_ebs1231_hash(const char *str, size_t len)
 {
-    size_t seq_len = strlen(sequence);
-    if ((*posn + seq_len) > len) {
-        return 0;
+    unsigned hash = 0;
+    int ch;
+    while (len > 0) {
+        ch = *str++;
+        if (ch >= 'a' && ch <= 'z') {
+            ch = ch - 'a' + 'A';
+        }
+        hash = hash * 31 + (ch & 0xFF);
+        --len;
     }
-    if (litton_name_match(sequence, str + *posn, seq_len)) {
-        *posn += seq_len;
-        return 1;
+    return hash % LITTON_EBS1231_HASH_SIZE;
+}
+
+void litton_charset_init(void)
+{
+    const char *sequence;
+    size_t len;
+    unsigned hash;
+    int ch;
+    if (litton_EBS1231_ready) {
+        return;
     }
-    return 0;
+    memset(litton_EBS1231_single, 0xFF, sizeof(litton_EBS1231_single));
+    memset(litton_EBS1231_multi, 0, sizeof(litton_EBS1231_multi));
+    for (ch = 0; ch < 128; ++ch) {
+        /* If there are duplicates, the first one in the table wins */
+        sequence = litton_EBS1231_to_ASCII[ch];
+        len = strlen(sequence);
+        if (len == 1) {
+            int ch2 = sequence[0] & 0xFF;
+            if (litton_EBS1231_single[ch2] < 0) {
+                litton_EBS1231_single[ch2] = ch;
+            }
+            if (ch2 >= 'A' && ch2 <= 'Z') {
+                ch2 = ch2 - 'A' + 'a';
+                if (litton_EBS1231_single[ch2] < 0) {
+                    litton_EBS1231_single[ch2] = ch;
+                }
+            }
+        } else {
+            /* Insert multi-character sequences with linear probing */
+            hash = litton_ebs1231_hash(sequence, len);
+            while (litton_EBS1231_multi[hash] != 0) {
+                if (litton_name_match
+                        (litton_EBS1231_to_ASCII
+                            [litton_EBS1231_multi[hash] - 1],
+                         sequence, len)) {
+                    break;
+                }
+                hash = (hash + 1) % LITTON_EBS1231_HASH_SIZE;
+            }
+            if (litton_EBS1231_multi[hash] == 0) {
+                litton_EBS1231_multi[hash] = (uint8_t)(ch + 1);
+            }
+        }
+    }
+    litton_EBS1231_ready = 1;
+}
+
+/**
+ * @brief Decodes the next EBS1231 character from a string.
+ *
+ * @param[in] str Points to the start of the string to convert.
+ * @param[in,out] posn Current position in the string.
+ * @param[in] len Length of the string.
+ *
+ * @return The EBS1231 code, or -1 if there is no mapping.
+ *
+ * Multi-character sequences are delimited by "[...]" or "{...}", so we
+ * find the end of the sequence and then look it up in the hash table.
+ */
+static int litton_ebs1231_decode(const char *str, size_t *posn, size_t len)
+{
+    const char *start = str + *posn;
+    size_t avail = len - *posn;
+    size_t seq_len;
+    unsigned hash;
+    int lastch;
+    int ch;
+    if (start[0] == '[') {
+        lastch = ']';
+    } else if (start[0] == '{') {
+        lastch = '}';
+    } else {
+        lastch = 0;
+    }
+    if (lastch) {
+        if (avail > LITTON_EBS1231_MAX_SEQUENCE) {
+            avail = LITTON_EBS1231_MAX_SEQUENCE;
+        }
+        for (seq_len = 1; seq_len < avail; ++seq_len) {
+            if (start[seq_len] == lastch) {
+                break;
+            }
+        }
+        if (seq_len < avail) {
+            ++seq_len;
+            hash = litton_ebs1231_hash(start, seq_len);
+            while ((ch = litton_EBS1231_multi[hash]) != 0) {
+                if (litton_name_match
+                        (litton_EBS1231_to_ASCII[ch - 1], start, seq_len)) {
+                    *posn += seq_len;
+                    return ch - 1;
+                }
+                hash = (hash + 1) % LITTON_EBS1231_HASH_SIZE;
+            }
+        }
+    }
+    ch = litton_EBS1231_single[start[0] & 0xFF];
+    if (ch >= 0) {
+        ++(*posn);
+    }
+    return ch;
 }
 
 int litton_char_to_charset
@@ -940,15 +1761,9 @@ int litton_char_to_charset
 
     case LITTON_CHARSET_EBS1231:
     case LITTON_CHARSET_HEX: /* Not supported for input at the moment */
-        /* Scan the EBS1231 mapping table to find a match */
-        for (ch = 0; ch < 128; ++ch) {
-            if (litton_ebs1231_match
-                    (str, posn, len, litton_EBS1231_to_ASCII[ch])) {
-                return ch;
-            }
-        }
-        ch = -1; /* Not found */
-        break;
+        /* Look up the sequence in the EBS1231 decoding tables */
+        litton_charset_init();
+        return litton_ebs1231_decode(str, posn, len);
     }
     return -1;
 }
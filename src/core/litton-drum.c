@@ -211,6 +211,13 @@ int litton_load_drum
                 } else {
                     state->keyboard_id = (uint8_t)keyboard_device;
                 }
+            } else if (!strncmp(buffer, "#IO-Timing: ", 12)) {
+                if (!litton_parse_io_timing
+                        (state, buffer + 12, strlen(buffer + 12))) {
+                    fprintf(stderr, "%s:%lu: invalid I/O timing\n",
+                            filename, line);
+                    ok = 0;
+                }
             }
         } else if (buffer[0] != '\0') {
             unsigned long addr = 0;
@@ -234,10 +241,37 @@ int litton_load_drum
     return ok;
 }
 
+/**
+ * @brief Writes an I/O timing descriptor to a drum image as metadata.
+ *
+ * @param[in] file The file to write to.
+ * @param[in] id The device identifier, or zero for the machine-wide default.
+ * @param[in] timing The timing descriptor.
+ */
+static void litton_save_io_timing
+    (FILE *file, unsigned id, const litton_io_timing_t *timing)
+{
+    if (timing->mode == LITTON_IO_DEFAULT) {
+        return;
+    }
+    fprintf(file, "#IO-Timing: ");
+    if (id != 0) {
+        fprintf(file, "%02X=", id);
+    }
+    if (timing->mode == LITTON_IO_INSTANT) {
+        fprintf(file, "instant\n");
+    } else if (timing->mode == LITTON_IO_CUSTOM) {
+        fprintf(file, "%ucps\n", timing->rate);
+    } else {
+        fprintf(file, "realistic\n");
+    }
+}
+
 int litton_save_drum(litton_state_t *state, const char *filename)
 {
     FILE *file;
     unsigned addr;
+    unsigned id;
     file = fopen(filename, "w");
     if (!file) {
         perror(filename);
@@ -256,6 +290,9 @@ int litton_save_drum(litton_state_t *state, const char *filename)
     if (state->keyboard_id != 0) {
         fprintf(file, "#Keyboard-Device: %02X\n", state->keyboard_id);
     }
+    for (id = 0; id < 256; ++id) {
+        litton_save_io_timing(file, id, &(state->io_timing[id]));
+    }
     for (addr = 0; addr < state->drum_size; ++addr) {
         fprintf(file, "%03X:%010LX\n", addr,
                 (unsigned long long)(litton_get_memory(state, addr)));
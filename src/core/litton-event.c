@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "litton/litton.h"
+#include "litton-internal.h"
+
+/**
+ * @brief Moves an event up the heap until its parent is earlier.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] index Index of the event to move.
+ */
+static void litton_event_sift_up(litton_state_t *state, unsigned index)
+{
+    litton_event_t *events = state->events;
+    litton_event_t event = events[index];
+    unsigned parent;
+    while (index > 0) {
+        parent = (index - 1) / 2;
+        if (events[parent].when <= event.when) {
+            break;
+        }
+        events[index] = events[parent];
+        index = parent;
+    }
+    events[index] = event;
+}
+
+/**
+ * @brief Moves an event down the heap until its children are later.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] index Index of the event to move.
+ */
+static void litton_event_sift_down(litton_state_t *state, unsigned index)
+{
+    litton_event_t *events = state->events;
+    litton_event_t event = events[index];
+    unsigned count = state->num_events;
+    unsigned child;
+    for (;;) {
+        child = index * 2 + 1;
+        if (child >= count) {
+            break;
+        }
+        if ((child + 1) < count && events[child + 1].when < events[child].when) {
+            ++child;
+        }
+        if (event.when <= events[child].when) {
+            break;
+        }
+        events[index] = events[child];
+        index = child;
+    }
+    events[index] = event;
+}
+
+/**
+ * @brief Updates the deadline of the earliest pending event.
+ *
+ * @param[in,out] state The state of the computer.
+ */
+static void litton_event_update_next(litton_state_t *state)
+{
+    if (state->num_events > 0) {
+        state->next_event = state->events[0].when;
+    } else {
+        state->next_event = UINT64_MAX;
+    }
+}
+
+/**
+ * @brief Removes an event from the heap.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] index Index of the event to remove.
+ */
+static void litton_event_remove(litton_state_t *state, unsigned index)
+{
+    --(state->num_events);
+    if (index < state->num_events) {
+        state->events[index] = state->events[state->num_events];
+        litton_event_sift_down(state, index);
+        litton_event_sift_up(state, index);
+    }
+}
+
+/**
+ * @brief Finds a pending event.
+ *
+ * @param[in] state The state of the computer.
+ * @param[in] handler Handler for the event.
+ * @param[in] arg Argument for the event.
+ *
+ * @return Index of the event, or -1 if there is no such event pending.
+ */
+static int litton_event_find
+    (const litton_state_t *state, litton_event_handler_t handler, void *arg)
+{
+    unsigned index;
+    for (index = 0; index < state->num_events; ++index) {
+        if (state->events[index].handler == handler &&
+                state->events[index].arg == arg) {
+            return (int)index;
+        }
+    }
+    return -1;
+}
+
+int litton_schedule_event
+    (litton_state_t *state, uint64_t when,
+     litton_event_handler_t handler, void *arg)
+{
+    int index = litton_event_find(state, handler, arg);
+    if (index >= 0) {
+        /* Reschedule the existing event */
+        state->events[index].when = when;
+        litton_event_sift_down(state, (unsigned)index);
+        litton_event_sift_up(state, (unsigned)index);
+        litton_event_update_next(state);
+        return 1;
+    }
+    if (state->num_events >= LITTON_MAX_EVENTS) {
+        return 0;
+    }
+    index = (int)((state->num_events)++);
+    state->events[index].when = when;
+    state->events[index].handler = handler;
+    state->events[index].arg = arg;
+    litton_event_sift_up(state, (unsigned)index);
+    if (when < state->next_event) {
+        state->next_event = when;
+    }
+    return 1;
+}
+
+int litton_event_deadline
+    (const litton_state_t *state, litton_event_handler_t handler, void *arg,
+     uint64_t *when)
+{
+    int index = litton_event_find(state, handler, arg);
+    if (index >= 0) {
+        *when = state->events[index].when;
+        return 1;
+    }
+    return 0;
+}
+
+void litton_cancel_event
+    (litton_state_t *state, litton_event_handler_t handler, void *arg)
+{
+    int index = litton_event_find(state, handler, arg);
+    if (index >= 0) {
+        litton_event_remove(state, (unsigned)index);
+        litton_event_update_next(state);
+    }
+}
+
+void litton_dispatch_events(litton_state_t *state)
+{
+    litton_event_t event;
+    while (state->next_event <= state->cycle_counter) {
+        /* Remove the event before calling the handler in case the
+         * handler wants to schedule the event again */
+        event = state->events[0];
+        litton_event_remove(state, 0);
+        litton_event_update_next(state);
+        (*(event.handler))(state, event.arg);
+    }
+}
@@ -21,6 +21,7 @@
  */
 
 #include "litton/litton.h"
+#include <string.h>
 
 uint32_t litton_get_status_lights(litton_state_t *state)
 {
@@ -375,3 +376,51 @@ void litton_update_status_lights(litton_state_t *state)
         }
     }
 }
+
+void litton_lamp_sampler_init
+    (litton_lamp_sampler_t *sampler, const litton_state_t *state)
+{
+    memset(sampler, 0, sizeof(litton_lamp_sampler_t));
+    sampler->last_cycle = state->cycle_counter;
+}
+
+void litton_sample_lamps(litton_lamp_sampler_t *sampler, litton_state_t *state)
+{
+    uint64_t elapsed = state->cycle_counter - sampler->last_cycle;
+    uint32_t lights;
+    int bit;
+
+    /* The lights are assumed to have been in their current state since
+     * the last sample, which is accurate enough at quantum granularity */
+    litton_update_status_lights(state);
+    lights = state->status_lights;
+    for (bit = 0; lights != 0 && bit < LITTON_NUM_LAMPS; ++bit, lights >>= 1) {
+        if ((lights & 1) != 0) {
+            sampler->on_cycles[bit] += elapsed;
+        }
+    }
+    sampler->total_cycles += elapsed;
+    sampler->last_cycle = state->cycle_counter;
+}
+
+int litton_lamp_brightness
+    (const litton_lamp_sampler_t *current,
+     const litton_lamp_sampler_t *previous,
+     uint32_t lamp, int max_level)
+{
+    uint64_t total = current->total_cycles - previous->total_cycles;
+    uint64_t on;
+    int bit = 0;
+    if (!total || !lamp) {
+        return -1;
+    }
+    while ((lamp & 1) == 0) {
+        lamp >>= 1;
+        ++bit;
+    }
+    if (bit >= LITTON_NUM_LAMPS) {
+        return -1;
+    }
+    on = current->on_cycles[bit] - previous->on_cycles[bit];
+    return (int)((on * (uint64_t)max_level + total / 2) / total);
+}
@@ -0,0 +1,892 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LITTON_INTERNAL_H
+#define LITTON_INTERNAL_H
+
+#include "litton/litton.h"
+
+/* Definitions that are shared between the execution engines in the core.
+ * This is not part of the public API. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def LITTON_INLINE
+ * @brief Forces a function to be inlined into its callers when the
+ * compiler supports it.
+ */
+#if defined(__GNUC__)
+#define LITTON_INLINE inline __attribute__((always_inline))
+#else
+#define LITTON_INLINE inline
+#endif
+
+/**
+ * @def LITTON_COMPUTED_GOTO
+ * @brief Set to 1 to use computed goto for dispatch, or 0 to use a switch.
+ */
+#if !defined(LITTON_COMPUTED_GOTO)
+#if defined(__GNUC__)
+#define LITTON_COMPUTED_GOTO 1
+#else
+#define LITTON_COMPUTED_GOTO 0
+#endif
+#endif
+
+/**
+ * @brief Adds the basic opcode timing to the cycle counter.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] word_times The number of word times for executing the opcode.
+ */
+static inline void litton_add_opcode_timing
+    (litton_state_t *state, unsigned word_times)
+{
+    /* Credit the number of cycles for the opcode */
+    state->cycle_counter += word_times * LITTON_WORD_BITS;
+
+    /* While the instruction is executing, the drum will keep rotating.
+     * Predict which word it is on now. */
+    state->rotation_predictor += word_times;
+    state->rotation_predictor &= (LITTON_DRUM_NUM_SECTORS - 1);
+}
+
+/**
+ * @brief Adds memory timing for access to a specific address.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] addr The memory address that was accessed.
+ */
+static inline void litton_add_memory_timing
+    (litton_state_t *state, litton_drum_loc_t addr)
+{
+    unsigned word_times;
+
+    /* Record the address for the benefit of the front panel TRACK light */
+    state->last_address = addr;
+
+    /* Correct for scratchpad addresses.  Each scratchpad register loops
+     * around every 8 words, so use the offset from the current position. */
+    if (addr < LITTON_DRUM_RESERVED_SECTORS) {
+        unsigned offset =
+            state->rotation_predictor & (LITTON_DRUM_RESERVED_SECTORS - 1);
+        if (offset <= addr) {
+            /* We haven't seen this scratchpad register on this loop,
+             * so we will be coming across it in the current loop soon. */
+            addr |= state->rotation_predictor & ~(LITTON_DRUM_RESERVED_SECTORS - 1);
+        } else {
+            /* Scratchpad register has already passed, so we need to wait
+             * for the next loop to begin before we can access it. */
+            addr |= state->rotation_predictor & ~(LITTON_DRUM_RESERVED_SECTORS - 1);
+            addr += LITTON_DRUM_RESERVED_SECTORS;
+        }
+    }
+
+    /* Rotation prediction is based on the sector number within the track */
+    addr &= (LITTON_DRUM_NUM_SECTORS - 1);
+    if (addr >= state->rotation_predictor) {
+        /* Sector number is still in our future on this track */
+        word_times = addr - state->rotation_predictor;
+    } else {
+        /* Sector number is behind us, so wait for it to rotate around again */
+        word_times = addr + (LITTON_DRUM_NUM_SECTORS - state->rotation_predictor);
+    }
+
+    /* Account for the time to seek to the sector */
+    litton_add_opcode_timing(state, word_times);
+
+    /* Account for the time to read or write the sector */
+    litton_add_opcode_timing(state, 1);
+}
+
+/**
+ * @brief Rotates the CR/I register pair by 8 bits.
+ *
+ * @param[in,out] state The state of the computer.
+ */
+static inline void litton_rotate_8(litton_state_t *state)
+{
+    state->I = (state->I << 8) | state->CR;
+    state->CR = (uint8_t)(state->I >> LITTON_WORD_BITS);
+    state->I &= LITTON_WORD_MASK;
+}
+
+/**
+ * @brief Determine if there is a breakpoint on a drum address.
+ *
+ * @param[in] state The state of the computer.
+ * @param[in] addr The address to check.
+ *
+ * @return Non-zero if there is a breakpoint on @a addr.
+ */
+#define litton_is_breakpoint(state, addr) \
+    (((state)->breakpoints[((addr) & (LITTON_DRUM_MAX_SIZE - 1)) >> 3] & \
+      (1 << ((addr) & 0x07))) != 0)
+
+/**
+ * @brief Determine if the program has just jumped into a delay loop.
+ *
+ * @param[in] state The state of the computer.
+ *
+ * @return Non-zero if the word in CR/I is a binary shift of A followed
+ * by a conditional jump back to the same word.
+ *
+ * Programs like OPUS use such loops to wait for a device to be ready
+ * after selecting it.  The loop keeps going until K is zero.
+ */
+#define litton_is_delay_loop(state) \
+    (((state)->CR & 0xF7) == 0x40 && \
+     (((state)->I >> 16) & 0xFFFF) == (LOP_JC | (state)->PC))
+
+/**
+ * @brief Skips over the iterations of a delay loop in one step.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_instructions Maximum number of instructions to execute.
+ * @param[in] end_cycles Value of the cycle counter to stop at.
+ *
+ * @return The number of instructions that were executed or skipped.
+ *
+ * The state afterwards is the same as if the loop had been run one
+ * instruction at a time, stopping after the same number of instructions
+ * as litton_run() would within the @a max_instructions and
+ * @a end_cycles budgets.  This should only be called when the program
+ * has just jumped and litton_is_delay_loop() is true.
+ */
+uint64_t litton_skip_delay_loop
+    (litton_state_t *state, uint64_t max_instructions, uint64_t end_cycles);
+
+/**
+ * @brief Limits the cycle budget of an execution engine to the deadline
+ * of the next pending event.
+ *
+ * @param[in] state The state of the computer.
+ * @param[in] end_cycles The cycle counter value to stop at.
+ *
+ * @return The earlier of @a end_cycles and the next event deadline.
+ *
+ * Engines call this on entry and after I/O instructions, which may
+ * schedule new events.  litton_run() dispatches the events when the
+ * engine stops and then starts it again.
+ */
+static LITTON_INLINE uint64_t litton_limit_to_events
+    (const litton_state_t *state, uint64_t end_cycles)
+{
+    return state->next_event < end_cycles ? state->next_event : end_cycles;
+}
+
+/**
+ * @brief Runs instructions using a specific step function.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_cycles Maximum number of cycles to run for, or zero.
+ * @param[in] max_instructions Maximum number of instructions to run, or zero.
+ * @param[out] result Returns information about the run.  May be NULL.
+ * @param[in] step_func Function to use to step each instruction.
+ *
+ * @return The reason why execution stopped.
+ *
+ * This is always inlined with a constant @a step_func so that the
+ * compiler can inline the step function into the loop.
+ */
+static LITTON_INLINE litton_run_reason_t litton_run_with
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result,
+     litton_step_result_t (*step_func)(litton_state_t *state))
+{
+    litton_run_reason_t reason = LITTON_RUN_BUDGET;
+    uint64_t start_cycles = state->cycle_counter;
+    uint64_t end_cycles;
+    uint64_t instructions = 0;
+    if (max_cycles && max_cycles <= (UINT64_MAX - start_cycles)) {
+        end_cycles = start_cycles + max_cycles;
+    } else {
+        end_cycles = UINT64_MAX;
+    }
+    end_cycles = litton_limit_to_events(state, end_cycles);
+    for (;;) {
+        /* Execute the next instruction */
+        litton_step_result_t step = (*step_func)(state);
+        if (step != LITTON_STEP_OK) {
+            if (step == LITTON_STEP_HALT) {
+                reason = LITTON_RUN_HALT;
+                ++instructions;
+            } else if (step == LITTON_STEP_ILLEGAL) {
+                reason = LITTON_RUN_ILLEGAL;
+                ++instructions;
+            } else {
+                /* Spinning instructions are not executed */
+                reason = LITTON_RUN_SPINNING;
+            }
+            break;
+        }
+        ++instructions;
+
+        /* Stop if the program is waiting for an I/O device or is idle */
+        if (state->io_wait) {
+            if (state->stop_on_io_wait) {
+                reason = LITTON_RUN_IO_WAIT;
+                break;
+            }
+            if (state->idle && state->stop_on_idle) {
+                reason = LITTON_RUN_IDLE;
+                break;
+            }
+        }
+
+        /* Stop if we jumped to a word with a breakpoint on it */
+        if (state->jumped && state->breakpoints &&
+                litton_is_breakpoint(state, state->PC)) {
+            reason = LITTON_RUN_BREAKPOINT;
+            break;
+        }
+
+        /* The instruction may have scheduled an event */
+        end_cycles = litton_limit_to_events(state, end_cycles);
+
+        /* Skip over delay loops in one step */
+        if (state->jumped && litton_is_delay_loop(state)) {
+            instructions += litton_skip_delay_loop
+                (state,
+                 max_instructions ? max_instructions - instructions
+                                  : UINT64_MAX,
+                 end_cycles);
+        }
+
+        /* Stop if we have used up the cycle budget or reached an event */
+        if (state->cycle_counter >= end_cycles) {
+            break;
+        }
+        if (max_instructions && instructions >= max_instructions) {
+            break;
+        }
+    }
+    if (result) {
+        result->reason = reason;
+        result->cycles = state->cycle_counter - start_cycles;
+        result->instructions = instructions;
+    }
+    return reason;
+}
+
+/**
+ * @brief Shifts a word left by N bits, shifting K in first.
+ *
+ * @param[in,out] state The state of the computer; K is set to the last
+ * bit that was shifted out.
+ * @param[in,out] word The word to shift.
+ * @param[in] K The bit to shift in first, 0 or 1.
+ * @param[in] N The number of bits to shift by.
+ */
+void litton_single_left_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N);
+
+/**
+ * @brief Shifts a word right by N bits, filling with K.
+ *
+ * @param[in,out] state The state of the computer; K is set to the last
+ * bit that was shifted out.
+ * @param[in,out] word The word to shift.
+ * @param[in] K The bit to fill the vacated bits with, 0 or 1.
+ * @param[in] N The number of bits to shift by.
+ */
+void litton_single_right_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N);
+
+/**
+ * @brief Shifts a pair of words left by N bits, shifting K in first.
+ *
+ * @param[in,out] state The state of the computer; K is set to the last
+ * bit that was shifted out.
+ * @param[in,out] word1 The high word of the pair.
+ * @param[in,out] word2 The low word of the pair.
+ * @param[in] K The bit to shift in first, 0 or 1.
+ * @param[in] N The number of bits to shift by.
+ */
+void litton_double_left_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N);
+
+/**
+ * @brief Shifts a pair of words right by N bits, filling with K.
+ *
+ * @param[in,out] state The state of the computer; K is set to the last
+ * bit that was shifted out.
+ * @param[in,out] word1 The high word of the pair.
+ * @param[in,out] word2 The low word of the pair.
+ * @param[in] K The bit to fill the vacated bits with, 0 or 1.
+ * @param[in] N The number of bits to shift by.
+ */
+void litton_double_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N);
+
+/**
+ * @brief Shifts a word left by N decimal digits, adding K to the first
+ * digit that is shifted in.
+ *
+ * @param[in,out] state The state of the computer; K is set to zero.
+ * @param[in,out] word The word to shift.
+ * @param[in] K The constant to add to the first digit, 0 or 1.
+ * @param[in] N The number of digits to shift by.
+ */
+void litton_single_decimal_left_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N);
+
+/**
+ * @brief Shifts a word right by N decimal digits.
+ *
+ * @param[in,out] state The state of the computer; K is set to zero.
+ * @param[in,out] word The word to shift.
+ * @param[in] N The number of digits to shift by.
+ */
+void litton_single_decimal_right_shift
+    (litton_state_t *state, litton_word_t *word, uint16_t N);
+
+/**
+ * @brief Shifts a pair of words left by N decimal digits, adding K to
+ * the first digit that is shifted in.
+ *
+ * @param[in,out] state The state of the computer; K is set to zero.
+ * @param[in,out] word1 The high word of the pair.
+ * @param[in,out] word2 The low word of the pair.
+ * @param[in] K The constant to add to the first digit, 0 or 1.
+ * @param[in] N The number of digits to shift by.
+ */
+void litton_double_decimal_left_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N);
+
+/**
+ * @brief Shifts a pair of words right by N decimal digits.
+ *
+ * @param[in,out] state The state of the computer; K is set to zero.
+ * @param[in,out] word1 The high word of the pair.
+ * @param[in,out] word2 The low word of the pair.
+ * @param[in] N The number of digits to shift by.
+ */
+void litton_double_decimal_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     uint16_t N);
+
+/**
+ * @brief Performs a binary shift instruction.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] insn The 16-bit instruction word.
+ *
+ * @return LITTON_STEP_OK or LITTON_STEP_ILLEGAL.
+ */
+litton_step_result_t litton_binary_shift
+    (litton_state_t *state, uint16_t insn);
+
+/**
+ * @brief Performs a decimal shift instruction.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] insn The 16-bit instruction word.
+ *
+ * @return LITTON_STEP_OK or LITTON_STEP_ILLEGAL.
+ */
+litton_step_result_t litton_decimal_shift
+    (litton_state_t *state, uint16_t insn);
+
+/**
+ * @brief Performs an I/O instruction.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] insn The 16-bit instruction word.
+ *
+ * @return LITTON_STEP_OK or LITTON_STEP_ILLEGAL.
+ */
+litton_step_result_t litton_perform_io
+    (litton_state_t *state, uint16_t insn);
+
+#if !LITTON_SMALL_MEMORY
+
+/**
+ * @brief Accesses a drum word directly.
+ *
+ * The alternative execution engines are only used on systems with the
+ * whole drum in RAM, so they can access the drum directly rather than
+ * going through litton_get_memory() and litton_set_memory().
+ */
+#define litton_drum_word(state, addr) \
+    ((state)->drum[(addr) & (LITTON_DRUM_MAX_SIZE - 1)])
+
+/** Maximum number of operations that can be decoded from a single word */
+#define LITTON_DECODE_MAX_OPS 6
+
+/** Mask for the 48-bit combination of CR and I */
+#define LITTON_CRI_MASK 0xFFFFFFFFFFFFULL
+
+/** Value for CR and I that can never match a real 48-bit value */
+#define LITTON_CRI_INVALID 0xFFFFFFFFFFFFFFFFULL
+
+/**
+ * @brief Handlers for pre-decoded operations.
+ */
+typedef enum
+{
+    LITTON_OP_FALLBACK,         /**< Use the reference interpreter */
+    LITTON_OP_AK,               /**< "AK" instruction */
+    LITTON_OP_CL,               /**< "CL" instruction */
+    LITTON_OP_NN,               /**< "NN" instruction */
+    LITTON_OP_CM,               /**< "CM" instruction */
+    LITTON_OP_SK,               /**< "SK" instruction */
+    LITTON_OP_TZ,               /**< "TZ" instruction */
+    LITTON_OP_TH,               /**< "TH" instruction */
+    LITTON_OP_RK,               /**< "RK" instruction */
+    LITTON_OP_TP,               /**< "TP" instruction */
+    LITTON_OP_LA,               /**< "LA" instruction */
+    LITTON_OP_XC,               /**< "XC" instruction */
+    LITTON_OP_XT,               /**< "XT" instruction */
+    LITTON_OP_TE,               /**< "TE" instruction */
+    LITTON_OP_TG,               /**< "TG" instruction */
+    LITTON_OP_BINARY_SHIFT,     /**< Binary shift instructions */
+    LITTON_OP_DECIMAL_SHIFT,    /**< Decimal shift instructions */
+    LITTON_OP_IO,               /**< I/O instructions */
+    LITTON_OP_CA,               /**< "CA" instruction */
+    LITTON_OP_AD,               /**< "AD" instruction */
+    LITTON_OP_ST,               /**< "ST" instruction */
+    LITTON_OP_CD,               /**< "CD" instruction */
+    LITTON_OP_JM,               /**< "JM" instruction */
+    LITTON_OP_JU,               /**< "JU" instruction */
+    LITTON_OP_JC                /**< "JC" instruction */
+
+} litton_op_handler_t;
+
+/**
+ * @brief Information about a pre-decoded operation.
+ */
+typedef struct
+{
+    /** Contents of CR and I before the operation, as a 48-bit value */
+    uint64_t pre;
+
+    /** Contents of CR and I after the operation if it doesn't jump */
+    uint64_t post;
+
+    /** Operand; usually a memory address or a full 16-bit instruction */
+    uint16_t operand;
+
+    /** Number of word times for the basic opcode timing */
+    uint16_t cost;
+
+    /** Handler for the operation, from litton_op_handler_t */
+    uint8_t handler;
+
+} litton_decoded_op_t;
+
+/**
+ * @brief Information about a pre-decoded drum word.
+ */
+typedef struct
+{
+    /** Non-zero if this entry is valid */
+    uint8_t valid;
+
+    /** Number of operations that were decoded */
+    uint8_t count;
+
+    /** Operations that were decoded from the word, followed by an
+     *  end marker whose "pre" value can never match CR and I */
+    litton_decoded_op_t ops[LITTON_DECODE_MAX_OPS + 1];
+
+} litton_decoded_word_t;
+
+/**
+ * @brief Cache of pre-decoded drum words, indexed by drum address.
+ */
+struct litton_decode_cache_s
+{
+    /** Decoded words */
+    litton_decoded_word_t words[LITTON_DRUM_MAX_SIZE];
+};
+
+/** Maximum number of instructions in a recorded trace */
+#define LITTON_TRACE_MAX_OPS 128
+
+/** Maximum number of drum words that a recorded trace can pass through */
+#define LITTON_TRACE_MAX_WORDS 16
+
+/** Number of entries in the trace cache; must be a power of 2 */
+#define LITTON_TRACE_CACHE_SIZE 4096
+
+/** Value for "last_address" when a trace has not accessed memory yet */
+#define LITTON_TRACE_NO_ADDRESS 0xFFFF
+
+/** Value for "spin" when a trace has not performed a jump yet */
+#define LITTON_TRACE_NO_SPIN 0xFFFF
+
+/** Number of times that a drum word can be modified after it was recorded
+ *  in a trace before it is left out of future traces */
+#define LITTON_TRACE_VOLATILE_LIMIT 4
+
+/**
+ * @def LITTON_JIT_SUPPORTED
+ * @brief Non-zero if the "jit" engine was enabled with the LITTON_JIT
+ * build option and the host is a 64-bit x86 Unix system.
+ */
+#if defined(LITTON_JIT) && LITTON_JIT && defined(__x86_64__) && \
+        defined(__unix__)
+#define LITTON_JIT_SUPPORTED 1
+#else
+#define LITTON_JIT_SUPPORTED 0
+#endif
+
+/** Number of times that a trace is replayed before it is compiled */
+#define LITTON_JIT_THRESHOLD 16
+
+/**
+ * @brief Native code that was compiled from a trace.
+ *
+ * @param[in,out] state The state of the computer.
+ *
+ * @return The index of the instruction in the trace that the native code
+ * exited at, which will be the length of the trace if it ran to the end.
+ */
+typedef unsigned (*litton_jit_func_t)(litton_state_t *state);
+
+/** Opaque type for the code memory of the JIT */
+typedef struct litton_jit_s litton_jit_t;
+
+/**
+ * @brief Handlers for instructions in a trace.
+ */
+typedef enum
+{
+    LITTON_TRACE_OP_END,            /**< End of the trace */
+    LITTON_TRACE_OP_AK,             /**< "AK" instruction */
+    LITTON_TRACE_OP_CL,             /**< "CL" instruction */
+    LITTON_TRACE_OP_NN,             /**< "NN" instruction */
+    LITTON_TRACE_OP_CM,             /**< "CM" instruction */
+    LITTON_TRACE_OP_SK,             /**< "SK" instruction */
+    LITTON_TRACE_OP_TZ,             /**< "TZ" instruction */
+    LITTON_TRACE_OP_TH,             /**< "TH" instruction */
+    LITTON_TRACE_OP_RK,             /**< "RK" instruction */
+    LITTON_TRACE_OP_TP,             /**< "TP" instruction */
+    LITTON_TRACE_OP_LA,             /**< "LA" instruction */
+    LITTON_TRACE_OP_XC,             /**< "XC" instruction */
+    LITTON_TRACE_OP_XT,             /**< "XT" instruction */
+    LITTON_TRACE_OP_TE,             /**< "TE" instruction */
+    LITTON_TRACE_OP_TG,             /**< "TG" instruction */
+    LITTON_TRACE_OP_BINARY_SHIFT,   /**< Binary shift instructions */
+    LITTON_TRACE_OP_DECIMAL_SHIFT,  /**< Decimal shift instructions */
+    LITTON_TRACE_OP_CA,             /**< "CA" instruction */
+    LITTON_TRACE_OP_AD,             /**< "AD" instruction */
+    LITTON_TRACE_OP_ST,             /**< "ST" instruction */
+    LITTON_TRACE_OP_JM,             /**< "JM" instruction */
+    LITTON_TRACE_OP_AC_ADD,         /**< "AC" instruction when K is 1 */
+    LITTON_TRACE_OP_AC_SKIP,        /**< "AC" instruction when K is 0 */
+    LITTON_TRACE_OP_JU,             /**< "JU" instruction */
+    LITTON_TRACE_OP_JC_TAKEN,       /**< "JC" instruction when K is 1 */
+    LITTON_TRACE_OP_JC_NOT_TAKEN    /**< "JC" instruction when K is 0 */
+
+} litton_trace_handler_t;
+
+/**
+ * @brief Information about an instruction in a recorded trace.
+ *
+ * Apart from the handler and operand, the fields describe the state of
+ * the machine just before the instruction is executed.  The timing of
+ * every instruction in a trace is fixed once the rotation predictor at
+ * the start of the trace is known, so all of this can be recorded ahead
+ * of time and then restored when the trace exits.
+ */
+typedef struct
+{
+    /** Contents of CR and I, as a 48-bit value */
+    uint64_t cri;
+
+    /** Number of cycles since the start of the trace */
+    uint32_t cycles;
+
+    /** Operand; usually a memory address or a full 16-bit instruction */
+    uint16_t operand;
+
+    /** Program counter */
+    litton_drum_loc_t pc;
+
+    /** Last memory address, or LITTON_TRACE_NO_ADDRESS */
+    litton_drum_loc_t last_address;
+
+    /** Spin counter, or LITTON_TRACE_NO_SPIN if it is relative to the
+     *  spin counter at the start of the trace */
+    uint16_t spin;
+
+    /** Handler for the instruction */
+    uint8_t handler;
+
+    /** Rotation predictor */
+    uint8_t predictor;
+
+    /** Non-zero if the previous instruction performed a jump */
+    uint8_t jumped;
+
+} litton_trace_op_t;
+
+/**
+ * @brief Recorded trace of instructions.
+ */
+typedef struct
+{
+    /** Program counter at the start of the trace */
+    litton_drum_loc_t entry_pc;
+
+    /** Rotation predictor at the start of the trace */
+    uint8_t entry_predictor;
+
+    /** Number of drum words that the trace passes through */
+    uint8_t num_words;
+
+    /** Number of instructions in the trace */
+    uint16_t count;
+
+#if LITTON_JIT_SUPPORTED
+    /** Number of times that the trace has been replayed, up to
+     *  LITTON_JIT_THRESHOLD */
+    uint16_t replays;
+
+    /** Native code for the trace, or NULL if it hasn't been compiled */
+    litton_jit_func_t native;
+#endif
+
+    /** Addresses of the drum words that the trace passes through */
+    litton_drum_loc_t words[LITTON_TRACE_MAX_WORDS];
+
+    /** Versions of the drum words when the trace was recorded */
+    uint32_t versions[LITTON_TRACE_MAX_WORDS];
+
+    /** Instructions in the trace, followed by an extra entry that
+     *  describes the state of the machine at the end of the trace */
+    litton_trace_op_t ops[1];
+
+} litton_trace_t;
+
+/**
+ * @brief Cache of recorded traces.
+ */
+struct litton_trace_cache_s
+{
+    /** Version number for each drum word, incremented on every write */
+    uint32_t versions[LITTON_DRUM_MAX_SIZE];
+
+    /** Number of times that each drum word has been modified after it
+     *  was recorded in a trace, up to LITTON_TRACE_VOLATILE_LIMIT */
+    uint8_t volatile_words[LITTON_DRUM_MAX_SIZE];
+
+    /** Recorded traces, indexed by a hash of the starting state */
+    litton_trace_t *traces[LITTON_TRACE_CACHE_SIZE];
+
+    /** Drum words that the trace being recorded has written to */
+    litton_drum_loc_t written[LITTON_TRACE_MAX_OPS];
+
+    /** Trace that is currently being recorded */
+    litton_trace_t *recording;
+
+#if LITTON_JIT_SUPPORTED
+    /** Code memory for the JIT, or NULL if nothing has been compiled yet */
+    litton_jit_t *jit;
+#endif
+};
+
+/**
+ * @brief Invalidates a drum word in the decode and trace caches.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] addr The drum address that was modified.
+ *
+ * This also restarts idle detection, because the program has changed
+ * the contents of memory.
+ */
+static inline void litton_decode_cache_invalidate
+    (litton_state_t *state, litton_drum_loc_t addr)
+{
+    /* A store means that the program is not idle */
+    state->idle_polls = 0;
+    if (state->decode_cache) {
+        state->decode_cache->words[addr & (LITTON_DRUM_MAX_SIZE - 1)].valid = 0;
+    }
+    if (state->trace_cache) {
+        ++(state->trace_cache->versions[addr & (LITTON_DRUM_MAX_SIZE - 1)]);
+    }
+}
+
+/**
+ * @brief Writes a drum word directly and invalidates it in the decode cache.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] addr The drum address to write to.
+ * @param[in] value The value to write.
+ */
+static inline void litton_write_drum
+    (litton_state_t *state, litton_drum_loc_t addr, litton_word_t value)
+{
+    litton_drum_word(state, addr) = value;
+    litton_decode_cache_invalidate(state, addr);
+}
+
+/**
+ * @brief Allocates a new decode cache.
+ *
+ * @return The new decode cache, or NULL if out of memory.
+ *
+ * The decode cache should be freed with free() when it is no
+ * longer required.
+ */
+litton_decode_cache_t *litton_decode_cache_create(void);
+
+/**
+ * @brief Runs instructions using the decode cache.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_cycles Maximum number of cycles to run for, or zero.
+ * @param[in] max_instructions Maximum number of instructions to run, or zero.
+ * @param[out] result Returns information about the run.  May be NULL.
+ *
+ * @return The reason why execution stopped.
+ *
+ * The decode cache must have already been allocated.
+ */
+litton_run_reason_t litton_run_cached
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result);
+
+/**
+ * @brief Runs instructions using the threaded-code dispatch engine.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_cycles Maximum number of cycles to run for, or zero.
+ * @param[in] max_instructions Maximum number of instructions to run, or zero.
+ * @param[out] result Returns information about the run.  May be NULL.
+ *
+ * @return The reason why execution stopped.
+ */
+litton_run_reason_t litton_run_threaded
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result);
+
+/**
+ * @brief Allocates a new trace cache.
+ *
+ * @return The new trace cache, or NULL if out of memory.
+ */
+litton_trace_cache_t *litton_trace_cache_create(void);
+
+/**
+ * @brief Frees a trace cache and all of the traces within it.
+ *
+ * @param[in] cache The trace cache to free.
+ */
+void litton_trace_cache_free(litton_trace_cache_t *cache);
+
+/**
+ * @brief Runs instructions by recording and replaying traces.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_cycles Maximum number of cycles to run for, or zero.
+ * @param[in] max_instructions Maximum number of instructions to run, or zero.
+ * @param[out] result Returns information about the run.  May be NULL.
+ *
+ * @return The reason why execution stopped.
+ *
+ * The trace cache must have already been allocated.
+ */
+litton_run_reason_t litton_run_trace
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result);
+
+#if LITTON_JIT_SUPPORTED
+
+/**
+ * @brief Compiles a trace into native code.
+ *
+ * @param[in,out] cache The trace cache that contains the trace.
+ * @param[in,out] trace The trace to compile.
+ *
+ * On success, the "native" field of the trace will be set.  If the code
+ * memory is full, then all previously compiled traces in the cache are
+ * discarded to make room.
+ */
+void litton_jit_compile(litton_trace_cache_t *cache, litton_trace_t *trace);
+
+/**
+ * @brief Frees the code memory for the JIT.
+ *
+ * @param[in] jit The code memory to free.
+ */
+void litton_jit_free(litton_jit_t *jit);
+
+#endif /* LITTON_JIT_SUPPORTED */
+
+#endif /* !LITTON_SMALL_MEMORY */
+
+/**
+ * @brief Dispatches all events whose deadlines have been reached.
+ *
+ * @param[in,out] state The state of the computer.
+ */
+void litton_dispatch_events(litton_state_t *state);
+
+/**
+ * @brief Gets the deadline of a pending event.
+ *
+ * @param[in] state The state of the computer.
+ * @param[in] handler Handler for the event.
+ * @param[in] arg Argument for the event.
+ * @param[out] when Returns the value of the cycle counter when the
+ * event will occur.
+ *
+ * @return Non-zero if the event is pending, or zero if it is not.
+ */
+int litton_event_deadline
+    (const litton_state_t *state, litton_event_handler_t handler, void *arg,
+     uint64_t *when);
+
+/**
+ * @brief Updates the number of word times to transfer a byte to or from
+ * the selected devices.
+ *
+ * @param[in,out] state The state of the computer.
+ *
+ * The fastest selected device sets the pace.  If no devices are selected,
+ * then the machine-wide default timing applies at the printer's rate.
+ */
+void litton_update_io_word_times(litton_state_t *state);
+
+/**
+ * @brief Builds the lookup tables for decoding EBS1231 text.
+ *
+ * This is called by litton_init() so that the tables are built before
+ * any threads are created.  It is safe to call more than once.
+ */
+void litton_charset_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
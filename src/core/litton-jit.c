@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "litton/litton.h"
+#include "litton-internal.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#if LITTON_JIT_SUPPORTED
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * The JIT compiles the traces that are recorded by the trace engine
+ * into native x86-64 code once they have been replayed a few times.
+ *
+ * The native code only needs to perform the data operations of the
+ * instructions in the trace, just like litton_trace_replay().  The contents
+ * of CR and I, the cycle counter, and the other bookkeeping are static
+ * for the whole trace, so they are restored from the recorded values when
+ * the native code returns the index of the instruction that it exited at.
+ *
+ * While the native code is running, the registers are allocated as follows:
+ *
+ *     rbx      Pointer to the state of the computer.
+ *     r12      A
+ *     r13      K, as 0 or 1
+ *     r14      LITTON_WORD_MASK
+ *     rax, rcx Temporaries
+ *
+ * Conditional instructions compile into guards that exit the trace if K
+ * is not the same as when the trace was recorded.  Stores invalidate the
+ * destination word in the decode and trace caches, so that traces which
+ * pass through the word are discarded the next time that they are looked
+ * up.  Traces never store to their own words, and never contain I/O
+ * instructions, so the reference interpreter takes over for those.
+ *
+ * The code memory is mapped once and is writable only while a trace is
+ * being compiled into it.  When it fills up, all compiled traces are
+ * discarded and compilation starts again from the beginning.
+ */
+
+/** Size of the code memory for the JIT */
+#define LITTON_JIT_CODE_SIZE (8 * 1024 * 1024)
+
+/** Maximum size of the code for a single instruction in a trace */
+#define LITTON_JIT_MAX_OP_SIZE 96
+
+/** Maximum size of the code for a trace, including entry and exit */
+#define LITTON_JIT_MAX_TRACE_SIZE \
+    (128 + (LITTON_TRACE_MAX_OPS + 1) * LITTON_JIT_MAX_OP_SIZE)
+
+/** Alignment of the start of each compiled trace */
+#define LITTON_JIT_ALIGNMENT 16
+
+/* Register numbers for ModR/M encodings */
+#define LITTON_JIT_RAX 0
+#define LITTON_JIT_RCX 1
+#define LITTON_JIT_R12 12
+#define LITTON_JIT_R13 13
+
+/**
+ * @brief Buffer that native code is emitted into.
+ */
+typedef struct
+{
+    /** Code that has been emitted so far */
+    uint8_t code[LITTON_JIT_MAX_TRACE_SIZE];
+
+    /** Number of bytes that have been emitted so far */
+    unsigned posn;
+
+} litton_jit_buffer_t;
+
+/**
+ * @brief Code memory for the JIT.
+ */
+struct litton_jit_s
+{
+    /** Start of the code memory, or NULL if it could not be mapped */
+    uint8_t *code;
+
+    /** Position of the next trace to be compiled into the code memory */
+    size_t posn;
+
+    /** Size of a page of memory on the host */
+    size_t page_size;
+
+    /** Buffer for compiling the next trace before it is copied into
+     *  the code memory */
+    litton_jit_buffer_t buf;
+};
+
+/**
+ * @brief Emits a sequence of bytes into the code buffer.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] bytes Points to the bytes to emit.
+ * @param[in] len Number of bytes to emit.
+ */
+static void litton_jit_emit
+    (litton_jit_buffer_t *buf, const uint8_t *bytes, unsigned len)
+{
+    memcpy(buf->code + buf->posn, bytes, len);
+    buf->posn += len;
+}
+
+/**
+ * @brief Emits a list of constant bytes into the code buffer.
+ *
+ * @param[in,out] buf The code buffer.
+ */
+#define litton_jit_code(buf, ...) \
+    do { \
+        static const uint8_t litton_bytes[] = {__VA_ARGS__}; \
+        litton_jit_emit((buf), litton_bytes, sizeof(litton_bytes)); \
+    } while (0)
+
+/**
+ * @brief Emits a 32-bit little-endian value into the code buffer.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] value The value to emit.
+ */
+static void litton_jit_emit_u32(litton_jit_buffer_t *buf, uint32_t value)
+{
+    uint8_t bytes[4];
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+    litton_jit_emit(buf, bytes, sizeof(bytes));
+}
+
+/**
+ * @brief Emits a 64-bit little-endian value into the code buffer.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] value The value to emit.
+ */
+static void litton_jit_emit_u64(litton_jit_buffer_t *buf, uint64_t value)
+{
+    litton_jit_emit_u32(buf, (uint32_t)value);
+    litton_jit_emit_u32(buf, (uint32_t)(value >> 32));
+}
+
+/**
+ * @brief Emits the ModR/M byte and displacement for a memory operand
+ * of the form "[rbx + offset]".
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] reg Number of the register in the "reg" field.
+ * @param[in] offset Offset from the start of the state.
+ */
+static void litton_jit_emit_state
+    (litton_jit_buffer_t *buf, unsigned reg, size_t offset)
+{
+    uint8_t modrm = (uint8_t)(0x80 | ((reg & 7) << 3) | 3);
+    litton_jit_emit(buf, &modrm, 1);
+    litton_jit_emit_u32(buf, (uint32_t)offset);
+}
+
+/**
+ * @brief Gets the offset of a drum word from the start of the state.
+ *
+ * @param[in] addr The drum address.
+ *
+ * @return The offset of the word.
+ */
+#define litton_jit_drum_offset(addr) \
+    (offsetof(litton_state_t, drum) + \
+     ((addr) & (LITTON_DRUM_MAX_SIZE - 1)) * sizeof(litton_word_t))
+
+/**
+ * @brief Emits code to exit from the trace.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] index Index of the instruction that the trace exits at.
+ *
+ * The common exit code is at the start of the buffer.
+ */
+static void litton_jit_emit_exit(litton_jit_buffer_t *buf, unsigned index)
+{
+    /* mov eax, index; jmp exit */
+    litton_jit_code(buf, 0xB8);
+    litton_jit_emit_u32(buf, index);
+    litton_jit_code(buf, 0xE9);
+    litton_jit_emit_u32(buf, (uint32_t)(-(int32_t)(buf->posn + 4)));
+}
+
+/**
+ * @brief Emits code to exit from the trace if K has a specific value.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] index Index of the instruction that the trace exits at.
+ * @param[in] K The value of K that causes the exit.
+ */
+static void litton_jit_emit_guard
+    (litton_jit_buffer_t *buf, unsigned index, int K)
+{
+    /* test r13, r13; jz/jnz over the exit */
+    litton_jit_code(buf, 0x4D, 0x85, 0xED);
+    if (K) {
+        litton_jit_code(buf, 0x74, 0x0A);
+    } else {
+        litton_jit_code(buf, 0x75, 0x0A);
+    }
+    litton_jit_emit_exit(buf, index);
+}
+
+/**
+ * @brief Emits code to normalize the result of an addition into A and K.
+ *
+ * @param[in,out] buf The code buffer.
+ */
+static void litton_jit_emit_carry(litton_jit_buffer_t *buf)
+{
+    /* mov r13, r12; shr r13, 40; and r12, r14 */
+    litton_jit_code(buf, 0x4D, 0x89, 0xE5);
+    litton_jit_code(buf, 0x49, 0xC1, 0xED, LITTON_WORD_BITS);
+    litton_jit_code(buf, 0x4D, 0x21, 0xF4);
+}
+
+/**
+ * @brief Emits code to set K if A is zero.
+ *
+ * @param[in,out] buf The code buffer.
+ */
+static void litton_jit_emit_test_zero(litton_jit_buffer_t *buf)
+{
+    /* xor r13d, r13d; test r12, r12; setz r13b */
+    litton_jit_code(buf, 0x45, 0x31, 0xED);
+    litton_jit_code(buf, 0x4D, 0x85, 0xE4);
+    litton_jit_code(buf, 0x41, 0x0F, 0x94, 0xC5);
+}
+
+/**
+ * @brief Emits code to invalidate a drum word that was written to.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] addr The drum address that was written to.
+ *
+ * This is the equivalent of litton_decode_cache_invalidate().
+ */
+static void litton_jit_emit_invalidate
+    (litton_jit_buffer_t *buf, litton_drum_loc_t addr)
+{
+    addr &= (LITTON_DRUM_MAX_SIZE - 1);
+
+    /* mov dword [rbx + idle_polls], 0 */
+    litton_jit_code(buf, 0xC7);
+    litton_jit_emit_state(buf, 0, offsetof(litton_state_t, idle_polls));
+    litton_jit_emit_u32(buf, 0);
+
+    /* mov rax, [rbx + decode_cache]; test rax, rax; jz skip */
+    litton_jit_code(buf, 0x48, 0x8B);
+    litton_jit_emit_state
+        (buf, LITTON_JIT_RAX, offsetof(litton_state_t, decode_cache));
+    litton_jit_code(buf, 0x48, 0x85, 0xC0);
+    litton_jit_code(buf, 0x74, 0x07);
+
+    /* mov byte [rax + words[addr].valid], 0 */
+    litton_jit_code(buf, 0xC6, 0x80);
+    litton_jit_emit_u32
+        (buf, (uint32_t)(offsetof(litton_decode_cache_t, words) +
+                         addr * sizeof(litton_decoded_word_t) +
+                         offsetof(litton_decoded_word_t, valid)));
+    litton_jit_code(buf, 0x00);
+
+    /* mov rax, [rbx + trace_cache]; inc dword [rax + versions[addr]] */
+    litton_jit_code(buf, 0x48, 0x8B);
+    litton_jit_emit_state
+        (buf, LITTON_JIT_RAX, offsetof(litton_state_t, trace_cache));
+    litton_jit_code(buf, 0xFF, 0x80);
+    litton_jit_emit_u32
+        (buf, (uint32_t)(offsetof(litton_trace_cache_t, versions) +
+                         addr * sizeof(uint32_t)));
+}
+
+/**
+ * @brief Emits code to call a shift helper function.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] func The helper function to call.
+ * @param[in] insn The 16-bit shift instruction.
+ */
+static void litton_jit_emit_shift
+    (litton_jit_buffer_t *buf,
+     litton_step_result_t (*func)(litton_state_t *state, uint16_t insn),
+     uint16_t insn)
+{
+    /* mov [rbx + A], r12; mov [rbx + K], r13b */
+    litton_jit_code(buf, 0x4C, 0x89);
+    litton_jit_emit_state(buf, LITTON_JIT_R12, offsetof(litton_state_t, A));
+    litton_jit_code(buf, 0x44, 0x88);
+    litton_jit_emit_state(buf, LITTON_JIT_R13, offsetof(litton_state_t, K));
+
+    /* mov rdi, rbx; mov esi, insn; mov rax, func; call rax */
+    litton_jit_code(buf, 0x48, 0x89, 0xDF);
+    litton_jit_code(buf, 0xBE);
+    litton_jit_emit_u32(buf, insn);
+    litton_jit_code(buf, 0x48, 0xB8);
+    litton_jit_emit_u64(buf, (uint64_t)(uintptr_t)func);
+    litton_jit_code(buf, 0xFF, 0xD0);
+
+    /* mov r12, [rbx + A]; movzx r13d, byte [rbx + K] */
+    litton_jit_code(buf, 0x4C, 0x8B);
+    litton_jit_emit_state(buf, LITTON_JIT_R12, offsetof(litton_state_t, A));
+    litton_jit_code(buf, 0x44, 0x0F, 0xB6);
+    litton_jit_emit_state(buf, LITTON_JIT_R13, offsetof(litton_state_t, K));
+}
+
+/**
+ * @brief Emits the code for an instruction in a trace.
+ *
+ * @param[in,out] buf The code buffer.
+ * @param[in] op The instruction.
+ * @param[in] index Index of the instruction in the trace.
+ */
+static void litton_jit_emit_op
+    (litton_jit_buffer_t *buf, const litton_trace_op_t *op, unsigned index)
+{
+    size_t offset = litton_jit_drum_offset(op->operand);
+    switch (op->handler) {
+    case LITTON_TRACE_OP_AK:
+        /* add r12, r13 */
+        litton_jit_code(buf, 0x4D, 0x01, 0xEC);
+        litton_jit_emit_carry(buf);
+        break;
+
+    case LITTON_TRACE_OP_CL:
+        /* xor r12d, r12d */
+        litton_jit_code(buf, 0x45, 0x31, 0xE4);
+        break;
+
+    case LITTON_TRACE_OP_CM:
+        /* neg r12; and r12, r14; xor r13d, r13d; test r12, r12; setnz r13b */
+        litton_jit_code(buf, 0x49, 0xF7, 0xDC);
+        litton_jit_code(buf, 0x4D, 0x21, 0xF4);
+        litton_jit_code(buf, 0x45, 0x31, 0xED);
+        litton_jit_code(buf, 0x4D, 0x85, 0xE4);
+        litton_jit_code(buf, 0x41, 0x0F, 0x95, 0xC5);
+        break;
+
+    case LITTON_TRACE_OP_SK:
+        /* mov r13d, 1 */
+        litton_jit_code(buf, 0x41, 0xBD, 0x01, 0x00, 0x00, 0x00);
+        break;
+
+    case LITTON_TRACE_OP_TZ:
+        litton_jit_emit_test_zero(buf);
+        break;
+
+    case LITTON_TRACE_OP_TH:
+        /* mov r13, r12; shr r13, 39 */
+        litton_jit_code(buf, 0x4D, 0x89, 0xE5);
+        litton_jit_code(buf, 0x49, 0xC1, 0xED, LITTON_WORD_BITS - 1);
+        break;
+
+    case LITTON_TRACE_OP_RK:
+        /* xor r13d, r13d */
+        litton_jit_code(buf, 0x45, 0x31, 0xED);
+        break;
+
+    case LITTON_TRACE_OP_TP:
+        /* movzx r13d, byte [rbx + P]; mov byte [rbx + P], 0 */
+        litton_jit_code(buf, 0x44, 0x0F, 0xB6);
+        litton_jit_emit_state(buf, LITTON_JIT_R13, offsetof(litton_state_t, P));
+        litton_jit_code(buf, 0xC6);
+        litton_jit_emit_state(buf, 0, offsetof(litton_state_t, P));
+        litton_jit_code(buf, 0x00);
+        break;
+
+    case LITTON_TRACE_OP_LA:
+        /* and r12, [addr] */
+        litton_jit_code(buf, 0x4C, 0x23);
+        litton_jit_emit_state(buf, LITTON_JIT_R12, offset);
+        litton_jit_emit_test_zero(buf);
+        break;
+
+    case LITTON_TRACE_OP_XC:
+        /* mov rax, [addr]; mov [addr], r12; mov r12, rax */
+        litton_jit_code(buf, 0x48, 0x8B);
+        litton_jit_emit_state(buf, LITTON_JIT_RAX, offset);
+        litton_jit_code(buf, 0x4C, 0x89);
+        litton_jit_emit_state(buf, LITTON_JIT_R12, offset);
+        litton_jit_code(buf, 0x49, 0x89, 0xC4);
+        litton_jit_emit_invalidate(buf, op->operand);
+        break;
+
+    case LITTON_TRACE_OP_XT:
+        /* mov rax, [addr]; mov rcx, r12; not rcx; and rcx, rax;
+         * mov [addr], rcx; and r12, rax */
+        litton_jit_code(buf, 0x48, 0x8B);
+        litton_jit_emit_state(buf, LITTON_JIT_RAX, offset);
+        litton_jit_code(buf, 0x4C, 0x89, 0xE1);
+        litton_jit_code(buf, 0x48, 0xF7, 0xD1);
+        litton_jit_code(buf, 0x48, 0x21, 0xC1);
+        litton_jit_code(buf, 0x48, 0x89);
+        litton_jit_emit_state(buf, LITTON_JIT_RCX, offset);
+        litton_jit_code(buf, 0x49, 0x21, 0xC4);
+        litton_jit_emit_invalidate(buf, op->operand);
+        break;
+
+    case LITTON_TRACE_OP_TE:
+        /* xor r13d, r13d; cmp r12, [addr]; sete r13b */
+        litton_jit_code(buf, 0x45, 0x31, 0xED);
+        litton_jit_code(buf, 0x4C, 0x3B);
+        litton_jit_emit_state(buf, LITTON_JIT_R12, offset);
+        litton_jit_code(buf, 0x41, 0x0F, 0x94, 0xC5);
+        break;
+
+    case LITTON_TRACE_OP_TG:
+        /* xor r13d, r13d; cmp r12, [addr]; setae r13b */
+        litton_jit_code(buf, 0x45, 0x31, 0xED);
+        litton_jit_code(buf, 0x4C, 0x3B);
+        litton_jit_emit_state(buf, LITTON_JIT_R12, offset);
+        litton_jit_code(buf, 0x41, 0x0F, 0x93, 0xC5);
+        break;
+
+    case LITTON_TRACE_OP_BINARY_SHIFT:
+        litton_jit_emit_shift(buf, litton_binary_shift, op->operand);
+        break;
+
+    case LITTON_TRACE_OP_DECIMAL_SHIFT:
+        litton_jit_emit_shift(buf, litton_decimal_shift, op->operand);
+        break;
+
+    case LITTON_TRACE_OP_CA:
+        /* mov r12, [addr] */
+        litton_jit_code(buf, 0x4C, 0x8B);
+        litton_jit_emit_state(buf, LITTON_JIT_R12, offset);
+        break;
+
+    case LITTON_TRACE_OP_AC_ADD:
+        litton_jit_emit_guard(buf, index, 0);
+        /* Fall through */
+
+    case LITTON_TRACE_OP_AD:
+        /* add r12, [addr] */
+        litton_jit_code(buf, 0x4C, 0x03);
+        litton_jit_emit_state(buf, LITTON_JIT_R12, offset);
+        litton_jit_emit_carry(buf);
+        break;
+
+    case LITTON_TRACE_OP_ST:
+        /* mov [addr], r12 */
+        litton_jit_code(buf, 0x4C, 0x89);
+        litton_jit_emit_state(buf, LITTON_JIT_R12, offset);
+        litton_jit_emit_invalidate(buf, op->operand);
+        break;
+
+    case LITTON_TRACE_OP_JM:
+        /* Save the return point in A: mov r12, imm64 */
+        litton_jit_code(buf, 0x49, 0xBC);
+        litton_jit_emit_u64(buf, op->cri & LITTON_WORD_MASK);
+        break;
+
+    case LITTON_TRACE_OP_AC_SKIP:
+    case LITTON_TRACE_OP_JC_NOT_TAKEN:
+        litton_jit_emit_guard(buf, index, 1);
+        break;
+
+    case LITTON_TRACE_OP_JC_TAKEN:
+        litton_jit_emit_guard(buf, index, 0);
+        break;
+
+    default:
+        /* "NN" and "JU" have no effect on the data */
+        break;
+    }
+}
+
+/**
+ * @brief Creates the code memory for the JIT.
+ *
+ * @return The code memory, or NULL if out of memory.  The "code" field
+ * will be NULL if the host refused to map executable memory.
+ */
+static litton_jit_t *litton_jit_create(void)
+{
+    litton_jit_t *jit = calloc(1, sizeof(litton_jit_t));
+    void *code;
+    long page_size;
+    if (!jit) {
+        return 0;
+    }
+    page_size = sysconf(_SC_PAGESIZE);
+    jit->page_size = (page_size > 0) ? (size_t)page_size : 4096;
+    code = mmap(0, LITTON_JIT_CODE_SIZE, PROT_READ | PROT_EXEC,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code != MAP_FAILED) {
+        jit->code = (uint8_t *)code;
+    }
+    return jit;
+}
+
+void litton_jit_free(litton_jit_t *jit)
+{
+    if (jit->code) {
+        munmap(jit->code, LITTON_JIT_CODE_SIZE);
+    }
+    free(jit);
+}
+
+/**
+ * @brief Discards all of the compiled traces in a trace cache.
+ *
+ * @param[in,out] cache The trace cache.
+ */
+static void litton_jit_flush(litton_trace_cache_t *cache)
+{
+    litton_trace_t *trace;
+    unsigned index;
+    for (index = 0; index < LITTON_TRACE_CACHE_SIZE; ++index) {
+        trace = cache->traces[index];
+        if (trace) {
+            trace->native = 0;
+            trace->replays = 0;
+        }
+    }
+    cache->jit->posn = 0;
+}
+
+void litton_jit_compile(litton_trace_cache_t *cache, litton_trace_t *trace)
+{
+    litton_jit_t *jit = cache->jit;
+    litton_jit_buffer_t *buf;
+    unsigned index;
+    unsigned entry;
+    size_t start, end;
+
+    /* Create the code memory the first time that we need it */
+    if (!jit) {
+        jit = litton_jit_create();
+        if (!jit) {
+            return;
+        }
+        cache->jit = jit;
+    }
+    if (!(jit->code)) {
+        /* Executable memory is not available, so keep replaying */
+        return;
+    }
+    buf = &(jit->buf);
+
+    /* Common exit code: store A and K back into the state and return */
+    buf->posn = 0;
+    litton_jit_code(buf, 0x4C, 0x89);
+    litton_jit_emit_state(buf, LITTON_JIT_R12, offsetof(litton_state_t, A));
+    litton_jit_code(buf, 0x44, 0x88);
+    litton_jit_emit_state(buf, LITTON_JIT_R13, offsetof(litton_state_t, K));
+    litton_jit_code(buf, 0x48, 0x83, 0xC4, 0x08);  /* add rsp, 8 */
+    litton_jit_code(buf, 0x41, 0x5E);              /* pop r14 */
+    litton_jit_code(buf, 0x41, 0x5D);              /* pop r13 */
+    litton_jit_code(buf, 0x41, 0x5C);              /* pop r12 */
+    litton_jit_code(buf, 0x5B);                    /* pop rbx */
+    litton_jit_code(buf, 0xC3);                    /* ret */
+
+    /* Entry point: save registers and load A and K from the state */
+    entry = buf->posn;
+    litton_jit_code(buf, 0x53);                    /* push rbx */
+    litton_jit_code(buf, 0x41, 0x54);              /* push r12 */
+    litton_jit_code(buf, 0x41, 0x55);              /* push r13 */
+    litton_jit_code(buf, 0x41, 0x56);              /* push r14 */
+    litton_jit_code(buf, 0x48, 0x83, 0xEC, 0x08);  /* sub rsp, 8 */
+    litton_jit_code(buf, 0x48, 0x89, 0xFB);        /* mov rbx, rdi */
+    litton_jit_code(buf, 0x4C, 0x8B);
+    litton_jit_emit_state(buf, LITTON_JIT_R12, offsetof(litton_state_t, A));
+    litton_jit_code(buf, 0x44, 0x0F, 0xB6);
+    litton_jit_emit_state(buf, LITTON_JIT_R13, offsetof(litton_state_t, K));
+    litton_jit_code(buf, 0x49, 0xBE);              /* mov r14, mask */
+    litton_jit_emit_u64(buf, LITTON_WORD_MASK);
+
+    /* Compile the instructions and then exit at the end of the trace */
+    for (index = 0; index < trace->count; ++index) {
+        litton_jit_emit_op(buf, &(trace->ops[index]), index);
+    }
+    litton_jit_emit_exit(buf, trace->count);
+
+    /* Make room in the code memory if necessary */
+    if ((jit->posn + buf->posn) > LITTON_JIT_CODE_SIZE) {
+        litton_jit_flush(cache);
+    }
+
+    /* Copy the code into the code memory, making only the pages that
+     * are being modified writable while we do so */
+    start = jit->posn & ~(jit->page_size - 1);
+    end = (jit->posn + buf->posn + jit->page_size - 1) & ~(jit->page_size - 1);
+    if (mprotect(jit->code + start, end - start, PROT_READ | PROT_WRITE) != 0) {
+        return;
+    }
+    memcpy(jit->code + jit->posn, buf->code, buf->posn);
+    if (mprotect(jit->code + start, end - start, PROT_READ | PROT_EXEC) != 0) {
+        return;
+    }
+    trace->native = (litton_jit_func_t)(jit->code + jit->posn + entry);
+    jit->posn = (jit->posn + buf->posn + LITTON_JIT_ALIGNMENT - 1) &
+                ~((size_t)(LITTON_JIT_ALIGNMENT - 1));
+}
+
+#endif /* LITTON_JIT_SUPPORTED */
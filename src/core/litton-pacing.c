@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "litton/litton.h"
+#include "litton-internal.h"
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Number of nanoseconds that the computer can fall behind real time
+ * before the pacer gives up trying to catch up.
+ *
+ * Small delays, like a quantum that took longer than usual on the host,
+ * are made up for by not sleeping after the next quantum.
+ */
+#define LITTON_PACER_MAX_LAG_NS 50000000ULL
+
+/**
+ * @brief Gets the current host time in nanoseconds.
+ *
+ * @return The monotonic time in nanoseconds.
+ */
+static uint64_t litton_pacer_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)(now.tv_sec)) * 1000000000ULL + now.tv_nsec;
+}
+
+void litton_pacer_init
+    (litton_pacer_t *pacer, const litton_state_t *state, unsigned speed)
+{
+    memset(pacer, 0, sizeof(litton_pacer_t));
+    pacer->speed = speed;
+    pacer->quantum = LITTON_PACER_QUANTUM;
+    litton_pacer_resync(pacer, state);
+}
+
+void litton_pacer_resync(litton_pacer_t *pacer, const litton_state_t *state)
+{
+    pacer->checkpoint_cycles = state->cycle_counter;
+    pacer->checkpoint_ns = litton_pacer_now();
+}
+
+uint64_t litton_pacer_quantum_cycles(const litton_pacer_t *pacer)
+{
+    return pacer->quantum * pacer->speed;
+}
+
+void litton_pacer_wait(litton_pacer_t *pacer, const litton_state_t *state)
+{
+    uint64_t deadline_ns;
+    uint64_t now_ns;
+    struct timespec deadline;
+
+    /* Nothing to do if we are running at full speed */
+    if (pacer->speed == LITTON_SPEED_UNLIMITED) {
+        return;
+    }
+
+    /* Each cycle is one microsecond at 1x speed */
+    deadline_ns = pacer->checkpoint_ns +
+        (state->cycle_counter - pacer->checkpoint_cycles) * 1000 /
+            pacer->speed;
+
+    /* Resynchronise on "now" if we are accelerating or too far behind */
+    now_ns = litton_pacer_now();
+    if (state->acceleration_counter != 0 ||
+            now_ns > (deadline_ns + LITTON_PACER_MAX_LAG_NS)) {
+        pacer->checkpoint_cycles = state->cycle_counter;
+        pacer->checkpoint_ns = now_ns;
+        if (state->acceleration_counter == 0) {
+            ++(pacer->resyncs);
+        }
+        return;
+    }
+
+    /* If the deadline has already passed, then keep going to catch up */
+    if (now_ns >= deadline_ns) {
+        return;
+    }
+
+    /* Sleep until the deadline and record how late we woke up */
+    deadline.tv_sec = (time_t)(deadline_ns / 1000000000ULL);
+    deadline.tv_nsec = (long)(deadline_ns % 1000000000ULL);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    now_ns = litton_pacer_now();
+    ++(pacer->sleeps);
+    if (now_ns > deadline_ns) {
+        now_ns -= deadline_ns;
+        pacer->total_jitter_ns += now_ns;
+        if (now_ns > pacer->max_jitter_ns) {
+            pacer->max_jitter_ns = now_ns;
+        }
+    }
+}
+
+int litton_speed_from_name
+    (unsigned *speed, const char *name, size_t name_len)
+{
+    unsigned value = 0;
+    size_t posn = 0;
+    if (litton_name_match("unlimited", name, name_len)) {
+        *speed = LITTON_SPEED_UNLIMITED;
+        return 1;
+    }
+    while (posn < name_len && name[posn] >= '0' && name[posn] <= '9') {
+        value = value * 10 + (name[posn] - '0');
+        if (value > 1000000) {
+            return 0;
+        }
+        ++posn;
+    }
+    if (posn < name_len && (name[posn] == 'x' || name[posn] == 'X')) {
+        ++posn;
+    }
+    if (posn == 0 || posn != name_len || value == 0) {
+        return 0;
+    }
+    *speed = value;
+    return 1;
+}
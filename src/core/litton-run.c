@@ -21,76 +21,20 @@
  */
 
 #include "litton/litton.h"
+#include "litton-internal.h"
+#include <stdlib.h>
 
 /**
- * @brief Adds the basic opcode timing to the cycle counter.
+ * @brief Handles the event for the selected output devices becoming ready
+ * to accept the next byte.
  *
  * @param[in,out] state The state of the computer.
- * @param[in] word_times The number of word times for executing the opcode.
+ * @param[in] arg Not used.
  */
-static void litton_add_opcode_timing(litton_state_t *state, unsigned word_times)
+static void litton_output_ready(litton_state_t *state, void *arg)
 {
-    /* Credit the number of cycles for the opcode */
-    state->cycle_counter += word_times * LITTON_WORD_BITS;
-
-    /* While the instruction is executing, the drum will keep rotating.
-     * Predict which word it is on now. */
-    state->rotation_predictor += word_times;
-    state->rotation_predictor &= (LITTON_DRUM_NUM_SECTORS - 1);
-}
-
-/**
- * @brief Adds memory timing for access to a specific address.
- *
- * @param[in,out] state The state of the computer.
- * @param[in] addr The memory address that was accessed.
- */
-static void litton_add_memory_timing
-    (litton_state_t *state, litton_drum_loc_t addr)
-{
-    unsigned word_times;
-
-    /* Record the address for the benefit of the front panel TRACK light */
-    state->last_address = addr;
-
-    /* Correct for scratchpad addresses.  Each scratchpad register loops
-     * around every 8 words, so use the offset from the current position. */
-    if (addr < LITTON_DRUM_RESERVED_SECTORS) {
-        unsigned offset =
-            state->rotation_predictor & (LITTON_DRUM_RESERVED_SECTORS - 1);
-        if (offset <= addr) {
-            /* We haven't seen this scratchpad register on this loop,
-             * so we will be coming across it in the current loop soon. */
-            addr |= state->rotation_predictor & ~(LITTON_DRUM_RESERVED_SECTORS - 1);
-        } else {
-            /* Scratchpad register has already passed, so we need to wait
-             * for the next loop to begin before we can access it. */
-            addr |= state->rotation_predictor & ~(LITTON_DRUM_RESERVED_SECTORS - 1);
-            addr += LITTON_DRUM_RESERVED_SECTORS;
-        }
-    }
-
-    /* Rotation prediction is based on the sector number within the track */
-    addr &= (LITTON_DRUM_NUM_SECTORS - 1);
-    if (addr >= state->rotation_predictor) {
-        /* Sector number is still in our future on this track */
-        word_times = addr - state->rotation_predictor;
-    } else {
-        /* Sector number is behind us, so wait for it to rotate around again */
-        word_times = addr + (LITTON_DRUM_NUM_SECTORS - state->rotation_predictor);
-    }
-
-    /* Account for the time to seek to the sector */
-    litton_add_opcode_timing(state, word_times);
-
-    /* Account for the time to read or write the sector */
-    litton_add_opcode_timing(state, 1);
-}
-
-static int litton_is_device_selected(litton_state_t *state, uint8_t id)
-{
-    litton_device_t *device = litton_find_device(state, id);
-    return device != 0 && device->selected && device->id == id;
+    (void)arg;
+    state->output_busy = 0;
 }
 
 /**
@@ -103,30 +47,41 @@ static void litton_add_io_timing(litton_state_t *state)
     /*
      * The Litton documentation indicates that the printer was about
      * 35 characters per second and the tape reader/punch was about
-     * 50 characters per second.
+     * 50 characters per second.  Each device has a timing descriptor
+     * that can select these realistic rates, a custom rate, or instant
+     * I/O that does not use any machine time at all.
      *
      * One byte at 35 characters per second is roughly equivalent to 714
      * word times, and one byte at 50 characters per second is roughly
      * equivalent to 500 word times.  However, we can overlap processing
      * and I/O, particularly output.
      *
-     * We attempt to simulate when the I/O device is next ready after
-     * sending the last byte.  If that time has already passed, we do the
-     * I/O immediately.  Otherwise simulate waiting on device busy.
+     * Sending a byte schedules an event for when the devices are next
+     * ready.  If that event has already happened, we do the I/O
+     * immediately.  Otherwise simulate waiting on device busy until the
+     * event's deadline.  If several devices are selected, the fastest one
+     * sets the pace.  The rate is worked out when the devices are selected.
      */
-    uint64_t predict_next_io = state->last_io_counter;
-    if (litton_is_device_selected(state, LITTON_DEVICE_READER) ||
-            litton_is_device_selected(state, LITTON_DEVICE_PUNCH)) {
-        predict_next_io += 500 * LITTON_WORD_BITS;
-    } else {
-        predict_next_io += 714 * LITTON_WORD_BITS;
-    }
-    if (predict_next_io > state->cycle_counter) {
-        uint64_t bits = predict_next_io - state->cycle_counter;
+    uint64_t ready;
+    if (state->output_busy &&
+            litton_event_deadline(state, litton_output_ready, 0, &ready) &&
+            ready > state->cycle_counter) {
+        uint64_t bits = ready - state->cycle_counter;
         bits += LITTON_WORD_BITS - 1; /* Round up */
         litton_add_opcode_timing(state, bits / LITTON_WORD_BITS);
     }
-    state->last_io_counter = state->cycle_counter;
+
+    /* Reschedule the ready event for the byte that is being sent now */
+    if (state->io_word_times != 0 &&
+            litton_schedule_event
+                (state, state->cycle_counter +
+                    ((uint64_t)(state->io_word_times)) * LITTON_WORD_BITS,
+                 litton_output_ready, 0)) {
+        state->output_busy = 1;
+    } else {
+        litton_cancel_event(state, litton_output_ready, 0);
+        state->output_busy = 0;
+    }
 }
 
 static uint16_t litton_available_scratchpad(litton_state_t *state)
@@ -141,79 +96,211 @@ static uint16_t litton_available_scratchpad(litton_state_t *state)
     return 0;
 }
 
-static void litton_single_left_shift
+/*
+ * The binary shift kernels below compute the result of shifting by N
+ * bits in one step rather than one bit at a time.  Left shifts insert K
+ * into the first bit that is shifted in, and right shifts fill all of
+ * the vacated bits with K.  The final value of K is the last bit that
+ * was shifted out, or zero if N is zero.
+ */
+
+void litton_single_left_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
+{
+    /* Shift in K first, and then the remaining N - 1 zero bits */
+    litton_word_t W = (*word << 1) | K;
+    if (N == 0) {
+        state->K = 0;
+        return;
+    }
+    if (N <= LITTON_WORD_BITS) {
+        *word = (W << (N - 1)) & LITTON_WORD_MASK;
+    } else {
+        *word = 0;
+    }
+    if (N <= (LITTON_WORD_BITS + 1)) {
+        state->K = (W >> (LITTON_WORD_BITS + 1 - N)) & 1;
+    } else {
+        state->K = 0;
+    }
+}
+
+void litton_single_right_shift
     (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
 {
     litton_word_t A = *word;
-    litton_word_t final_K = 0;
-    while (N > 0) {
-        A = (A << 1) | K;
-        final_K = (A >> LITTON_WORD_BITS);
-        A &= LITTON_WORD_MASK;
-        K = 0;
-        --N;
+    litton_word_t fill = K ? LITTON_WORD_MASK : 0;
+    if (N == 0) {
+        state->K = 0;
+        return;
+    }
+    if (N < LITTON_WORD_BITS) {
+        *word = (A >> N) | ((fill << (LITTON_WORD_BITS - N)) & LITTON_WORD_MASK);
+    } else {
+        *word = fill;
+    }
+    if (N <= LITTON_WORD_BITS) {
+        state->K = (A >> (N - 1)) & 1;
+    } else {
+        state->K = K;
     }
-    *word = A;
-    state->K = final_K;
 }
 
-static void litton_double_left_shift
+#if defined(__SIZEOF_INT128__)
+
+/** Number of bits in the value for a double shift */
+#define LITTON_DOUBLE_BITS (LITTON_WORD_BITS * 2)
+
+/** Mask for the value in a double shift */
+#define LITTON_DOUBLE_MASK \
+    ((((unsigned __int128)1) << LITTON_DOUBLE_BITS) - 1)
+
+void litton_double_left_shift
     (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
      litton_word_t K, uint16_t N)
 {
-    litton_word_t A = *word1;
-    litton_word_t B = *word2;
-    litton_word_t final_K = 0;
-    while (N > 0) {
-        B = (B << 1) | K;
-        final_K = (B >> LITTON_WORD_BITS);
-        B &= LITTON_WORD_MASK;
-        A = (A << 1) | final_K;
-        final_K = (A >> LITTON_WORD_BITS);
-        A &= LITTON_WORD_MASK;
-        K = 0;
-        --N;
+    /* Shift in K first, and then the remaining N - 1 zero bits */
+    unsigned __int128 W =
+        (((unsigned __int128)(*word1)) << (LITTON_WORD_BITS + 1)) |
+        (((unsigned __int128)(*word2)) << 1) | K;
+    if (N == 0) {
+        state->K = 0;
+        return;
     }
-    *word1 = A;
-    *word2 = B;
-    state->K = final_K;
+    if (N <= (LITTON_DOUBLE_BITS + 1)) {
+        state->K = (litton_word_t)(W >> (LITTON_DOUBLE_BITS + 1 - N)) & 1;
+    } else {
+        state->K = 0;
+    }
+    if (N <= LITTON_DOUBLE_BITS) {
+        W = (W << (N - 1)) & LITTON_DOUBLE_MASK;
+    } else {
+        W = 0;
+    }
+    *word1 = (litton_word_t)(W >> LITTON_WORD_BITS);
+    *word2 = (litton_word_t)W & LITTON_WORD_MASK;
 }
 
-static void litton_single_right_shift
-    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
+void litton_double_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
 {
-    litton_word_t A = *word;
-    litton_word_t final_K = 0;
-    while (N > 0) {
-        final_K = A & 1;
-        A = (A >> 1) | (K << (LITTON_WORD_BITS - 1));
-        --N;
+    unsigned __int128 V =
+        (((unsigned __int128)(*word1)) << LITTON_WORD_BITS) | *word2;
+    unsigned __int128 fill = K ? LITTON_DOUBLE_MASK : 0;
+    if (N == 0) {
+        state->K = 0;
+        return;
+    }
+    if (N <= LITTON_DOUBLE_BITS) {
+        state->K = (litton_word_t)(V >> (N - 1)) & 1;
+    } else {
+        state->K = K;
+    }
+    if (N < LITTON_DOUBLE_BITS) {
+        V = (V >> N) | ((fill << (LITTON_DOUBLE_BITS - N)) & LITTON_DOUBLE_MASK);
+    } else {
+        V = fill;
+    }
+    *word1 = (litton_word_t)(V >> LITTON_WORD_BITS);
+    *word2 = (litton_word_t)V & LITTON_WORD_MASK;
+}
+
+#else /* !__SIZEOF_INT128__ */
+
+/**
+ * @brief Gets a bit from a double-word value.
+ *
+ * @param[in] hi High word of the value.
+ * @param[in] lo Low word of the value.
+ * @param[in] bit Number of the bit to get, between 0 and 79.
+ *
+ * @return The value of the bit.
+ */
+static litton_word_t litton_double_bit
+    (litton_word_t hi, litton_word_t lo, uint16_t bit)
+{
+    if (bit >= LITTON_WORD_BITS) {
+        return (hi >> (bit - LITTON_WORD_BITS)) & 1;
+    } else {
+        return (lo >> bit) & 1;
     }
-    *word = A;
-    state->K = final_K;
 }
 
-static void litton_double_right_shift
+void litton_double_left_shift
     (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
      litton_word_t K, uint16_t N)
 {
-    litton_word_t A = *word1;
-    litton_word_t B = *word2;
-    litton_word_t final_K = 0;
-    litton_word_t carry_K = 0;
-    while (N > 0) {
-        carry_K = A & 1;
-        A = (A >> 1) | (K << (LITTON_WORD_BITS - 1));
-        final_K = B & 1;
-        B = (B >> 1) | (carry_K << (LITTON_WORD_BITS - 1));
-        --N;
+    litton_word_t hi = *word1;
+    litton_word_t lo = *word2;
+    if (N == 0) {
+        state->K = 0;
+        return;
     }
-    *word1 = A;
-    *word2 = B;
-    state->K = final_K;
+    if (N <= (LITTON_WORD_BITS * 2)) {
+        state->K = litton_double_bit(hi, lo, LITTON_WORD_BITS * 2 - N);
+    } else if (N == (LITTON_WORD_BITS * 2 + 1)) {
+        state->K = K;
+    } else {
+        state->K = 0;
+    }
+
+    /* Shift the value left by N bits */
+    if (N >= (LITTON_WORD_BITS * 2)) {
+        hi = 0;
+        lo = 0;
+    } else if (N >= LITTON_WORD_BITS) {
+        hi = (lo << (N - LITTON_WORD_BITS)) & LITTON_WORD_MASK;
+        lo = 0;
+    } else {
+        hi = ((hi << N) | (lo >> (LITTON_WORD_BITS - N))) & LITTON_WORD_MASK;
+        lo = (lo << N) & LITTON_WORD_MASK;
+    }
+
+    /* K ends up in the last bit that was shifted in */
+    if (N <= LITTON_WORD_BITS) {
+        lo |= K << (N - 1);
+    } else if (N <= (LITTON_WORD_BITS * 2)) {
+        hi |= K << (N - 1 - LITTON_WORD_BITS);
+    }
+    *word1 = hi;
+    *word2 = lo;
+}
+
+void litton_double_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
+{
+    litton_word_t hi = *word1;
+    litton_word_t lo = *word2;
+    litton_word_t fill = K ? LITTON_WORD_MASK : 0;
+    if (N == 0) {
+        state->K = 0;
+        return;
+    }
+    if (N <= (LITTON_WORD_BITS * 2)) {
+        state->K = litton_double_bit(hi, lo, N - 1);
+    } else {
+        state->K = K;
+    }
+    if (N >= (LITTON_WORD_BITS * 2)) {
+        hi = fill;
+        lo = fill;
+    } else if (N >= LITTON_WORD_BITS) {
+        lo = (hi >> (N - LITTON_WORD_BITS)) |
+             ((fill << (LITTON_WORD_BITS * 2 - N)) & LITTON_WORD_MASK);
+        hi = fill;
+    } else {
+        lo = ((lo >> N) | (hi << (LITTON_WORD_BITS - N))) & LITTON_WORD_MASK;
+        hi = (hi >> N) | ((fill << (LITTON_WORD_BITS - N)) & LITTON_WORD_MASK);
+    }
+    *word1 = hi;
+    *word2 = lo;
 }
 
-static litton_step_result_t litton_binary_shift
+#endif /* !__SIZEOF_INT128__ */
+
+litton_step_result_t litton_binary_shift
     (litton_state_t *state, uint16_t insn)
 {
     uint16_t S = litton_available_scratchpad(state);
@@ -327,32 +414,205 @@ static litton_step_result_t litton_binary_shift
     return LITTON_STEP_OK;
 }
 
-static void litton_single_decimal_left_shift
+/*
+ * The decimal shift kernels below shift by N digits in one step, using
+ * multiplication and division by a power of ten.  Left shifts add the
+ * constant K to the first digit that is shifted in.
+ */
+
+/**
+ * @brief Powers of ten modulo 2 to the power of 80, split into high and
+ * low words.
+ *
+ * The entries are exact up to 10 to the power of 24, which is the largest
+ * power of ten that fits in two words.  The low words on their own are the
+ * powers of ten modulo 2 to the power of 40.
+ */
+static const litton_word_t litton_powers_of_ten[LITTON_WORD_BITS * 2][2] = {
+    {0x0000000000ULL, 0x0000000001ULL},
+    {0x0000000000ULL, 0x000000000AULL},
+    {0x0000000000ULL, 0x0000000064ULL},
+    {0x0000000000ULL, 0x00000003E8ULL},
+    {0x0000000000ULL, 0x0000002710ULL},
+    {0x0000000000ULL, 0x00000186A0ULL},
+    {0x0000000000ULL, 0x00000F4240ULL},
+    {0x0000000000ULL, 0x0000989680ULL},
+    {0x0000000000ULL, 0x0005F5E100ULL},
+    {0x0000000000ULL, 0x003B9ACA00ULL},
+    {0x0000000000ULL, 0x02540BE400ULL},
+    {0x0000000000ULL, 0x174876E800ULL},
+    {0x0000000000ULL, 0xE8D4A51000ULL},
+    {0x0000000009ULL, 0x184E72A000ULL},
+    {0x000000005AULL, 0xF3107A4000ULL},
+    {0x000000038DULL, 0x7EA4C68000ULL},
+    {0x0000002386ULL, 0xF26FC10000ULL},
+    {0x0000016345ULL, 0x785D8A0000ULL},
+    {0x00000DE0B6ULL, 0xB3A7640000ULL},
+    {0x00008AC723ULL, 0x0489E80000ULL},
+    {0x00056BC75EULL, 0x2D63100000ULL},
+    {0x003635C9ADULL, 0xC5DEA00000ULL},
+    {0x021E19E0C9ULL, 0xBAB2400000ULL},
+    {0x152D02C7E1ULL, 0x4AF6800000ULL},
+    {0xD3C21BCECCULL, 0xEDA1000000ULL},
+    {0x4595161401ULL, 0x484A000000ULL},
+    {0xB7D2DCC80CULL, 0xD2E4000000ULL},
+    {0x2E3C9FD080ULL, 0x3CE8000000ULL},
+    {0xCE5E3E2502ULL, 0x6110000000ULL},
+    {0x0FAE6D7217ULL, 0xCAA0000000ULL},
+    {0x9CD04674EDULL, 0xEA40000000ULL},
+    {0x2022C0914BULL, 0x2680000000ULL},
+    {0x415B85ACEFULL, 0x8100000000ULL},
+    {0x8D9338C15BULL, 0x0A00000000ULL},
+    {0x87C0378D8EULL, 0x6400000000ULL},
+    {0x4D822B878FULL, 0xE800000000ULL},
+    {0x0715B34B9FULL, 0x1000000000ULL},
+    {0x46D900F436ULL, 0xA000000000ULL},
+    {0xC47A098A22ULL, 0x4000000000ULL},
+    {0xACC45F6556ULL, 0x8000000000ULL},
+    {0xBFABB9F561ULL, 0x0000000000ULL},
+    {0x7CB54395CAULL, 0x0000000000ULL},
+    {0xDF14A3D9E4ULL, 0x0000000000ULL},
+    {0xB6CE6682E8ULL, 0x0000000000ULL},
+    {0x2410011D10ULL, 0x0000000000ULL},
+    {0x68A00B22A0ULL, 0x0000000000ULL},
+    {0x16406F5A40ULL, 0x0000000000ULL},
+    {0xDE84598680ULL, 0x0000000000ULL},
+    {0xB12B7F4100ULL, 0x0000000000ULL},
+    {0xEBB2F88A00ULL, 0x0000000000ULL},
+    {0x34FDB56400ULL, 0x0000000000ULL},
+    {0x11E915E800ULL, 0x0000000000ULL},
+    {0xB31ADB1000ULL, 0x0000000000ULL},
+    {0xFF0C8EA000ULL, 0x0000000000ULL},
+    {0xF67D924000ULL, 0x0000000000ULL},
+    {0xA0E7B68000ULL, 0x0000000000ULL},
+    {0x490D210000ULL, 0x0000000000ULL},
+    {0xDA834A0000ULL, 0x0000000000ULL},
+    {0x8920E40000ULL, 0x0000000000ULL},
+    {0x5B48E80000ULL, 0x0000000000ULL},
+    {0x90D9100000ULL, 0x0000000000ULL},
+    {0xA87AA00000ULL, 0x0000000000ULL},
+    {0x94CA400000ULL, 0x0000000000ULL},
+    {0xCFE6800000ULL, 0x0000000000ULL},
+    {0x1F01000000ULL, 0x0000000000ULL},
+    {0x360A000000ULL, 0x0000000000ULL},
+    {0x1C64000000ULL, 0x0000000000ULL},
+    {0x1BE8000000ULL, 0x0000000000ULL},
+    {0x1710000000ULL, 0x0000000000ULL},
+    {0xE6A0000000ULL, 0x0000000000ULL},
+    {0x0240000000ULL, 0x0000000000ULL},
+    {0x1680000000ULL, 0x0000000000ULL},
+    {0xE100000000ULL, 0x0000000000ULL},
+    {0xCA00000000ULL, 0x0000000000ULL},
+    {0xE400000000ULL, 0x0000000000ULL},
+    {0xE800000000ULL, 0x0000000000ULL},
+    {0x1000000000ULL, 0x0000000000ULL},
+    {0xA000000000ULL, 0x0000000000ULL},
+    {0x4000000000ULL, 0x0000000000ULL},
+    {0x8000000000ULL, 0x0000000000ULL}
+};
+
+/** Largest power of ten that fits in a single word */
+#define LITTON_WORD_MAX_POWER_OF_TEN 12
+
+/** Largest power of ten that fits in two words */
+#define LITTON_DOUBLE_MAX_POWER_OF_TEN 24
+
+/**
+ * @brief Gets a power of ten modulo 2 to the power of 40.
+ *
+ * @param[in] N The power.
+ *
+ * @return The power of ten, modulo the word size.
+ */
+static litton_word_t litton_single_power_of_ten(uint16_t N)
+{
+    if (N < (LITTON_WORD_BITS * 2)) {
+        return litton_powers_of_ten[N][1];
+    } else {
+        return 0;
+    }
+}
+
+void litton_single_decimal_left_shift
     (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
 {
-    litton_word_t A = *word;
-    while (N > 0) {
-        A = A * 10 + K;
-        A &= LITTON_WORD_MASK;
-        K = 0;
-        --N;
+    if (N == 0) {
+        state->K = K;
+        return;
     }
-    *word = A;
-    state->K = K;
+    *word = ((*word) * litton_single_power_of_ten(N) +
+             K * litton_single_power_of_ten(N - 1)) & LITTON_WORD_MASK;
+    state->K = 0;
 }
 
-static void litton_single_decimal_right_shift
+void litton_single_decimal_right_shift
     (litton_state_t *state, litton_word_t *word, uint16_t N)
 {
-    litton_word_t A = *word;
-    while (N > 0) {
-        A = A / 10;
-        --N;
+    if (N <= LITTON_WORD_MAX_POWER_OF_TEN) {
+        *word /= litton_powers_of_ten[N][1];
+    } else {
+        *word = 0;
+    }
+    state->K = 0;
+}
+
+#if defined(__SIZEOF_INT128__)
+
+/**
+ * @brief Gets a power of ten modulo 2 to the power of 80.
+ *
+ * @param[in] N The power.
+ *
+ * @return The power of ten, modulo the double word size.
+ */
+static unsigned __int128 litton_double_power_of_ten(uint16_t N)
+{
+    if (N < LITTON_DOUBLE_BITS) {
+        return (((unsigned __int128)(litton_powers_of_ten[N][0]))
+                    << LITTON_WORD_BITS) | litton_powers_of_ten[N][1];
+    } else {
+        return 0;
+    }
+}
+
+void litton_double_decimal_left_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
+{
+    unsigned __int128 V =
+        (((unsigned __int128)(*word1)) << LITTON_WORD_BITS) | *word2;
+    if (N == 0) {
+        state->K = K;
+        return;
+    }
+    V = (V * litton_double_power_of_ten(N) +
+         K * litton_double_power_of_ten(N - 1)) & LITTON_DOUBLE_MASK;
+    *word1 = (litton_word_t)(V >> LITTON_WORD_BITS);
+    *word2 = (litton_word_t)V & LITTON_WORD_MASK;
+    state->K = 0;
+}
+
+void litton_double_decimal_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     uint16_t N)
+{
+    unsigned __int128 V =
+        (((unsigned __int128)(*word1)) << LITTON_WORD_BITS) | *word2;
+    if (N <= LITTON_DOUBLE_MAX_POWER_OF_TEN) {
+        V /= litton_double_power_of_ten(N);
+    } else {
+        V = 0;
     }
-    *word = A;
+    *word1 = (litton_word_t)(V >> LITTON_WORD_BITS);
+    *word2 = (litton_word_t)V & LITTON_WORD_MASK;
     state->K = 0;
 }
 
+#else /* !__SIZEOF_INT128__ */
+
+/* Without 128-bit arithmetic, double decimal shifts are performed one
+ * digit at a time */
+
 static void litton_double_times_2
     (litton_word_t *word1, litton_word_t *word2)
 {
@@ -383,7 +643,7 @@ static void litton_double_mul_10
     *word2 &= LITTON_WORD_MASK;
 }
 
-static void litton_double_decimal_left_shift
+void litton_double_decimal_left_shift
     (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
      litton_word_t K, uint16_t N)
 {
@@ -419,7 +679,7 @@ static void litton_double_div_10
     }
 }
 
-static void litton_double_decimal_right_shift
+void litton_double_decimal_right_shift
     (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
      uint16_t N)
 {
@@ -434,7 +694,9 @@ static void litton_double_decimal_right_shift
     state->K = 0;
 }
 
-static litton_step_result_t litton_decimal_shift
+#endif /* !__SIZEOF_INT128__ */
+
+litton_step_result_t litton_decimal_shift
     (litton_state_t *state, uint16_t insn)
 {
     uint16_t S = litton_available_scratchpad(state);
@@ -553,9 +815,61 @@ static void litton_parity_check
     }
 }
 
-static litton_step_result_t litton_perform_io
+/**
+ * @brief Number of consecutive failed input polls from the same state
+ * before the program is considered to be idle.
+ *
+ * Once the state repeats, the program cannot do anything different
+ * until input arrives.  Wait for a few repeats anyway to be safe.
+ */
+#define LITTON_IDLE_POLLS 4
+
+/**
+ * @brief Handles an input instruction when the input device is not ready.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] idle_polls Number of failed input polls from the same state
+ * before this one.
+ *
+ * If the program keeps polling from the same registers without storing
+ * anything to memory or doing other I/O, then it is in a wait loop that
+ * cannot make progress until input arrives.  Flag the program as idle.
+ */
+static void litton_input_not_ready(litton_state_t *state, unsigned idle_polls)
+{
+    litton_add_opcode_timing(state, 3);
+    state->io_wait = 1;
+    state->K = 0;
+    if (idle_polls > 0 && state->A == state->idle_A &&
+            state->I == state->idle_I && state->PC == state->idle_PC &&
+            state->CR == state->idle_CR && state->B == state->idle_B &&
+            state->P == state->idle_P) {
+        if (idle_polls < LITTON_IDLE_POLLS) {
+            ++idle_polls;
+        } else {
+            state->idle = 1;
+        }
+        state->idle_polls = idle_polls;
+    } else {
+        state->idle_A = state->A;
+        state->idle_I = state->I;
+        state->idle_PC = state->PC;
+        state->idle_CR = state->CR;
+        state->idle_B = state->B;
+        state->idle_P = state->P;
+        state->idle_polls = 1;
+    }
+}
+
+litton_step_result_t litton_perform_io
     (litton_state_t *state, uint16_t insn)
 {
+    /* Transferring data or waiting for a busy output device means that
+     * the program is not idle, so restart idle detection from scratch */
+    unsigned idle_polls = state->idle_polls;
+    state->idle_polls = 0;
+    state->idle = 0;
+
     /* If we're doing an I/O instruction, then the code is probably
      * looping waiting for input ready or output not busy.  Which is OK. */
     state->spin_counter = 0;
@@ -574,8 +888,7 @@ static litton_step_result_t litton_perform_io
             state->K = 1;
         } else {
             /* Input device is currently busy */
-            litton_add_opcode_timing(state, 3);
-            state->K = 0;
+            litton_input_not_ready(state, idle_polls);
         }
         break;
 
@@ -590,8 +903,7 @@ static litton_step_result_t litton_perform_io
             state->K = 1;
         } else {
             /* Input device is currently busy */
-            litton_add_opcode_timing(state, 3);
-            state->K = 0;
+            litton_input_not_ready(state, idle_polls);
         }
         break;
 
@@ -606,8 +918,7 @@ static litton_step_result_t litton_perform_io
             state->K = 1;
         } else {
             /* Input device is currently busy */
-            litton_add_opcode_timing(state, 3);
-            state->K = 0;
+            litton_input_not_ready(state, idle_polls);
         }
         break;
 
@@ -622,8 +933,7 @@ static litton_step_result_t litton_perform_io
             state->K = 1;
         } else {
             /* Input device is currently busy */
-            litton_add_opcode_timing(state, 3);
-            state->K = 0;
+            litton_input_not_ready(state, idle_polls);
         }
         break;
 
@@ -641,8 +951,7 @@ static litton_step_result_t litton_perform_io
             state->K = 1;
         } else {
             /* Input device is currently busy */
-            litton_add_opcode_timing(state, 3);
-            state->K = 0;
+            litton_input_not_ready(state, idle_polls);
         }
         break;
 
@@ -660,8 +969,7 @@ static litton_step_result_t litton_perform_io
             state->K = 1;
         } else {
             /* Input device is currently busy */
-            litton_add_opcode_timing(state, 3);
-            state->K = 0;
+            litton_input_not_ready(state, idle_polls);
         }
         break;
 
@@ -677,6 +985,7 @@ static litton_step_result_t litton_perform_io
         } else {
             /* Output device is currently busy */
             litton_add_opcode_timing(state, 3);
+            state->io_wait = 1;
             state->K = 0;
         }
         break;
@@ -693,6 +1002,7 @@ static litton_step_result_t litton_perform_io
         } else {
             /* Output device is currently busy */
             litton_add_opcode_timing(state, 3);
+            state->io_wait = 1;
             state->K = 0;
         }
         break;
@@ -709,6 +1019,7 @@ static litton_step_result_t litton_perform_io
         } else {
             /* Output device is currently busy */
             litton_add_opcode_timing(state, 3);
+            state->io_wait = 1;
             state->K = 0;
         }
         break;
@@ -727,6 +1038,7 @@ static litton_step_result_t litton_perform_io
             } else {
                 /* Output device is currently busy */
                 litton_add_opcode_timing(state, 3);
+                state->io_wait = 1;
                 state->K = 0;
             }
             break;
@@ -742,6 +1054,7 @@ static litton_step_result_t litton_perform_io
             } else {
                 /* Output device is currently busy */
                 litton_add_opcode_timing(state, 3);
+                state->io_wait = 1;
                 state->K = 0;
             }
             break;
@@ -753,6 +1066,9 @@ static litton_step_result_t litton_perform_io
             state->A = (state->A << 8) & 0xFFFFFFFF00ULL;
             litton_select_device(state, state->B);
             state->K = 1;
+
+            /* Selecting a device does not transfer any data */
+            state->idle_polls = idle_polls;
             break;
 
         case LOP_IST:
@@ -765,6 +1081,7 @@ static litton_step_result_t litton_perform_io
             } else {
                 /* Output device is currently busy */
                 litton_add_opcode_timing(state, 3);
+                state->io_wait = 1;
                 state->K = 0;
             }
             break;
@@ -775,6 +1092,9 @@ static litton_step_result_t litton_perform_io
             state->B = insn & 0x00FF;
             litton_select_device(state, state->B);
             state->K = 1;
+
+            /* Selecting a device does not transfer any data */
+            state->idle_polls = idle_polls;
             break;
 
         default:
@@ -785,7 +1105,19 @@ static litton_step_result_t litton_perform_io
     return LITTON_STEP_OK;
 }
 
-litton_step_result_t litton_step(litton_state_t *state)
+/**
+ * @brief Executes a single instruction.
+ *
+ * @param[in,out] state The state of the computer.
+ *
+ * @return LITTON_STEP_OK, LITTON_STEP_HALT, ...
+ *
+ * This is inlined into both litton_step() and litton_run() so that the
+ * batched execution loop in litton_run() does not need a function call
+ * per instruction.
+ */
+static LITTON_INLINE litton_step_result_t litton_execute
+    (litton_state_t *state)
 {
     litton_step_result_t result = LITTON_STEP_OK;
     litton_drum_loc_t addr;
@@ -798,11 +1130,8 @@ litton_step_result_t litton_step(litton_state_t *state)
         return LITTON_STEP_SPINNING;
     }
     ++(state->spin_counter);
-
-    /* Decrement the acceleration counter every instruction */
-    if (state->acceleration_counter > 0) {
-        --(state->acceleration_counter);
-    }
+    state->jumped = 0;
+    state->io_wait = 0;
 
 #if !LITTON_SMALL_MEMORY
     /* Dump the state of the registers before the instruction */
@@ -1074,6 +1403,7 @@ litton_step_result_t litton_step(litton_state_t *state)
             state->I = litton_get_memory(state, addr);
             state->PC = addr;
             state->spin_counter = 0;
+            state->jumped = 1;
             break;
 
         case 0xD0:
@@ -1096,6 +1426,7 @@ litton_step_result_t litton_step(litton_state_t *state)
             state->I = litton_get_memory(state, addr);
             state->PC = addr;
             state->spin_counter = 0;
+            state->jumped = 1;
             break;
 
         case 0xF0:
@@ -1107,6 +1438,7 @@ litton_step_result_t litton_step(litton_state_t *state)
                 state->I = litton_get_memory(state, addr);
                 state->PC = addr;
                 state->spin_counter = 0;
+                state->jumped = 1;
 
                 /* Convert the instruction into an unconditional jump
                  * when we rotate it back in again later. */
@@ -1135,3 +1467,295 @@ litton_step_result_t litton_step(litton_state_t *state)
     /* Return the step result to the caller */
     return result;
 }
+
+litton_step_result_t litton_step(litton_state_t *state)
+{
+    litton_step_result_t result = litton_execute(state);
+    if (state->cycle_counter >= state->next_event) {
+        litton_dispatch_events(state);
+    }
+    return result;
+}
+
+uint64_t litton_skip_delay_loop
+    (litton_state_t *state, uint64_t max_instructions, uint64_t end_cycles)
+{
+    litton_drum_loc_t PC = state->PC;
+    uint8_t CR = state->CR;
+    litton_word_t I = state->I;
+    unsigned predictor = state->rotation_predictor;
+    uint64_t start_cycles = state->cycle_counter;
+    uint16_t insn = (uint16_t)((CR << 8) | (I >> (LITTON_WORD_BITS - 8)));
+    unsigned N = (insn & 0x7F) + 1;
+    uint64_t cycles, iterations, max_iterations;
+    litton_word_t A, K;
+
+    /* Breakpoints and disassembly need every instruction to be executed */
+    if (state->breakpoints || state->disassemble ||
+            max_instructions < 4 || start_cycles >= end_cycles) {
+        return 0;
+    }
+
+    /* Run the first iteration normally to find out how long it takes.
+     * We may have come in from somewhere else, so make sure that we end
+     * up back on the same word with the drum in the same position. */
+    litton_execute(state);
+    if (state->cycle_counter >= end_cycles) {
+        return 1;
+    }
+    litton_execute(state);
+    if (state->cycle_counter >= end_cycles || !(state->jumped) ||
+            state->PC != PC || state->CR != CR || state->I != I ||
+            state->rotation_predictor != predictor) {
+        return 2;
+    }
+    cycles = state->cycle_counter - start_cycles;
+
+    /* Every iteration from now on takes the same amount of time.  Work out
+     * how many iterations fit within the budget and keep K set to 1. */
+    max_iterations = (max_instructions - 2) / 2;
+    if (max_iterations > (end_cycles - state->cycle_counter) / cycles) {
+        max_iterations = (end_cycles - state->cycle_counter) / cycles;
+    }
+    K = (insn & 0x0080) ? state->K : 0;
+    A = state->A;
+    for (iterations = 0; iterations < max_iterations; ++iterations) {
+        litton_word_t next = A;
+        if ((insn & 0xFF00) == (LOP_BLS & 0xFF00)) {
+            litton_single_left_shift(state, &next, K, N);
+        } else {
+            litton_single_right_shift(state, &next, K, N);
+        }
+        if (!(state->K)) {
+            /* Leave the final iteration to be executed normally */
+            break;
+        }
+        if (next == A) {
+            /* A will never change again, so the loop will not end */
+            iterations = max_iterations;
+            break;
+        }
+        A = next;
+    }
+
+    /* Advance the state as though we had run the iterations */
+    state->A = A;
+    state->K = 1;
+    state->cycle_counter += iterations * cycles;
+    return 2 + iterations * 2;
+}
+
+/**
+ * @brief Runs the computer with the selected execution engine.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_cycles Maximum number of cycles to run for, or 0 for no limit.
+ * @param[in] max_instructions Maximum number of instructions to run for,
+ * or 0 for no limit.
+ * @param[out] result Returns information about the run, may be NULL.
+ *
+ * @return The reason why the run loop stopped.
+ */
+static litton_run_reason_t litton_run_engine
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result)
+{
+    switch (state->engine) {
+#if !LITTON_SMALL_MEMORY
+    case LITTON_ENGINE_CACHED:
+        if (state->decode_cache && !(state->disassemble)) {
+            return litton_run_cached
+                (state, max_cycles, max_instructions, result);
+        }
+        break;
+
+    case LITTON_ENGINE_THREADED:
+        return litton_run_threaded
+            (state, max_cycles, max_instructions, result);
+
+    case LITTON_ENGINE_TRACE:
+        if (state->trace_cache && !(state->disassemble)) {
+            return litton_run_trace
+                (state, max_cycles, max_instructions, result);
+        }
+        break;
+
+#if LITTON_JIT_SUPPORTED
+    case LITTON_ENGINE_JIT:
+        if (state->trace_cache && !(state->disassemble)) {
+            return litton_run_trace
+                (state, max_cycles, max_instructions, result);
+        }
+        break;
+#endif
+#endif
+
+    default: break;
+    }
+    return litton_run_with
+        (state, max_cycles, max_instructions, result, litton_execute);
+}
+
+litton_run_reason_t litton_run
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result)
+{
+    litton_run_reason_t reason;
+    litton_run_result_t slice_result;
+    uint64_t start_cycles;
+    uint64_t instructions = 0;
+    uint64_t slice_cycles;
+    uint64_t slice_instructions;
+
+    /* Dispatch the events that are due and then run the engine.  The
+     * engine stops when it reaches the next event deadline, including for
+     * events that it schedules itself, so keep going until the budget
+     * runs out or the engine stops for some other reason */
+    start_cycles = state->cycle_counter;
+    for (;;) {
+        litton_dispatch_events(state);
+        slice_cycles = 0;
+        if (max_cycles) {
+            slice_cycles = max_cycles - (state->cycle_counter - start_cycles);
+        }
+        slice_instructions = 0;
+        if (max_instructions) {
+            slice_instructions = max_instructions - instructions;
+        }
+        reason = litton_run_engine
+            (state, slice_cycles, slice_instructions, &slice_result);
+        instructions += slice_result.instructions;
+        if (reason != LITTON_RUN_BUDGET) {
+            break;
+        }
+        if (max_cycles &&
+                (state->cycle_counter - start_cycles) >= max_cycles) {
+            break;
+        }
+        if (max_instructions && instructions >= max_instructions) {
+            break;
+        }
+    }
+    litton_dispatch_events(state);
+    if (result) {
+        result->reason = reason;
+        result->cycles = state->cycle_counter - start_cycles;
+        result->instructions = instructions;
+    }
+    return reason;
+}
+
+void litton_set_breakpoint
+    (litton_state_t *state, litton_drum_loc_t addr, int enable)
+{
+    addr &= (LITTON_DRUM_MAX_SIZE - 1);
+    if (!(state->breakpoints)) {
+        if (!enable) {
+            return;
+        }
+        state->breakpoints = calloc(1, LITTON_DRUM_MAX_SIZE / 8);
+        if (!(state->breakpoints)) {
+            return;
+        }
+    }
+    if (enable) {
+        state->breakpoints[addr >> 3] |= (uint8_t)(1 << (addr & 0x07));
+    } else {
+        state->breakpoints[addr >> 3] &= (uint8_t)~(1 << (addr & 0x07));
+    }
+}
+
+void litton_clear_breakpoints(litton_state_t *state)
+{
+    if (state->breakpoints) {
+        free(state->breakpoints);
+        state->breakpoints = 0;
+    }
+}
+
+int litton_set_engine(litton_state_t *state, litton_engine_t engine)
+{
+    switch (engine) {
+    case LITTON_ENGINE_REFERENCE:
+        break;
+
+#if !LITTON_SMALL_MEMORY
+    case LITTON_ENGINE_CACHED:
+        /* Allocate the decode cache the first time it is needed */
+        if (!(state->decode_cache)) {
+            state->decode_cache = litton_decode_cache_create();
+            if (!(state->decode_cache)) {
+                return 0;
+            }
+        }
+        break;
+
+    case LITTON_ENGINE_THREADED:
+        break;
+
+    case LITTON_ENGINE_TRACE:
+        /* Allocate the trace cache the first time it is needed */
+        if (!(state->trace_cache)) {
+            state->trace_cache = litton_trace_cache_create();
+            if (!(state->trace_cache)) {
+                return 0;
+            }
+        }
+        break;
+
+    case LITTON_ENGINE_JIT:
+#if LITTON_JIT_SUPPORTED
+        if (!(state->trace_cache)) {
+            state->trace_cache = litton_trace_cache_create();
+            if (!(state->trace_cache)) {
+                return 0;
+            }
+        }
+#endif
+        break;
+#endif
+
+    default:
+        return 0;
+    }
+    state->engine = engine;
+    return 1;
+}
+
+int litton_engine_from_name
+    (litton_engine_t *engine, const char *name, size_t name_len)
+{
+    if (litton_name_match("reference", name, name_len)) {
+        *engine = LITTON_ENGINE_REFERENCE;
+        return 1;
+    }
+    if (litton_name_match("cached", name, name_len)) {
+        *engine = LITTON_ENGINE_CACHED;
+        return 1;
+    }
+    if (litton_name_match("threaded", name, name_len)) {
+        *engine = LITTON_ENGINE_THREADED;
+        return 1;
+    }
+    if (litton_name_match("trace", name, name_len)) {
+        *engine = LITTON_ENGINE_TRACE;
+        return 1;
+    }
+    if (litton_name_match("jit", name, name_len)) {
+        *engine = LITTON_ENGINE_JIT;
+        return 1;
+    }
+    return 0;
+}
+
+const char *litton_engine_to_name(litton_engine_t engine)
+{
+    switch (engine) {
+    case LITTON_ENGINE_REFERENCE:   return "reference";
+    case LITTON_ENGINE_CACHED:      return "cached";
+    case LITTON_ENGINE_THREADED:    return "threaded";
+    case LITTON_ENGINE_TRACE:       return "trace";
+    case LITTON_ENGINE_JIT:         return "jit";
+    }
+    return "reference"; /* Just in case */
+}
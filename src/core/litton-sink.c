@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "litton/litton.h"
+#include <stdlib.h>
+#include <string.h>
+#if !defined(ARDUINO)
+#include <unistd.h>
+#include <errno.h>
+#define LITTON_POSIX_SINKS 1
+#endif
+
+void litton_sink_write(litton_sink_t *sink, const char *data, size_t size)
+{
+    if (sink) {
+        (*(sink->write))(sink, data, size);
+    } else {
+        fwrite(data, 1, size, stdout);
+    }
+}
+
+void litton_sink_flush(litton_sink_t *sink)
+{
+    if (sink) {
+        if (sink->flush) {
+            (*(sink->flush))(sink);
+        }
+    } else {
+        fflush(stdout);
+    }
+}
+
+void litton_sink_close(litton_sink_t *sink)
+{
+    if (sink) {
+        (*(sink->close))(sink);
+    }
+}
+
+void litton_set_device_sink(litton_device_t *device, litton_sink_t *sink)
+{
+    if (device->sink != sink) {
+        litton_sink_close(device->sink);
+        device->sink = sink;
+    }
+}
+
+typedef struct
+{
+    /** Parent class fields */
+    litton_sink_t parent;
+
+    /** File to write to */
+    FILE *file;
+
+    /** Non-zero to close the file when the sink is closed */
+    int close_file;
+
+} litton_file_sink_t;
+
+static void litton_file_sink_write
+    (litton_sink_t *sink, const char *data, size_t size)
+{
+    fwrite(data, 1, size, ((litton_file_sink_t *)sink)->file);
+}
+
+static void litton_file_sink_flush(litton_sink_t *sink)
+{
+    fflush(((litton_file_sink_t *)sink)->file);
+}
+
+static void litton_file_sink_close(litton_sink_t *sink)
+{
+    litton_file_sink_t *file_sink = (litton_file_sink_t *)sink;
+    if (file_sink->close_file) {
+        fclose(file_sink->file);
+    } else {
+        fflush(file_sink->file);
+    }
+    free(file_sink);
+}
+
+litton_sink_t *litton_create_file_sink(FILE *file, int close_file)
+{
+    litton_file_sink_t *sink = calloc(1, sizeof(litton_file_sink_t));
+    sink->parent.write = litton_file_sink_write;
+    sink->parent.flush = litton_file_sink_flush;
+    sink->parent.close = litton_file_sink_close;
+    sink->file = file;
+    sink->close_file = close_file;
+    return &(sink->parent);
+}
+
+#if defined(LITTON_POSIX_SINKS)
+
+typedef struct
+{
+    /** Parent class fields */
+    litton_sink_t parent;
+
+    /** File descriptor to write to */
+    int fd;
+
+    /** Non-zero to close the file descriptor when the sink is closed */
+    int close_fd;
+
+} litton_fd_sink_t;
+
+static void litton_fd_sink_write
+    (litton_sink_t *sink, const char *data, size_t size)
+{
+    int fd = ((litton_fd_sink_t *)sink)->fd;
+    ssize_t written;
+    while (size > 0) {
+        written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* The reader has gone away or some other error; drop the data */
+            break;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+}
+
+static void litton_fd_sink_close(litton_sink_t *sink)
+{
+    litton_fd_sink_t *fd_sink = (litton_fd_sink_t *)sink;
+    if (fd_sink->close_fd) {
+        close(fd_sink->fd);
+    }
+    free(fd_sink);
+}
+
+litton_sink_t *litton_create_fd_sink(int fd, int close_fd)
+{
+    litton_fd_sink_t *sink = calloc(1, sizeof(litton_fd_sink_t));
+    sink->parent.write = litton_fd_sink_write;
+    sink->parent.flush = 0;
+    sink->parent.close = litton_fd_sink_close;
+    sink->fd = fd;
+    sink->close_fd = close_fd;
+    return &(sink->parent);
+}
+
+static void litton_pipe_sink_close(litton_sink_t *sink)
+{
+    litton_file_sink_t *file_sink = (litton_file_sink_t *)sink;
+    pclose(file_sink->file);
+    free(file_sink);
+}
+
+litton_sink_t *litton_create_pipe_sink(const char *command)
+{
+    litton_sink_t *sink;
+    FILE *file;
+    if ((file = popen(command, "w")) == NULL) {
+        perror(command);
+        return 0;
+    }
+    sink = litton_create_file_sink(file, 0);
+    sink->close = litton_pipe_sink_close;
+    return sink;
+}
+
+#endif /* LITTON_POSIX_SINKS */
+
+/** Initial size of the buffer in a memory sink */
+#define LITTON_MEMORY_SINK_INITIAL_SIZE 1024
+
+typedef struct
+{
+    /** Parent class fields */
+    litton_sink_t parent;
+
+    /** Data that has been written to the sink */
+    char *data;
+
+    /** Number of bytes of data */
+    size_t size;
+
+    /** Allocated size of data, including space for a NUL terminator */
+    size_t max_size;
+
+} litton_memory_sink_t;
+
+static void litton_memory_sink_write
+    (litton_sink_t *sink, const char *data, size_t size)
+{
+    litton_memory_sink_t *memory = (litton_memory_sink_t *)sink;
+    size_t new_max;
+    char *new_data;
+    if ((memory->size + size) >= memory->max_size) {
+        new_max = memory->max_size ? memory->max_size
+                                   : LITTON_MEMORY_SINK_INITIAL_SIZE;
+        while ((memory->size + size) >= new_max) {
+            new_max *= 2;
+        }
+        new_data = realloc(memory->data, new_max);
+        if (!new_data) {
+            /* Out of memory, so drop the data */
+            return;
+        }
+        memory->data = new_data;
+        memory->max_size = new_max;
+    }
+    memcpy(memory->data + memory->size, data, size);
+    memory->size += size;
+    memory->data[memory->size] = '\0';
+}
+
+static void litton_memory_sink_close(litton_sink_t *sink)
+{
+    litton_memory_sink_t *memory = (litton_memory_sink_t *)sink;
+    free(memory->data);
+    free(memory);
+}
+
+litton_sink_t *litton_create_memory_sink(void)
+{
+    litton_memory_sink_t *sink = calloc(1, sizeof(litton_memory_sink_t));
+    sink->parent.write = litton_memory_sink_write;
+    sink->parent.flush = 0;
+    sink->parent.close = litton_memory_sink_close;
+    return &(sink->parent);
+}
+
+const char *litton_memory_sink_data(litton_sink_t *sink, size_t *size)
+{
+    litton_memory_sink_t *memory = (litton_memory_sink_t *)sink;
+    *size = memory->size;
+    return memory->data ? memory->data : "";
+}
+
+void litton_memory_sink_clear(litton_sink_t *sink)
+{
+    litton_memory_sink_t *memory = (litton_memory_sink_t *)sink;
+    memory->size = 0;
+    if (memory->data) {
+        memory->data[0] = '\0';
+    }
+}
+
+typedef struct
+{
+    /** Parent class fields */
+    litton_sink_t parent;
+
+    /** Function to call with the data */
+    litton_sink_callback_t callback;
+
+    /** User data to pass to the callback */
+    void *user_data;
+
+} litton_callback_sink_t;
+
+static void litton_callback_sink_write
+    (litton_sink_t *sink, const char *data, size_t size)
+{
+    litton_callback_sink_t *callback = (litton_callback_sink_t *)sink;
+    (*(callback->callback))(callback->user_data, data, size);
+}
+
+static void litton_callback_sink_close(litton_sink_t *sink)
+{
+    free(sink);
+}
+
+litton_sink_t *litton_create_callback_sink
+    (litton_sink_callback_t callback, void *user_data)
+{
+    litton_callback_sink_t *sink = calloc(1, sizeof(litton_callback_sink_t));
+    sink->parent.write = litton_callback_sink_write;
+    sink->parent.flush = 0;
+    sink->parent.close = litton_callback_sink_close;
+    sink->callback = callback;
+    sink->user_data = user_data;
+    return &(sink->parent);
+}
@@ -21,6 +21,7 @@
  */
 
 #include "litton/litton.h"
+#include "litton-internal.h"
 #include <stdlib.h>
 #include <string.h>
 #if defined(__AVR__)
@@ -62,6 +63,9 @@ void litton_init(litton_state_t *state)
 {
     memset(state, 0, sizeof(litton_state_t));
     litton_clear_memory(state);
+    state->next_event = UINT64_MAX;
+    litton_update_io_word_times(state);
+    litton_charset_init();
 }
 
 void litton_free(litton_state_t *state)
@@ -74,13 +78,30 @@ void litton_free(litton_state_t *state)
         if (device->close != 0) {
             (*(device->close))(state, device);
         }
+        litton_sink_close(device->sink);
         if (device->file) {
             fclose(device->file);
         }
+        free(device->tape_data);
         free(device);
         device = next_device;
     }
 
+    /* Free the breakpoint table */
+    litton_clear_breakpoints(state);
+
+#if !LITTON_SMALL_MEMORY
+    /* Free the decode cache */
+    if (state->decode_cache) {
+        free(state->decode_cache);
+    }
+
+    /* Free the trace cache */
+    if (state->trace_cache) {
+        litton_trace_cache_free(state->trace_cache);
+    }
+#endif
+
     /* Clear the machine state */
     memset(state, 0, sizeof(litton_state_t));
 }
@@ -124,6 +145,19 @@ void litton_reset(litton_state_t *state)
 
     /* K is set to 1 upon reset */
     state->K = 1;
+
+    /* Restart idle detection */
+    state->idle_polls = 0;
+    state->idle = 0;
+
+#if !LITTON_SMALL_MEMORY
+    /* The program may have been reloaded, so forget which words it
+     * was modifying on the previous run */
+    if (state->trace_cache) {
+        memset(state->trace_cache->volatile_words, 0,
+               sizeof(state->trace_cache->volatile_words));
+    }
+#endif
 }
 
 #if LITTON_SMALL_MEMORY
@@ -194,6 +228,7 @@ void litton_set_memory
 {
 #if LITTON_SMALL_MEMORY
     uint8_t *ptr;
+    state->idle_polls = 0;
     if (addr < LITTON_DRUM_RESERVED_SECTORS) {
         /* Write to the scratchpad loop instead of main memory */
         state->scratchpad[addr] = value;
@@ -212,7 +247,14 @@ void litton_set_memory
 #endif
     }
 #else
-    state->drum[addr & (LITTON_DRUM_MAX_SIZE - 1)] = value;
+    /* Writing the same value again doesn't invalidate the caches, so that
+     * compiled code survives when the same image is reloaded.  It is still
+     * a store as far as idle detection is concerned. */
+    state->idle_polls = 0;
+    if (state->drum[addr & (LITTON_DRUM_MAX_SIZE - 1)] != value) {
+        state->drum[addr & (LITTON_DRUM_MAX_SIZE - 1)] = value;
+        litton_decode_cache_invalidate(state, addr);
+    }
 #endif
 }
 
@@ -230,6 +272,7 @@ void litton_set_scratchpad
 {
 #if LITTON_SMALL_MEMORY
     state->scratchpad[S & (LITTON_DRUM_RESERVED_SECTORS - 1)] = value;
+    state->idle_polls = 0;
 #else
     litton_set_memory(state, S & (LITTON_DRUM_RESERVED_SECTORS - 1), value);
 #endif
@@ -238,8 +281,11 @@ void litton_set_scratchpad
 litton_word_t *litton_get_scratchpad_address(litton_state_t *state, uint8_t S)
 {
 #if LITTON_SMALL_MEMORY
+    state->idle_polls = 0;
     return &(state->scratchpad[S & (LITTON_DRUM_RESERVED_SECTORS - 1)]);
 #else
+    /* The caller is about to modify the register through the pointer */
+    litton_decode_cache_invalidate(state, S & (LITTON_DRUM_RESERVED_SECTORS - 1));
     return &(state->drum[S & (LITTON_DRUM_RESERVED_SECTORS - 1)]);
 #endif
 }
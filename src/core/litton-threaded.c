@@ -0,0 +1,608 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "litton/litton.h"
+#include "litton-internal.h"
+#include <string.h>
+#include <pthread.h>
+
+#if !LITTON_SMALL_MEMORY
+
+/*
+ * The threaded engine dispatches directly on the contents of the command
+ * register (CR) through a 256-entry table, rather than going through the
+ * nested switch statements of the reference interpreter.  The table is
+ * generated from litton_opcodes[] the first time that the engine is used.
+ *
+ * With gcc and clang, each handler ends by jumping straight to the handler
+ * for the next instruction using "labels as values" (computed goto).
+ * This gives the host's branch predictor one indirect branch per handler
+ * to learn from.  Other compilers use a single switch statement instead.
+ *
+ * The behaviour and timing of each handler must be kept identical to
+ * litton_step().  The litton-engine-check test program runs the two
+ * side by side to verify this.
+ */
+
+/**
+ * @brief Handlers for the threaded engine, one per distinct behaviour.
+ */
+typedef enum
+{
+    LITTON_TH_HH,               /**< "HH" instruction */
+    LITTON_TH_AK,               /**< "AK" instruction */
+    LITTON_TH_CL,               /**< "CL" instruction */
+    LITTON_TH_NN,               /**< "NN" instruction */
+    LITTON_TH_CM,               /**< "CM" instruction */
+    LITTON_TH_JA,               /**< "JA" instruction */
+    LITTON_TH_BI,               /**< "BI" instruction */
+    LITTON_TH_SK,               /**< "SK" instruction */
+    LITTON_TH_TZ,               /**< "TZ" instruction */
+    LITTON_TH_TH,               /**< "TH" instruction */
+    LITTON_TH_RK,               /**< "RK" instruction */
+    LITTON_TH_TP,               /**< "TP" instruction */
+    LITTON_TH_LA,               /**< "LA" instruction */
+    LITTON_TH_XC,               /**< "XC" instruction */
+    LITTON_TH_XT,               /**< "XT" instruction */
+    LITTON_TH_TE,               /**< "TE" instruction */
+    LITTON_TH_TG,               /**< "TG" instruction */
+    LITTON_TH_ILLEGAL_1,        /**< Illegal single-byte instruction */
+    LITTON_TH_BINARY_SHIFT,     /**< Binary shift instructions */
+    LITTON_TH_DECIMAL_SHIFT,    /**< Decimal shift instructions */
+    LITTON_TH_IO,               /**< I/O instructions */
+    LITTON_TH_CA,               /**< "CA" instruction */
+    LITTON_TH_AD,               /**< "AD" instruction */
+    LITTON_TH_ST,               /**< "ST" instruction */
+    LITTON_TH_JM,               /**< "JM" instruction */
+    LITTON_TH_AC,               /**< "AC" instruction */
+    LITTON_TH_JU,               /**< "JU" instruction */
+    LITTON_TH_JC,               /**< "JC" instruction */
+    LITTON_TH_ILLEGAL_2,        /**< Illegal double-byte instruction */
+    LITTON_TH_COUNT             /**< Number of handlers */
+
+} litton_threaded_handler_t;
+
+/**
+ * @brief Maps opcode names from litton_opcodes[] to handlers.
+ *
+ * The shift and I/O instructions are not listed here because they are
+ * handled as groups based on the high 4 bits of the command register.
+ */
+static struct {
+    const char *name;
+    uint8_t handler;
+} const litton_threaded_names[] = {
+    {"HH",      LITTON_TH_HH},
+    {"AK",      LITTON_TH_AK},
+    {"CL",      LITTON_TH_CL},
+    {"NN",      LITTON_TH_NN},
+    {"CM",      LITTON_TH_CM},
+    {"JA",      LITTON_TH_JA},
+    {"BI",      LITTON_TH_BI},
+    {"SK",      LITTON_TH_SK},
+    {"TZ",      LITTON_TH_TZ},
+    {"TH",      LITTON_TH_TH},
+    {"RK",      LITTON_TH_RK},
+    {"TP",      LITTON_TH_TP},
+    {"LA",      LITTON_TH_LA},
+    {"XC",      LITTON_TH_XC},
+    {"XT",      LITTON_TH_XT},
+    {"TE",      LITTON_TH_TE},
+    {"TG",      LITTON_TH_TG},
+    {"CA",      LITTON_TH_CA},
+    {"AD",      LITTON_TH_AD},
+    {"ST",      LITTON_TH_ST},
+    {"JM",      LITTON_TH_JM},
+    {"AC",      LITTON_TH_AC},
+    {"JU",      LITTON_TH_JU},
+    {"JC",      LITTON_TH_JC},
+    {0,         0}
+};
+
+/** Handler to use for each value of the command register */
+static uint8_t litton_threaded_table[256];
+
+/** Makes sure that litton_threaded_table is only initialized once,
+ *  even if several machines start running on different threads */
+static pthread_once_t litton_threaded_table_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Generates the handler table from litton_opcodes[].
+ */
+static void litton_threaded_init(void)
+{
+    const litton_opcode_info_t *info;
+    unsigned cr, first, last;
+    int index;
+
+    /* Populate the groups that are decoded further by the shift and I/O
+     * functions, and set everything else to be an illegal instruction. */
+    for (cr = 0; cr < 256; ++cr) {
+        if (cr < 0x40) {
+            litton_threaded_table[cr] = LITTON_TH_ILLEGAL_1;
+        } else if ((cr & 0xF0) == 0x40) {
+            litton_threaded_table[cr] = LITTON_TH_BINARY_SHIFT;
+        } else if ((cr & 0xF0) == 0x60) {
+            litton_threaded_table[cr] = LITTON_TH_DECIMAL_SHIFT;
+        } else if ((cr & 0xF0) == 0x50 || (cr & 0xF0) == 0x70) {
+            litton_threaded_table[cr] = LITTON_TH_IO;
+        } else {
+            litton_threaded_table[cr] = LITTON_TH_ILLEGAL_2;
+        }
+    }
+
+    /* Fill in the command register values for the other opcodes */
+    for (info = litton_opcodes; info->name; ++info) {
+        for (index = 0; litton_threaded_names[index].name; ++index) {
+            if (!strcmp(litton_threaded_names[index].name, info->name)) {
+                break;
+            }
+        }
+        if (!litton_threaded_names[index].name) {
+            continue;
+        }
+        if (info->opcode < 0x0100) {
+            /* Single-byte instruction */
+            first = info->opcode;
+            last = info->opcode | info->operand_mask;
+        } else {
+            /* Double-byte instruction; only the first byte is in CR */
+            first = info->opcode >> 8;
+            last = (info->opcode | info->operand_mask) >> 8;
+        }
+        for (cr = first; cr <= last; ++cr) {
+            litton_threaded_table[cr] = litton_threaded_names[index].handler;
+        }
+    }
+}
+
+/**
+ * @brief Rotates the CR/I register pair by 16 bits.
+ *
+ * @param[in,out] state The state of the computer.
+ */
+static LITTON_INLINE void litton_rotate_16(litton_state_t *state)
+{
+    litton_rotate_8(state);
+    litton_rotate_8(state);
+}
+
+/* Full 16-bit instruction word for a double-byte instruction */
+#define LITTON_INSN() ((uint16_t)((state->CR << 8) | (state->I >> 32)))
+
+/* Memory address operand for a double-byte instruction */
+#define LITTON_ADDR() (LITTON_INSN() & 0x0FFF)
+
+/* Scratchpad register operand for a single-byte instruction */
+#define LITTON_SCRATCHPAD() (state->CR & 0x07)
+
+#if LITTON_COMPUTED_GOTO
+#define LITTON_HANDLER(name) op_##name
+#define LITTON_DISPATCH() goto *handlers[litton_threaded_table[state->CR]]
+#else
+#define LITTON_HANDLER(name) case LITTON_TH_##name
+#define LITTON_DISPATCH() goto dispatch
+#endif
+
+/* Start the next instruction, with the same prologue as litton_step() */
+#define LITTON_BEGIN() \
+    do { \
+        if (state->spin_counter > LITTON_DRUM_MAX_SIZE) { \
+            reason = LITTON_RUN_SPINNING; \
+            goto done; \
+        } \
+        ++(state->spin_counter); \
+        state->jumped = 0; \
+        state->io_wait = 0; \
+        LITTON_DISPATCH(); \
+    } while (0)
+
+/* Finish the current instruction and start the next one if there is
+ * still some budget left */
+#define LITTON_NEXT() \
+    do { \
+        ++instructions; \
+        if (state->cycle_counter >= end_cycles || \
+                instructions >= max_instructions) { \
+            goto done; \
+        } \
+        LITTON_BEGIN(); \
+    } while (0)
+
+/* Finish a jump instruction, checking for breakpoints on the destination
+ * and delay loops that can be skipped in one step */
+#define LITTON_NEXT_JUMP() \
+    do { \
+        if (state->breakpoints && litton_is_breakpoint(state, state->PC)) { \
+            ++instructions; \
+            reason = LITTON_RUN_BREAKPOINT; \
+            goto done; \
+        } \
+        if (litton_is_delay_loop(state)) { \
+            ++instructions; \
+            goto delay_loop; \
+        } \
+        LITTON_NEXT(); \
+    } while (0)
+
+/* Finish an I/O instruction, checking for the program waiting on a device
+ * or being idle, and for events that the instruction has scheduled */
+#define LITTON_NEXT_IO() \
+    do { \
+        end_cycles = litton_limit_to_events(state, end_cycles); \
+        if (state->io_wait) { \
+            if (state->stop_on_io_wait) { \
+                ++instructions; \
+                reason = LITTON_RUN_IO_WAIT; \
+                goto done; \
+            } \
+            if (state->idle && state->stop_on_idle) { \
+                ++instructions; \
+                reason = LITTON_RUN_IDLE; \
+                goto done; \
+            } \
+        } \
+        LITTON_NEXT(); \
+    } while (0)
+
+litton_run_reason_t litton_run_threaded
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result)
+{
+    litton_run_reason_t reason = LITTON_RUN_BUDGET;
+    uint64_t start_cycles = state->cycle_counter;
+    uint64_t end_cycles;
+    uint64_t instructions = 0;
+    litton_drum_loc_t addr;
+    litton_word_t temp;
+#if LITTON_COMPUTED_GOTO
+    static void * const handlers[LITTON_TH_COUNT] = {
+        &&op_HH, &&op_AK, &&op_CL, &&op_NN, &&op_CM, &&op_JA, &&op_BI,
+        &&op_SK, &&op_TZ, &&op_TH, &&op_RK, &&op_TP, &&op_LA, &&op_XC,
+        &&op_XT, &&op_TE, &&op_TG, &&op_ILLEGAL_1, &&op_BINARY_SHIFT,
+        &&op_DECIMAL_SHIFT, &&op_IO, &&op_CA, &&op_AD, &&op_ST, &&op_JM,
+        &&op_AC, &&op_JU, &&op_JC, &&op_ILLEGAL_2
+    };
+#endif
+
+    /* The reference interpreter knows how to disassemble as it goes */
+    if (state->disassemble) {
+        return litton_run_with
+            (state, max_cycles, max_instructions, result, litton_step);
+    }
+
+    /* Generate the handler table the first time that any machine gets
+     * here.  The handler addresses are constant, so the computed goto
+     * version looks them up through the table on every dispatch rather
+     * than keeping a second table that would also need initializing. */
+    pthread_once(&litton_threaded_table_once, litton_threaded_init);
+
+    /* Convert the budgets into limits that can be checked quickly */
+    if (max_cycles && max_cycles <= (UINT64_MAX - start_cycles)) {
+        end_cycles = start_cycles + max_cycles;
+    } else {
+        end_cycles = UINT64_MAX;
+    }
+    end_cycles = litton_limit_to_events(state, end_cycles);
+    if (!max_instructions) {
+        max_instructions = UINT64_MAX;
+    }
+
+    /* Dispatch the first instruction */
+    LITTON_BEGIN();
+
+#if !LITTON_COMPUTED_GOTO
+dispatch:
+    switch (litton_threaded_table[state->CR]) {
+#endif
+
+    LITTON_HANDLER(HH):
+        /* If the front panel is in halt mode, then halt instructions
+         * turn into no-ops to allow single-stepping. */
+        if ((state->status_lights & LITTON_STATUS_HALT) != 0) {
+            litton_add_opcode_timing(state, 1);
+            litton_rotate_8(state);
+            LITTON_NEXT();
+        }
+        state->halt_code = state->CR & 0x07;
+        state->status_lights &= ~LITTON_STATUS_RUN;
+        state->status_lights |= LITTON_STATUS_HALT_CODE;
+        state->status_lights |= LITTON_STATUS_HALT;
+        litton_rotate_8(state);
+        ++instructions;
+        reason = LITTON_RUN_HALT;
+        goto done;
+
+    LITTON_HANDLER(AK):
+        litton_add_opcode_timing(state, 3);
+        state->A += state->K;
+        if (state->A > LITTON_WORD_MASK) {
+            state->A = 0;
+            state->K = 1;
+        } else {
+            state->K = 0;
+        }
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(CL):
+        litton_add_opcode_timing(state, 3);
+        state->A = 0;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(NN):
+        litton_add_opcode_timing(state, 1);
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(CM):
+        litton_add_opcode_timing(state, 3);
+        state->A = (-state->A) & LITTON_WORD_MASK;
+        state->K = (state->A != 0);
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(JA):
+        litton_add_opcode_timing(state, 3);
+        state->I = state->A;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(BI):
+        litton_add_opcode_timing(state, 10);
+        for (addr = 0; addr < LITTON_DRUM_RESERVED_SECTORS; ++addr) {
+            litton_add_memory_timing(state, addr);
+            temp = litton_get_scratchpad(state, addr);
+            litton_set_scratchpad
+                (state, addr, state->block_interchange_loop[addr]);
+            state->block_interchange_loop[addr] = temp;
+        }
+        state->K = 1;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(SK):
+        litton_add_opcode_timing(state, 3);
+        state->K = 1;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(TZ):
+        litton_add_opcode_timing(state, 3);
+        state->K = (state->A == 0);
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(TH):
+        litton_add_opcode_timing(state, 3);
+        state->K = ((state->A & LITTON_WORD_MSB) != 0);
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(RK):
+        litton_add_opcode_timing(state, 3);
+        state->K = 0;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(TP):
+        litton_add_opcode_timing(state, 3);
+        state->K = state->P;
+        state->P = 0;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(LA):
+        addr = LITTON_SCRATCHPAD();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 3);
+        state->A &= litton_drum_word(state, addr);
+        state->K = (state->A == 0);
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(XC):
+        addr = LITTON_SCRATCHPAD();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 3);
+        temp = litton_drum_word(state, addr);
+        litton_write_drum(state, addr, state->A);
+        state->A = temp;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(XT):
+        addr = LITTON_SCRATCHPAD();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 3);
+        temp = litton_drum_word(state, addr);
+        litton_write_drum(state, addr, temp & ~(state->A));
+        state->A &= temp;
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(TE):
+        addr = LITTON_SCRATCHPAD();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 3);
+        state->K = (state->A == litton_drum_word(state, addr));
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(TG):
+        addr = LITTON_SCRATCHPAD();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 3);
+        state->K = (state->A >= litton_drum_word(state, addr));
+        litton_rotate_8(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(ILLEGAL_1):
+        litton_add_opcode_timing(state, 1);
+        litton_rotate_8(state);
+        goto illegal;
+
+    LITTON_HANDLER(BINARY_SHIFT):
+        if (litton_binary_shift(state, LITTON_INSN()) != LITTON_STEP_OK) {
+            litton_rotate_16(state);
+            goto illegal;
+        }
+        litton_rotate_16(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(DECIMAL_SHIFT):
+        if (litton_decimal_shift(state, LITTON_INSN()) != LITTON_STEP_OK) {
+            litton_rotate_16(state);
+            goto illegal;
+        }
+        litton_rotate_16(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(IO):
+        if (litton_perform_io(state, LITTON_INSN()) != LITTON_STEP_OK) {
+            litton_rotate_16(state);
+            goto illegal;
+        }
+        litton_rotate_16(state);
+        LITTON_NEXT_IO();
+
+    LITTON_HANDLER(CA):
+        addr = LITTON_ADDR();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 4);
+        state->A = litton_drum_word(state, addr);
+        litton_rotate_16(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(AD):
+        addr = LITTON_ADDR();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 4);
+        state->A += litton_drum_word(state, addr);
+        state->K = (state->A > LITTON_WORD_MASK);
+        state->A &= LITTON_WORD_MASK;
+        litton_rotate_16(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(ST):
+        addr = LITTON_ADDR();
+        litton_add_opcode_timing(state, 4);
+        litton_add_memory_timing(state, addr);
+        litton_write_drum(state, addr, state->A);
+        litton_rotate_16(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(JM):
+        addr = LITTON_ADDR();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 4);
+        state->CR = 0xE0 | (state->CR & 0x0F);
+        state->A = state->I & LITTON_WORD_MASK;
+        state->I = litton_drum_word(state, addr);
+        state->PC = addr;
+        state->spin_counter = 0;
+        state->jumped = 1;
+        litton_rotate_16(state);
+        LITTON_NEXT_JUMP();
+
+    LITTON_HANDLER(AC):
+        if (state->K) {
+            addr = LITTON_ADDR();
+            litton_add_memory_timing(state, addr);
+            litton_add_opcode_timing(state, 4);
+            state->A += litton_drum_word(state, addr);
+            state->K = (state->A > LITTON_WORD_MASK);
+            state->A &= LITTON_WORD_MASK;
+        } else {
+            litton_add_opcode_timing(state, 3);
+        }
+        litton_rotate_16(state);
+        LITTON_NEXT();
+
+    LITTON_HANDLER(JU):
+        addr = LITTON_ADDR();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 4);
+        state->I = litton_drum_word(state, addr);
+        state->PC = addr;
+        state->spin_counter = 0;
+        state->jumped = 1;
+        litton_rotate_16(state);
+        LITTON_NEXT_JUMP();
+
+    LITTON_HANDLER(JC):
+        if (!(state->K)) {
+            litton_add_opcode_timing(state, 3);
+            litton_rotate_16(state);
+            LITTON_NEXT();
+        }
+        addr = LITTON_ADDR();
+        litton_add_memory_timing(state, addr);
+        litton_add_opcode_timing(state, 4);
+        state->I = litton_drum_word(state, addr);
+        state->PC = addr;
+        state->spin_counter = 0;
+        state->jumped = 1;
+        state->CR = 0xE0 | (state->CR & 0x0F);
+        litton_rotate_16(state);
+        LITTON_NEXT_JUMP();
+
+    LITTON_HANDLER(ILLEGAL_2):
+        litton_add_opcode_timing(state, 1);
+        litton_rotate_16(state);
+        goto illegal;
+
+#if !LITTON_COMPUTED_GOTO
+    default:
+        /* Not reachable; every table entry has a handler */
+        goto illegal;
+    }
+#endif
+
+delay_loop:
+    /* Skip over the delay loop that the last jump landed on */
+    if (state->cycle_counter < end_cycles && instructions < max_instructions) {
+        instructions += litton_skip_delay_loop
+            (state, max_instructions - instructions, end_cycles);
+    }
+    if (state->cycle_counter >= end_cycles ||
+            instructions >= max_instructions) {
+        goto done;
+    }
+    LITTON_BEGIN();
+
+illegal:
+    /* Illegal instructions are executed like a no-op and then stop */
+    ++instructions;
+    reason = LITTON_RUN_ILLEGAL;
+
+done:
+    if (result) {
+        result->reason = reason;
+        result->cycles = state->cycle_counter - start_cycles;
+        result->instructions = instructions;
+    }
+    return reason;
+}
+
+#endif /* !LITTON_SMALL_MEMORY */
@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "litton/litton.h"
+#include "litton-internal.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#if !LITTON_SMALL_MEMORY
+
+/*
+ * The trace engine stitches chains of drum words together into traces
+ * that can be executed as a unit.
+ *
+ * Every instruction word contains the partial address of the next word
+ * (see doc/precession.md), so control flow is fully static until we
+ * reach a conditional instruction, "JA", or an I/O instruction.  Once the
+ * rotation predictor is known at the start of a trace, the timing of every
+ * instruction in the trace is also static.  So a trace only needs to
+ * perform the data operations of each instruction; the contents of CR and
+ * I, the cycle counter, and the other bookkeeping are restored from values
+ * that were recorded ahead of time when the trace exits.
+ *
+ * Traces are recorded by running the reference interpreter, starting at
+ * any state that doesn't already have a trace.  Recording stops at an
+ * instruction whose timing or control flow depends upon something other
+ * than K, at a store to one of the words in the trace (self-modifying
+ * code), or when the trace becomes too long.
+ *
+ * Conditional instructions ("JC" and "AC") are recorded with the value of
+ * K that was seen when the trace was recorded.  If K is different when
+ * the trace is replayed, then the trace exits early and the reference
+ * interpreter takes over for that instruction.
+ *
+ * Each drum word has a version number that is incremented whenever the
+ * word is modified.  Traces remember the versions of the words that they
+ * were recorded from, and are discarded if any of those words change.
+ * Words that keep changing after being recorded are marked as volatile and
+ * are executed by the reference interpreter from then on, so that programs
+ * that modify their own instructions don't keep recording new traces.
+ */
+
+litton_trace_cache_t *litton_trace_cache_create(void)
+{
+    litton_trace_cache_t *cache = calloc(1, sizeof(litton_trace_cache_t));
+    if (!cache) {
+        return 0;
+    }
+    cache->recording = malloc
+        (offsetof(litton_trace_t, ops) +
+         (LITTON_TRACE_MAX_OPS + 1) * sizeof(litton_trace_op_t));
+    if (!(cache->recording)) {
+        free(cache);
+        return 0;
+    }
+    return cache;
+}
+
+void litton_trace_cache_free(litton_trace_cache_t *cache)
+{
+    unsigned index;
+    for (index = 0; index < LITTON_TRACE_CACHE_SIZE; ++index) {
+        if (cache->traces[index]) {
+            free(cache->traces[index]);
+        }
+    }
+#if LITTON_JIT_SUPPORTED
+    if (cache->jit) {
+        litton_jit_free(cache->jit);
+    }
+#endif
+    free(cache->recording);
+    free(cache);
+}
+
+/**
+ * @brief Gets the contents of CR and I as a 48-bit value.
+ *
+ * @param[in] state The state of the computer.
+ *
+ * @return The 48-bit value.
+ */
+static inline uint64_t litton_trace_get_cri(const litton_state_t *state)
+{
+    return (((uint64_t)(state->CR)) << LITTON_WORD_BITS) | state->I;
+}
+
+/**
+ * @brief Gets the slot in the trace cache for the current state.
+ *
+ * @param[in] state The state of the computer.
+ * @param[in] cri The current contents of CR and I.
+ *
+ * @return Index of the slot in the trace cache.
+ */
+static inline unsigned litton_trace_slot
+    (const litton_state_t *state, uint64_t cri)
+{
+    uint64_t hash = cri ^ (cri >> 21) ^ (cri >> 37);
+    hash ^= ((uint64_t)(state->PC)) * 0x9E37U;
+    hash ^= ((uint64_t)(state->rotation_predictor)) << 5;
+    return (unsigned)(hash & (LITTON_TRACE_CACHE_SIZE - 1));
+}
+
+/**
+ * @brief Notes that a drum word was modified after it was recorded.
+ *
+ * @param[in,out] cache The trace cache.
+ * @param[in] addr The drum address that was modified.
+ */
+static void litton_trace_mark_volatile
+    (litton_trace_cache_t *cache, litton_drum_loc_t addr)
+{
+    if (cache->volatile_words[addr] < LITTON_TRACE_VOLATILE_LIMIT) {
+        ++(cache->volatile_words[addr]);
+    }
+}
+
+/**
+ * @brief Determine if a drum word should be left out of traces.
+ *
+ * @param[in] cache The trace cache.
+ * @param[in] addr The drum address to check.
+ *
+ * @return Non-zero if the word at @a addr is volatile.
+ */
+#define litton_trace_is_volatile(cache, addr) \
+    ((cache)->volatile_words[(addr)] >= LITTON_TRACE_VOLATILE_LIMIT)
+
+/**
+ * @brief Finds the trace that starts at the current state.
+ *
+ * @param[in] state The state of the computer.
+ *
+ * @return The trace, or NULL if there is no valid trace for the state.
+ */
+static inline litton_trace_t *litton_trace_find
+    (const litton_state_t *state)
+{
+    litton_trace_cache_t *cache = state->trace_cache;
+    uint64_t cri = litton_trace_get_cri(state);
+    litton_trace_t *trace = cache->traces[litton_trace_slot(state, cri)];
+    unsigned index;
+    if (!trace || trace->ops[0].cri != cri ||
+            trace->entry_pc != state->PC ||
+            trace->entry_predictor != state->rotation_predictor) {
+        return 0;
+    }
+    for (index = 0; index < trace->num_words; ++index) {
+        if (cache->versions[trace->words[index]] != trace->versions[index]) {
+            litton_trace_mark_volatile(cache, trace->words[index]);
+            return 0;
+        }
+    }
+    return trace;
+}
+
+/**
+ * @brief Determine how an instruction should be recorded in a trace.
+ *
+ * @param[in] state The state of the computer.
+ *
+ * @return The handler, or LITTON_TRACE_OP_END if the instruction
+ * cannot be part of a trace.
+ */
+static uint8_t litton_trace_classify(const litton_state_t *state)
+{
+    uint8_t CR = state->CR;
+    if (CR < 0x40) {
+        switch (CR) {
+        case LOP_AK:    return LITTON_TRACE_OP_AK;
+        case LOP_CL:    return LITTON_TRACE_OP_CL;
+        case LOP_NN:    return LITTON_TRACE_OP_NN;
+        case LOP_CM:    return LITTON_TRACE_OP_CM;
+        case LOP_SK:    return LITTON_TRACE_OP_SK;
+        case LOP_TZ:    return LITTON_TRACE_OP_TZ;
+        case LOP_TH:    return LITTON_TRACE_OP_TH;
+        case LOP_RK:    return LITTON_TRACE_OP_RK;
+        case LOP_TP:    return LITTON_TRACE_OP_TP;
+        default:        break;
+        }
+        switch (CR & 0xF8) {
+        case LOP_LA:    return LITTON_TRACE_OP_LA;
+        case LOP_XC:    return LITTON_TRACE_OP_XC;
+        case LOP_XT:    return LITTON_TRACE_OP_XT;
+        case LOP_TE:    return LITTON_TRACE_OP_TE;
+        case LOP_TG:    return LITTON_TRACE_OP_TG;
+        default:        break;
+        }
+
+        /* "HH", "JA", "BI", and illegal instructions end the trace */
+        return LITTON_TRACE_OP_END;
+    }
+    switch (CR & 0xF0) {
+    case 0x40:  return LITTON_TRACE_OP_BINARY_SHIFT;
+    case 0x60:  return LITTON_TRACE_OP_DECIMAL_SHIFT;
+    case 0x80:  return LITTON_TRACE_OP_CA;
+    case 0x90:  return LITTON_TRACE_OP_AD;
+    case 0xB0:  return LITTON_TRACE_OP_ST;
+    case 0xC0:  return LITTON_TRACE_OP_JM;
+    case 0xD0:
+        return state->K ? LITTON_TRACE_OP_AC_ADD : LITTON_TRACE_OP_AC_SKIP;
+    case 0xE0:  return LITTON_TRACE_OP_JU;
+    case 0xF0:
+        return state->K ? LITTON_TRACE_OP_JC_TAKEN
+                        : LITTON_TRACE_OP_JC_NOT_TAKEN;
+    default:    break;
+    }
+
+    /* I/O and illegal instructions end the trace */
+    return LITTON_TRACE_OP_END;
+}
+
+/**
+ * @brief Determine if an address is in a list of addresses.
+ *
+ * @param[in] list The list of addresses.
+ * @param[in] size The size of the list.
+ * @param[in] addr The address to look for.
+ *
+ * @return Non-zero if @a addr is in the list.
+ */
+static int litton_trace_contains
+    (const litton_drum_loc_t *list, unsigned size, litton_drum_loc_t addr)
+{
+    while (size > 0) {
+        if (*list++ == addr) {
+            return 1;
+        }
+        --size;
+    }
+    return 0;
+}
+
+/**
+ * @brief Records a new trace starting at the current state.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] max_instructions Maximum number of instructions to execute.
+ * @param[in] end_cycles Stop once the cycle counter reaches this value.
+ * @param[out] step Returns the result of the last instruction executed.
+ *
+ * @return The number of instructions that were executed.
+ *
+ * Instructions are executed with the reference interpreter as they are
+ * recorded.  Recording stops just before the first instruction that
+ * cannot be part of a trace.
+ */
+static uint64_t litton_trace_record
+    (litton_state_t *state, uint64_t max_instructions, uint64_t end_cycles,
+     litton_step_result_t *step)
+{
+    litton_trace_cache_t *cache = state->trace_cache;
+    litton_trace_t *trace = cache->recording;
+    litton_trace_t **slot;
+    litton_trace_op_t *op;
+    uint64_t start_cycles = state->cycle_counter;
+    litton_drum_loc_t last_address = LITTON_TRACE_NO_ADDRESS;
+    litton_drum_loc_t saved_address;
+    litton_drum_loc_t addr;
+    uint16_t spin = LITTON_TRACE_NO_SPIN;
+    unsigned num_written = 0;
+    unsigned count = 0;
+    uint64_t executed = 0;
+    uint8_t handler;
+    int is_jump;
+    int stop = 0;
+
+    *step = LITTON_STEP_OK;
+    if (state->PC < LITTON_DRUM_RESERVED_SECTORS) {
+        /* Don't try to record code that is running from the scratchpad */
+        return 0;
+    }
+    trace->entry_pc = state->PC;
+    trace->entry_predictor = state->rotation_predictor;
+    trace->num_words = 0;
+    slot = &(cache->traces[litton_trace_slot(state, litton_trace_get_cri(state))]);
+
+    while (!stop && count < LITTON_TRACE_MAX_OPS && executed < max_instructions) {
+        /* Leave spinning programs to the reference interpreter */
+        if (state->spin_counter > LITTON_DRUM_MAX_SIZE) {
+            break;
+        }
+
+        /* Can this instruction be part of the trace? */
+        handler = litton_trace_classify(state);
+        if (handler == LITTON_TRACE_OP_END) {
+            break;
+        }
+        addr = (litton_drum_loc_t)
+            (((state->CR << 8) | (state->I >> 32)) & 0x0FFF);
+        is_jump = (handler == LITTON_TRACE_OP_JM ||
+                   handler == LITTON_TRACE_OP_JU ||
+                   handler == LITTON_TRACE_OP_JC_TAKEN);
+        if (is_jump) {
+            /* Stop if we are jumping into the scratchpad loop, into a
+             * volatile word, or into a word that was modified earlier
+             * in the trace */
+            if (addr < LITTON_DRUM_RESERVED_SECTORS ||
+                    litton_trace_is_volatile(cache, addr) ||
+                    litton_trace_contains(cache->written, num_written, addr)) {
+                break;
+            }
+            if (!litton_trace_contains(trace->words, trace->num_words, addr) &&
+                    trace->num_words >= LITTON_TRACE_MAX_WORDS) {
+                break;
+            }
+        }
+
+        /* Record the state of the machine before the instruction */
+        op = &(trace->ops[count]);
+        op->cri = litton_trace_get_cri(state);
+        op->cycles = (uint32_t)(state->cycle_counter - start_cycles);
+        if (handler == LITTON_TRACE_OP_BINARY_SHIFT ||
+                handler == LITTON_TRACE_OP_DECIMAL_SHIFT) {
+            op->operand = (uint16_t)((state->CR << 8) | (state->I >> 32));
+        } else if (state->CR < 0x40) {
+            op->operand = state->CR & 0x07;
+        } else {
+            op->operand = addr;
+        }
+        op->pc = state->PC;
+        op->last_address = last_address;
+        op->spin = spin;
+        op->handler = handler;
+        op->predictor = state->rotation_predictor;
+        op->jumped = state->jumped;
+
+        /* Execute the instruction and find out if it accessed memory */
+        saved_address = state->last_address;
+        state->last_address = LITTON_TRACE_NO_ADDRESS;
+        *step = litton_step(state);
+        ++executed;
+        if (state->last_address == LITTON_TRACE_NO_ADDRESS) {
+            state->last_address = saved_address;
+        } else {
+            last_address = state->last_address;
+        }
+        if (*step != LITTON_STEP_OK) {
+            /* Leave the failed instruction out of the trace */
+            break;
+        }
+        ++count;
+
+        /* Track the words that the trace jumps to and writes to */
+        if (is_jump) {
+            spin = (uint16_t)(state->spin_counter);
+            if (!litton_trace_contains(trace->words, trace->num_words, addr)) {
+                trace->words[trace->num_words] = addr;
+                trace->versions[trace->num_words] = cache->versions[addr];
+                ++(trace->num_words);
+            }
+        } else if (spin != LITTON_TRACE_NO_SPIN) {
+            spin = (uint16_t)(state->spin_counter);
+        }
+        if (handler == LITTON_TRACE_OP_ST) {
+            cache->written[num_written++] = addr;
+            if (litton_trace_contains(trace->words, trace->num_words, addr)) {
+                /* Self-modifying code, so stop here and discard the trace */
+                litton_trace_mark_volatile(cache, addr);
+                stop = 1;
+            }
+        }
+
+        /* Stop if we have run out of cycles */
+        if (state->cycle_counter >= end_cycles) {
+            break;
+        }
+    }
+
+    /* Record the state at the end of the trace.  If the last instruction
+     * failed, then its entry already describes the state before it. */
+    op = &(trace->ops[count]);
+    if (*step == LITTON_STEP_OK) {
+        op->cri = litton_trace_get_cri(state);
+        op->cycles = (uint32_t)(state->cycle_counter - start_cycles);
+        op->operand = 0;
+        op->pc = state->PC;
+        op->last_address = last_address;
+        op->spin = spin;
+        op->predictor = state->rotation_predictor;
+        op->jumped = state->jumped;
+    }
+    op->handler = LITTON_TRACE_OP_END;
+    trace->count = count;
+#if LITTON_JIT_SUPPORTED
+    trace->replays = 0;
+    trace->native = 0;
+#endif
+
+    /* Save a copy of the trace in the cache */
+    if (count > 0 && !stop) {
+        size_t size = offsetof(litton_trace_t, ops) +
+                      (count + 1) * sizeof(litton_trace_op_t);
+        litton_trace_t *copy = malloc(size);
+        if (copy) {
+            memcpy(copy, trace, size);
+            if (*slot) {
+                free(*slot);
+            }
+            *slot = copy;
+        }
+    }
+    return executed;
+}
+
+/**
+ * @brief Replays a recorded trace.
+ *
+ * @param[in,out] state The state of the computer.
+ * @param[in] trace The trace to replay.
+ * @param[in] max_instructions Maximum number of instructions to execute.
+ * @param[in] end_cycles Stop once the cycle counter reaches this value.
+ *
+ * @return The number of instructions that were executed.  This will be
+ * less than the length of the trace if it exited early.
+ *
+ * If the "jit" engine is selected, then traces that are replayed often
+ * are compiled into native code.  The native code is used whenever the
+ * entire trace fits within the budgets, which is almost always the case.
+ */
+static uint64_t litton_trace_replay
+    (litton_state_t *state, litton_trace_t *trace,
+     uint64_t max_instructions, uint64_t end_cycles)
+{
+    const litton_trace_op_t *op = trace->ops;
+    uint64_t start_cycles = state->cycle_counter;
+    uint64_t limit = end_cycles - start_cycles;
+    litton_drum_loc_t last_address = state->last_address;
+    unsigned count = trace->count;
+    unsigned index = 0;
+    litton_word_t temp;
+
+    /* Let the reference interpreter deal with spinning programs */
+    if ((state->spin_counter + count) > LITTON_DRUM_MAX_SIZE) {
+        return 0;
+    }
+
+#if LITTON_JIT_SUPPORTED
+    /* Run the native code for the trace if we have it */
+    if (trace->native) {
+        if (count <= max_instructions && trace->ops[count].cycles < limit) {
+            index = trace->native(state);
+            op += index;
+            goto exit;
+        }
+    } else if (state->engine == LITTON_ENGINE_JIT) {
+        if (trace->replays < LITTON_JIT_THRESHOLD) {
+            ++(trace->replays);
+        } else {
+            litton_jit_compile(state->trace_cache, trace);
+        }
+    }
+#endif
+
+    if (count > max_instructions) {
+        count = (unsigned)max_instructions;
+    }
+
+    /* Perform the data operations for the instructions in the trace */
+    while (index < count) {
+        switch (op->handler) {
+        case LITTON_TRACE_OP_AK:
+            state->A += state->K;
+            if (state->A > LITTON_WORD_MASK) {
+                state->A = 0;
+                state->K = 1;
+            } else {
+                state->K = 0;
+            }
+            break;
+
+        case LITTON_TRACE_OP_CL:
+            state->A = 0;
+            break;
+
+        case LITTON_TRACE_OP_CM:
+            state->A = (-state->A) & LITTON_WORD_MASK;
+            state->K = (state->A != 0);
+            break;
+
+        case LITTON_TRACE_OP_SK:
+            state->K = 1;
+            break;
+
+        case LITTON_TRACE_OP_TZ:
+            state->K = (state->A == 0);
+            break;
+
+        case LITTON_TRACE_OP_TH:
+            state->K = ((state->A & LITTON_WORD_MSB) != 0);
+            break;
+
+        case LITTON_TRACE_OP_RK:
+            state->K = 0;
+            break;
+
+        case LITTON_TRACE_OP_TP:
+            state->K = state->P;
+            state->P = 0;
+            break;
+
+        case LITTON_TRACE_OP_LA:
+            state->A &= litton_drum_word(state, op->operand);
+            state->K = (state->A == 0);
+            break;
+
+        case LITTON_TRACE_OP_XC:
+            temp = litton_drum_word(state, op->operand);
+            litton_write_drum(state, op->operand, state->A);
+            state->A = temp;
+            break;
+
+        case LITTON_TRACE_OP_XT:
+            temp = litton_drum_word(state, op->operand);
+            litton_write_drum(state, op->operand, temp & ~(state->A));
+            state->A &= temp;
+            break;
+
+        case LITTON_TRACE_OP_TE:
+            state->K = (state->A == litton_drum_word(state, op->operand));
+            break;
+
+        case LITTON_TRACE_OP_TG:
+            state->K = (state->A >= litton_drum_word(state, op->operand));
+            break;
+
+        case LITTON_TRACE_OP_BINARY_SHIFT:
+            /* The timing that this adds is replaced when the trace exits */
+            litton_binary_shift(state, op->operand);
+            break;
+
+        case LITTON_TRACE_OP_DECIMAL_SHIFT:
+            litton_decimal_shift(state, op->operand);
+            break;
+
+        case LITTON_TRACE_OP_CA:
+            state->A = litton_drum_word(state, op->operand);
+            break;
+
+        case LITTON_TRACE_OP_AD:
+            state->A += litton_drum_word(state, op->operand);
+            state->K = (state->A > LITTON_WORD_MASK);
+            state->A &= LITTON_WORD_MASK;
+            break;
+
+        case LITTON_TRACE_OP_ST:
+            litton_write_drum(state, op->operand, state->A);
+            break;
+
+        case LITTON_TRACE_OP_JM:
+            /* Save the return point in A, which is the rest of I */
+            state->A = op->cri & LITTON_WORD_MASK;
+            break;
+
+        case LITTON_TRACE_OP_AC_ADD:
+            if (!(state->K)) {
+                goto exit;
+            }
+            state->A += litton_drum_word(state, op->operand);
+            state->K = (state->A > LITTON_WORD_MASK);
+            state->A &= LITTON_WORD_MASK;
+            break;
+
+        case LITTON_TRACE_OP_AC_SKIP:
+        case LITTON_TRACE_OP_JC_NOT_TAKEN:
+            if (state->K) {
+                goto exit;
+            }
+            break;
+
+        case LITTON_TRACE_OP_JC_TAKEN:
+            if (!(state->K)) {
+                goto exit;
+            }
+            break;
+
+        default:
+            /* "NN" and "JU" have no effect on the data */
+            break;
+        }
+        ++index;
+        ++op;
+        if (op->cycles >= limit) {
+            break;
+        }
+    }
+
+exit:
+    /* Restore the rest of the state from the recorded values */
+    if (index > 0) {
+        state->CR = (uint8_t)(op->cri >> LITTON_WORD_BITS);
+        state->I = op->cri & LITTON_WORD_MASK;
+        state->cycle_counter = start_cycles + op->cycles;
+        state->rotation_predictor = op->predictor;
+        state->PC = op->pc;
+        if (op->last_address != LITTON_TRACE_NO_ADDRESS) {
+            state->last_address = op->last_address;
+        } else {
+            state->last_address = last_address;
+        }
+        if (op->spin != LITTON_TRACE_NO_SPIN) {
+            state->spin_counter = op->spin;
+        } else {
+            state->spin_counter += index;
+        }
+        state->jumped = op->jumped;
+        state->io_wait = 0;
+    }
+    return index;
+}
+
+litton_run_reason_t litton_run_trace
+    (litton_state_t *state, uint64_t max_cycles, uint64_t max_instructions,
+     litton_run_result_t *result)
+{
+    litton_run_reason_t reason = LITTON_RUN_BUDGET;
+    uint64_t start_cycles = state->cycle_counter;
+    uint64_t end_cycles;
+    uint64_t instructions = 0;
+    litton_trace_t *trace;
+    litton_step_result_t step;
+    uint64_t count;
+
+    /* Convert the budgets into limits that can be checked quickly */
+    if (max_cycles && max_cycles <= (UINT64_MAX - start_cycles)) {
+        end_cycles = start_cycles + max_cycles;
+    } else {
+        end_cycles = UINT64_MAX;
+    }
+    end_cycles = litton_limit_to_events(state, end_cycles);
+    if (!max_instructions) {
+        max_instructions = UINT64_MAX;
+    }
+
+    for (;;) {
+        /* Skip over delay loops in one step */
+        if (state->jumped && litton_is_delay_loop(state)) {
+            instructions += litton_skip_delay_loop
+                (state, max_instructions - instructions, end_cycles);
+            if (instructions >= max_instructions ||
+                    state->cycle_counter >= end_cycles) {
+                break;
+            }
+        }
+
+        /* Replay or record a trace from the current state.  Breakpoints
+         * and volatile words are handled by the reference interpreter. */
+        if (!(state->breakpoints) &&
+                !litton_trace_is_volatile(state->trace_cache, state->PC)) {
+            trace = litton_trace_find(state);
+            if (trace) {
+                count = litton_trace_replay
+                    (state, trace, max_instructions - instructions,
+                     end_cycles);
+                instructions += count;
+                if (instructions >= max_instructions ||
+                        state->cycle_counter >= end_cycles) {
+                    break;
+                }
+                if (count == trace->count) {
+                    continue;
+                }
+            } else {
+                count = litton_trace_record
+                    (state, max_instructions - instructions, end_cycles,
+                     &step);
+                instructions += count;
+                if (step != LITTON_STEP_OK) {
+                    reason = LITTON_RUN_ILLEGAL;
+                    break;
+                }
+                if (instructions >= max_instructions ||
+                        state->cycle_counter >= end_cycles) {
+                    break;
+                }
+                if (count > 0) {
+                    continue;
+                }
+            }
+        }
+
+        /* Execute the next instruction with the reference interpreter */
+        step = litton_step(state);
+        if (step != LITTON_STEP_OK) {
+            if (step == LITTON_STEP_HALT) {
+                reason = LITTON_RUN_HALT;
+                ++instructions;
+            } else if (step == LITTON_STEP_ILLEGAL) {
+                reason = LITTON_RUN_ILLEGAL;
+                ++instructions;
+            } else {
+                reason = LITTON_RUN_SPINNING;
+            }
+            break;
+        }
+        ++instructions;
+        end_cycles = litton_limit_to_events(state, end_cycles);
+        if (state->io_wait) {
+            if (state->stop_on_io_wait) {
+                reason = LITTON_RUN_IO_WAIT;
+                break;
+            }
+            if (state->idle && state->stop_on_idle) {
+                reason = LITTON_RUN_IDLE;
+                break;
+            }
+        }
+        if (state->jumped && state->breakpoints &&
+                litton_is_breakpoint(state, state->PC)) {
+            reason = LITTON_RUN_BREAKPOINT;
+            break;
+        }
+        if (instructions >= max_instructions ||
+                state->cycle_counter >= end_cycles) {
+            break;
+        }
+    }
+    if (result) {
+        result->reason = reason;
+        result->cycles = state->cycle_counter - start_cycles;
+        result->instructions = instructions;
+    }
+    return reason;
+}
+
+#endif /* !LITTON_SMALL_MEMORY */
@@ -29,11 +29,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
-#include <time.h>
 #include <unistd.h>
 #include "images.h"
 #include "core/litton-opus.h"
 
+/** Default number of lines to keep in the printer scroll-back history */
+#define PRINTER_HISTORY_LINES 10000
+
 static void usage(const char *progname)
 {
     fprintf(stderr, "Usage: %s [options] [image.drum]\n\n", progname);
@@ -42,16 +44,66 @@ static void usage(const char *progname)
     fprintf(stderr, "        Start in maximised mode.\n");
     fprintf(stderr, "    -v\n");
     fprintf(stderr, "        Verbose disassembly of instructions as they are executed.\n");
+    fprintf(stderr, "    -r SPEED\n");
+    fprintf(stderr, "        Run at a multiple of the original speed; e.g. 1x, 2x, 10x,\n");
+    fprintf(stderr, "        or unlimited.  The default is 1x.\n");
+    fprintf(stderr, "    -H LINES\n");
+    fprintf(stderr, "        Number of lines of printer output to keep for scrolling back\n");
+    fprintf(stderr, "        and saving to a file.  The default is %d.\n",
+            PRINTER_HISTORY_LINES);
+    fprintf(stderr, "    -I [DEVICE=]TIMING\n");
+    fprintf(stderr, "        Set the I/O timing for all devices, or for DEVICE: realistic,\n");
+    fprintf(stderr, "        instant, NNNcps, or NNNbaud.  May be given more than once.\n");
+    fprintf(stderr, "    -F FACE\n");
+    fprintf(stderr, "        Face of the printer font: regular or bold.  The default is bold.\n");
 }
 
-/** Maximum number of lines to keep in the printer scroll-back buffer */
+/** Maximum number of -I options on the command-line */
+#define MAX_IO_TIMINGS 16
+
+/** Number of lines of printer output that are visible on the paper */
 #define PRINTER_MAX_LINES 17
 
+/** Number of lines to scroll the paper by for each step of the mouse wheel */
+#define PRINTER_WHEEL_LINES 3
+
 /** Maximum size of a printer line before auto-CRLF */
 #define PRINTER_LINE_SIZE 200
 
-/** Size of the keyboard input buffer */
-#define KEYBOARD_BUFFER_SIZE 16
+/** Size of the keyboard input ring buffer, which is large enough to paste
+ *  whole program listings.  This must be a power of two. */
+#define KEYBOARD_BUFFER_SIZE 65536
+
+/** First character in the printer glyph atlas */
+#define GLYPH_FIRST ' '
+
+/** Last character in the printer glyph atlas */
+#define GLYPH_LAST '~'
+
+/** Number of characters in each row of the printer glyph atlas */
+#define GLYPH_COUNT (GLYPH_LAST - GLYPH_FIRST + 1)
+
+/* Ribbon colours, which are also the rows of the printer glyph atlas */
+#define RIBBON_BLACK 0
+#define RIBBON_RED   1
+#define RIBBON_COUNT 2
+
+/* Faces of the printer font; each has a row in the atlas per ribbon */
+#define FACE_REGULAR 0
+#define FACE_BOLD    1
+#define FACE_COUNT   2
+
+/** Size of the ring buffer that carries printer output from the run thread
+ *  to the user interface thread.  This must be a power of two. */
+#define PRINTER_RING_SIZE 4096
+
+/** The printer reports that it is busy when there are fewer than this
+ *  many free entries in the printer ring buffer. */
+#define PRINTER_RING_RESERVE 256
+
+/** Size of the command queue from the user interface thread to the
+ *  run thread.  This must be a power of two. */
+#define COMMAND_QUEUE_SIZE 64
 
 /* Extra buttons that are unique to this UI */
 #define LITTON_BUTTON_DRUM_LOAD 0x10000000U
@@ -59,15 +111,128 @@ static void usage(const char *progname)
 #define LITTON_BUTTON_TAPE_IN   0x40000000U
 #define LITTON_BUTTON_TAPE_OUT  0x80000000U
 
-/* Number of frames to leave a tape light highlighted when active requests */
-#define HIGHLIGHT_BUTTON_FRAMES 60
+/* Number of milliseconds to leave a tape button highlighted after the
+ * program asks for a tape that isn't mounted */
+#define HIGHLIGHT_BUTTON_MS 1000
+
+/** Number of milliseconds between frames while the machine is running */
+#define FRAME_MS 16
+
+/** Maximum number of milliseconds to block waiting for events when the
+ *  machine is halted or idle */
+#define IDLE_FRAME_MS 1000
+
+/** Number of brightness levels for the lamps on the front panel */
+#define LAMP_LEVELS 16
+
+/** Maximum number of damaged rectangles to track before redrawing the
+ *  whole window instead */
+#define MAX_DAMAGE_RECTS 32
+
+/**
+ * @brief Commands that the user interface thread can send to the run thread.
+ */
+typedef enum
+{
+    /** Press a button on the front panel */
+    UI_COMMAND_PRESS_BUTTON,
+
+    /** Load a drum image from a file */
+    UI_COMMAND_LOAD_DRUM,
+
+    /** Save the drum image to a file */
+    UI_COMMAND_SAVE_DRUM,
+
+    /** Close the input tape and then mount a new one if a filename is given */
+    UI_COMMAND_TAPE_IN,
+
+    /** Close the output tape and then mount a new one if a filename is given */
+    UI_COMMAND_TAPE_OUT
+
+} litton_ui_command_type_t;
+
+/**
+ * @brief Command from the user interface thread to the run thread.
+ */
+typedef struct
+{
+    /** Type of command */
+    litton_ui_command_type_t type;
+
+    /** Button to press for UI_COMMAND_PRESS_BUTTON */
+    uint32_t button;
+
+    /** Filename for the drum and tape commands, or NULL; the run thread
+     *  frees the filename after it executes the command */
+    char *filename;
+
+} litton_ui_command_t;
+
+/**
+ * @brief Line of printer output in the scroll-back history.
+ */
+typedef struct
+{
+    /** Characters on the line, padded with spaces */
+    uint8_t text[PRINTER_LINE_SIZE];
+
+    /** Ribbon colour that each character was printed with */
+    uint8_t ribbon[PRINTER_LINE_SIZE];
+
+} litton_ui_printer_line_t;
+
+/**
+ * @brief Snapshot of the machine state that the run thread publishes for
+ * the user interface thread after each time slice.
+ *
+ * The snapshot is protected by a sequence lock.  The run thread makes the
+ * sequence number odd while it is updating the fields, and the user
+ * interface thread retries if the sequence number was odd or changed
+ * while it was reading the fields.
+ */
+typedef struct
+{
+    /** Sequence number for the lock */
+    unsigned sequence;
+
+    /** Status lights on the front panel */
+    uint32_t status_lights;
+
+    /** Accumulated on time for each of the status lights */
+    litton_lamp_sampler_t lamps;
+
+    /** Register that is selected with the knob on the front panel */
+    uint32_t selected_register;
+
+    /** Non-zero if the machine is halted */
+    unsigned halted;
+
+    /** Non-zero if the program is idle, waiting for input */
+    unsigned idle;
+
+    /** Position of the run thread in the printer ring buffer */
+    unsigned printer_head;
+
+    /** Character set for the keyboard */
+    unsigned keyboard_charset;
+
+    /** Number of times that the program has asked for paper tape input
+     *  without an input tape being mounted */
+    unsigned tape_input_requests;
+
+    /** Number of times that the program has asked for paper tape output
+     *  without an output tape being mounted */
+    unsigned tape_output_requests;
+
+} litton_ui_snapshot_t;
 
 /**
  * @brief State information for managing the SDL user interface.
  */
 typedef struct
 {
-    /** Set to 1 when the program should quit */
+    /** Set to 1 when the program should quit, which is written by the
+     *  user interface thread and read by the run thread */
     int quit;
 
     /** Main SDL window */
@@ -124,11 +289,61 @@ typedef struct
     /** Main knob in the I32 position */
     SDL_Texture *image_knob_I32;
 
-    /** Font for displaying the printer output */
-    TTF_Font *font;
+    /** Fonts for displaying the printer output, indexed by face */
+    TTF_Font *fonts[FACE_COUNT];
+
+    /** Face of the printer font to print on the paper with */
+    int printer_face;
+
+    /** Semaphore that wakes up the background thread when it is idle
+     *  or halted and the user interface has something for it to do */
+    SDL_sem *wakeup;
+
+    /** Non-zero if the wakeup semaphore has been posted but the run
+     *  thread has not woken up yet */
+    int wakeup_pending;
+
+    /** Latest snapshot of the machine state from the run thread */
+    litton_ui_snapshot_t snapshot;
+
+    /** Number of paper tape input requests, which is only written by
+     *  the run thread and then published in the snapshot */
+    unsigned tape_input_requests;
 
-    /** Mutex lock for co-ordinating with the background thread */
-    SDL_mutex *mutex;
+    /** Number of paper tape output requests, which is only written by
+     *  the run thread and then published in the snapshot */
+    unsigned tape_output_requests;
+
+    /** Number of paper tape input requests that the user interface
+     *  thread has already seen in a snapshot */
+    unsigned seen_tape_input_requests;
+
+    /** Number of paper tape output requests that the user interface
+     *  thread has already seen in a snapshot */
+    unsigned seen_tape_output_requests;
+
+    /** Printer output ring buffer.  Each entry has a character code in
+     *  the low 8 bits and the printer character set in the high 8 bits. */
+    uint16_t printer_ring[PRINTER_RING_SIZE];
+
+    /** Position to write the next entry to the printer ring buffer,
+     *  which is only written by the run thread */
+    unsigned printer_head;
+
+    /** Position to read the next entry from the printer ring buffer,
+     *  which is only written by the user interface thread */
+    unsigned printer_tail;
+
+    /** Command queue from the user interface thread to the run thread */
+    litton_ui_command_t commands[COMMAND_QUEUE_SIZE];
+
+    /** Position to write the next command to the queue, which is only
+     *  written by the user interface thread */
+    unsigned command_head;
+
+    /** Position to read the next command from the queue, which is only
+     *  written by the run thread */
+    unsigned command_tail;
 
     /** Identifier of the button that is currently pressed and held */
     uint32_t pressed_button;
@@ -136,14 +351,38 @@ typedef struct
     /** Identifier of the button that is selected but not active yet */
     uint32_t selected_button;
 
-    /** Printer output buffer */
-    uint8_t printer_output[PRINTER_MAX_LINES][PRINTER_LINE_SIZE];
+    /** Ring buffer of printed lines for the scroll-back history */
+    litton_ui_printer_line_t *printer_history;
+
+    /** Number of lines in the printer history ring buffer */
+    long printer_history_size;
+
+    /** Number of lines that the paper is scrolled back by */
+    long printer_scroll;
+
+    /** Current ribbon colour, RIBBON_BLACK or RIBBON_RED */
+    uint8_t ribbon;
+
+    /** Pre-rendered glyphs for the printer font, with one row of
+     *  GLYPH_COUNT glyphs for each combination of face and ribbon colour */
+    SDL_Texture *glyph_atlas;
+
+    /** Cached renderings of printer lines, or NULL if the renderer
+     *  cannot render to textures.  Line N is cached in entry
+     *  N % PRINTER_MAX_LINES, so all visible lines have their own entry. */
+    SDL_Texture *printer_cache[PRINTER_MAX_LINES];
+
+    /** Number of the line that is in each cache entry, or -1 if none */
+    long printer_cache_line[PRINTER_MAX_LINES];
+
+    /** Non-zero if the printer line has changed since it was cached */
+    uint8_t printer_dirty[PRINTER_MAX_LINES];
 
     /** Current printer column, between 0 and PRINTER_LINE_SIZE-1 */
     int printer_column;
 
-    /** Current printer line, between 0 and PRINTER_MAX_LINES-1 */
-    int printer_line;
+    /** Number of the current printer line since the emulator started */
+    long printer_line;
 
     /** Width of a character in the font */
     int font_width;
@@ -151,59 +390,396 @@ typedef struct
     /** Height of a line of text in the font */
     int font_height;
 
-    /** Keyboard input buffer */
+    /** Keyboard input ring buffer */
     uint8_t keyboard_input[KEYBOARD_BUFFER_SIZE];
 
-    /** Number of characters in the keyboard input buffer */
-    int keyboard_count;
+    /** Position to write the next character to the keyboard input buffer,
+     *  which is only written by the user interface thread */
+    unsigned keyboard_head;
+
+    /** Position to read the next character from the keyboard input buffer,
+     *  which is only written by the run thread */
+    unsigned keyboard_tail;
+
+    /** Input that is waiting for space in the keyboard input buffer */
+    uint8_t *keyboard_pending;
+
+    /** Number of characters in keyboard_pending */
+    size_t keyboard_pending_count;
+
+    /** Position of the next character to move out of keyboard_pending */
+    size_t keyboard_pending_posn;
+
+    /** Allocated size of keyboard_pending */
+    size_t keyboard_pending_max;
+
+    /** Time in ticks when the TAPE IN button highlight expires */
+    Uint32 tape_input_highlight_end;
+
+    /** Time in ticks when the TAPE OUT button highlight expires */
+    Uint32 tape_output_highlight_end;
+
+    /** Non-zero if the TAPE IN button is currently highlighted */
+    int tape_input_highlighted;
+
+    /** Non-zero if the TAPE OUT button is currently highlighted */
+    int tape_output_highlighted;
+
+    /** Composited image of the front panel and the printer paper, or
+     *  NULL if the renderer cannot render to textures */
+    SDL_Texture *panel;
+
+    /** Snapshot of the machine state that is currently on the screen */
+    litton_ui_snapshot_t shown;
+
+    /** Accumulates the on time of the status lights, which is only
+     *  written by the run thread and then published in the snapshot */
+    litton_lamp_sampler_t lamp_sampler;
+
+    /** Brightness of each lamp in panel_lamps that is on the screen,
+     *  between 0 and LAMP_LEVELS */
+    int lamp_levels[LITTON_NUM_LAMPS];
+
+    /** Rectangles that need to be redrawn in the next frame */
+    SDL_Rect damage[MAX_DAMAGE_RECTS];
+
+    /** Number of rectangles in the damage list */
+    int num_damage;
 
-    /** If this is non-zero, the program wants paper tape input */
-    unsigned need_paper_tape_input;
+    /** Non-zero if the whole window needs to be redrawn */
+    int full_damage;
 
-    /** If this is non-zero, the program wants paper tape output */
-    unsigned need_paper_tape_output;
+    /** Time in ticks when the next frame is due while running */
+    Uint32 next_frame;
+
+    /** Non-zero when the user interface thread is blocked waiting for
+     *  events and wants the run thread to wake it up if the state of
+     *  the machine changes */
+    int ui_sleeping;
+
+    /** Event type that wakes up the user interface thread */
+    Uint32 refresh_event;
 
     /** Print to standard output at the same time as the GUI window */
     unsigned print_to_stdout;
 
+    /** Printer device, whose sink receives the copy on standard output */
+    litton_device_t *printer;
+
+    /** Speed multiplier relative to the original computer */
+    unsigned speed;
+
+    /** Paces the execution of the machine to real time */
+    litton_pacer_t pacer;
+
 } litton_ui_state_t;
 
 static litton_state_t machine;
 static litton_ui_state_t ui;
 
-static void draw_lamp(uint32_t lamps, uint32_t lamp, int x, int y)
+#define snapshot_store(field, value) \
+    __atomic_store_n(&(ui.snapshot.field), (value), __ATOMIC_RELAXED)
+#define snapshot_load(field) \
+    __atomic_load_n(&(ui.snapshot.field), __ATOMIC_RELAXED)
+
+/**
+ * @brief Publishes a snapshot of the machine state for the user interface.
+ *
+ * @param[in] state Points to the machine state.
+ * @param[in] idle Non-zero if the program is idle, waiting for input.
+ *
+ * This must only be called from the run thread.  If something visible
+ * has changed and the user interface thread is blocked waiting for
+ * events, then it is woken up.
+ */
+static void publish_snapshot(litton_state_t *state, int idle)
+{
+    litton_ui_snapshot_t *snapshot = &(ui.snapshot);
+    unsigned sequence = snapshot->sequence;
+    unsigned halted;
+    int changed;
+    int index;
+    SDL_Event event;
+    litton_sample_lamps(&(ui.lamp_sampler), state);
+    halted = litton_is_halted(state);
+    changed = snapshot->status_lights != state->status_lights ||
+              snapshot->selected_register != state->selected_register ||
+              snapshot->halted != halted ||
+              snapshot->idle != (unsigned)idle ||
+              snapshot->printer_head != ui.printer_head ||
+              snapshot->tape_input_requests != ui.tape_input_requests ||
+              snapshot->tape_output_requests != ui.tape_output_requests;
+    __atomic_store_n(&(snapshot->sequence), sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    snapshot_store(status_lights, state->status_lights);
+    for (index = 0; index < LITTON_NUM_LAMPS; ++index) {
+        snapshot_store(lamps.on_cycles[index],
+                       ui.lamp_sampler.on_cycles[index]);
+    }
+    snapshot_store(lamps.total_cycles, ui.lamp_sampler.total_cycles);
+    snapshot_store(selected_register, state->selected_register);
+    snapshot_store(halted, halted);
+    snapshot_store(idle, (unsigned)idle);
+    snapshot_store(printer_head, ui.printer_head);
+    snapshot_store(keyboard_charset, state->keyboard_charset);
+    snapshot_store(tape_input_requests, ui.tape_input_requests);
+    snapshot_store(tape_output_requests, ui.tape_output_requests);
+    __atomic_store_n(&(snapshot->sequence), sequence + 2, __ATOMIC_SEQ_CST);
+    if (changed && __atomic_exchange_n(&(ui.ui_sleeping), 0, __ATOMIC_SEQ_CST)) {
+        memset(&event, 0, sizeof(event));
+        event.type = ui.refresh_event;
+        SDL_PushEvent(&event);
+    }
+}
+
+/**
+ * @brief Reads the latest snapshot of the machine state.
+ *
+ * @param[out] snapshot Returns the snapshot.
+ *
+ * This must only be called from the user interface thread.
+ */
+static void read_snapshot(litton_ui_snapshot_t *snapshot)
+{
+    unsigned sequence;
+    int index;
+    do {
+        sequence = __atomic_load_n(&(ui.snapshot.sequence), __ATOMIC_ACQUIRE);
+        snapshot->status_lights = snapshot_load(status_lights);
+        for (index = 0; index < LITTON_NUM_LAMPS; ++index) {
+            snapshot->lamps.on_cycles[index] =
+                snapshot_load(lamps.on_cycles[index]);
+        }
+        snapshot->lamps.total_cycles = snapshot_load(lamps.total_cycles);
+        snapshot->selected_register = snapshot_load(selected_register);
+        snapshot->halted = snapshot_load(halted);
+        snapshot->idle = snapshot_load(idle);
+        snapshot->printer_head = snapshot_load(printer_head);
+        snapshot->keyboard_charset = snapshot_load(keyboard_charset);
+        snapshot->tape_input_requests = snapshot_load(tape_input_requests);
+        snapshot->tape_output_requests = snapshot_load(tape_output_requests);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) != 0 ||
+             sequence != __atomic_load_n(&(ui.snapshot.sequence),
+                                         __ATOMIC_RELAXED));
+    snapshot->sequence = sequence;
+}
+
+/**
+ * @brief Determine if the machine was halted in the latest snapshot.
+ *
+ * @return Non-zero if the machine is halted.
+ */
+static int snapshot_is_halted(void)
+{
+    litton_ui_snapshot_t snapshot;
+    read_snapshot(&snapshot);
+    return snapshot.halted;
+}
+
+/**
+ * @brief Wakes up the run thread if it is waiting for something to do.
+ *
+ * The semaphore is only posted once until the run thread wakes up,
+ * so that a large paste doesn't leave a long string of spurious
+ * wakeups behind it.
+ */
+static void wake_run_thread(void)
+{
+    if (!__atomic_exchange_n(&(ui.wakeup_pending), 1, __ATOMIC_ACQ_REL)) {
+        SDL_SemPost(ui.wakeup);
+    }
+}
+
+/**
+ * @brief Sends a command to the run thread.
+ *
+ * @param[in] type Type of command.
+ * @param[in] button Button to press for UI_COMMAND_PRESS_BUTTON.
+ * @param[in] filename Filename for the command, or NULL.  Ownership of
+ * the filename passes to the run thread.
+ */
+static void send_command
+    (litton_ui_command_type_t type, uint32_t button, char *filename)
+{
+    unsigned head = ui.command_head;
+    litton_ui_command_t *command;
+    if ((head - __atomic_load_n(&(ui.command_tail), __ATOMIC_ACQUIRE))
+            >= COMMAND_QUEUE_SIZE) {
+        /* The queue is full, so the run thread must be stuck.  Drop it. */
+        free(filename);
+        return;
+    }
+    command = &(ui.commands[head % COMMAND_QUEUE_SIZE]);
+    command->type = type;
+    command->button = button;
+    command->filename = filename;
+    __atomic_store_n(&(ui.command_head), head + 1, __ATOMIC_RELEASE);
+    wake_run_thread();
+}
+
+/**
+ * @brief Position of a lamp on the front panel.
+ */
+typedef struct
+{
+    /** Status light bit for the lamp */
+    uint32_t lamp;
+
+    /** X position of the lamp */
+    int x;
+
+    /** Y position of the lamp */
+    int y;
+
+} litton_ui_lamp_t;
+
+/**
+ * @brief Lamps on the front panel.
+ */
+static const litton_ui_lamp_t panel_lamps[] = {
+    {LITTON_STATUS_POWER,   LAMP_POWER_X,   LAMP_POWER_Y},
+    {LITTON_STATUS_READY,   LAMP_READY_X,   LAMP_READY_Y},
+    {LITTON_STATUS_RUN,     LAMP_RUN_X,     LAMP_RUN_Y},
+    {LITTON_STATUS_HALT,    LAMP_HALT_X,    LAMP_HALT_Y},
+    {LITTON_STATUS_K,       LAMP_K_X,       LAMP_K_Y},
+    {LITTON_STATUS_TRACK,   LAMP_TRACK_X,   LAMP_TRACK_Y},
+    {LITTON_STATUS_BIT_0,   LAMP_BIT_0_X,   LAMP_BIT_0_Y},
+    {LITTON_STATUS_BIT_1,   LAMP_BIT_1_X,   LAMP_BIT_1_Y},
+    {LITTON_STATUS_BIT_2,   LAMP_BIT_2_X,   LAMP_BIT_2_Y},
+    {LITTON_STATUS_BIT_3,   LAMP_BIT_3_X,   LAMP_BIT_3_Y},
+    {LITTON_STATUS_BIT_4,   LAMP_BIT_4_X,   LAMP_BIT_4_Y},
+    {LITTON_STATUS_BIT_5,   LAMP_BIT_5_X,   LAMP_BIT_5_Y},
+    {LITTON_STATUS_BIT_6,   LAMP_BIT_6_X,   LAMP_BIT_6_Y},
+    {LITTON_STATUS_BIT_7,   LAMP_BIT_7_X,   LAMP_BIT_7_Y},
+    {LITTON_STATUS_INST,    LAMP_INST_X,    LAMP_INST_Y},
+    {LITTON_STATUS_ACCUM,   LAMP_ACCUM_X,   LAMP_ACCUM_Y}
+};
+#define NUM_PANEL_LAMPS (sizeof(panel_lamps) / sizeof(panel_lamps[0]))
+
+/**
+ * @brief Position and size of a button on the front panel.
+ */
+typedef struct
+{
+    /** Identifier for the button */
+    uint32_t button;
+
+    /** Rectangle that contains the button */
+    SDL_Rect rect;
+
+} litton_ui_button_t;
+
+/**
+ * @brief Buttons on the front panel.
+ */
+static const litton_ui_button_t panel_buttons[] = {
+    {LITTON_BUTTON_POWER,
+     {BUTTON_POWER_X, BUTTON_POWER_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_READY,
+     {BUTTON_READY_X, BUTTON_READY_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_RUN,
+     {BUTTON_RUN_X, BUTTON_RUN_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_HALT,
+     {BUTTON_HALT_X, BUTTON_HALT_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_K_RESET,
+     {BUTTON_K_RESET_X, BUTTON_K_RESET_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_K_SET,
+     {BUTTON_K_SET_X, BUTTON_K_SET_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_RESET,
+     {BUTTON_BIT_RESET_X, BUTTON_BIT_RESET_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_0,
+     {BUTTON_BIT_0_X, BUTTON_BIT_0_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_1,
+     {BUTTON_BIT_1_X, BUTTON_BIT_1_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_2,
+     {BUTTON_BIT_2_X, BUTTON_BIT_2_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_3,
+     {BUTTON_BIT_3_X, BUTTON_BIT_3_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_4,
+     {BUTTON_BIT_4_X, BUTTON_BIT_4_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_5,
+     {BUTTON_BIT_5_X, BUTTON_BIT_5_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_6,
+     {BUTTON_BIT_6_X, BUTTON_BIT_6_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_BIT_7,
+     {BUTTON_BIT_7_X, BUTTON_BIT_7_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_CONTROL_UP,
+     {BUTTON_CONTROL_UP_X, BUTTON_CONTROL_UP_Y, BUTTON_CONTROL_UP_WIDTH, BUTTON_CONTROL_UP_HEIGHT}},
+    {LITTON_BUTTON_CONTROL_DOWN,
+     {BUTTON_CONTROL_DOWN_X, BUTTON_CONTROL_DOWN_Y, BUTTON_CONTROL_DOWN_WIDTH, BUTTON_CONTROL_DOWN_HEIGHT}},
+    {LITTON_BUTTON_INST_32,
+     {BUTTON_INST_32_X, BUTTON_INST_32_Y, BUTTON_INST_32_WIDTH, BUTTON_INST_32_HEIGHT}},
+    {LITTON_BUTTON_INST_24,
+     {BUTTON_INST_24_X, BUTTON_INST_24_Y, BUTTON_INST_24_WIDTH, BUTTON_INST_24_HEIGHT}},
+    {LITTON_BUTTON_INST_16,
+     {BUTTON_INST_16_X, BUTTON_INST_16_Y, BUTTON_INST_16_WIDTH, BUTTON_INST_16_HEIGHT}},
+    {LITTON_BUTTON_INST_8,
+     {BUTTON_INST_8_X, BUTTON_INST_8_Y, BUTTON_INST_8_WIDTH, BUTTON_INST_8_HEIGHT}},
+    {LITTON_BUTTON_INST_0,
+     {BUTTON_INST_0_X, BUTTON_INST_0_Y, BUTTON_INST_0_WIDTH, BUTTON_INST_0_HEIGHT}},
+    {LITTON_BUTTON_ACCUM_32,
+     {BUTTON_ACCUM_32_X, BUTTON_ACCUM_32_Y, BUTTON_ACCUM_32_WIDTH, BUTTON_ACCUM_32_HEIGHT}},
+    {LITTON_BUTTON_ACCUM_24,
+     {BUTTON_ACCUM_24_X, BUTTON_ACCUM_24_Y, BUTTON_ACCUM_24_WIDTH, BUTTON_ACCUM_24_HEIGHT}},
+    {LITTON_BUTTON_ACCUM_16,
+     {BUTTON_ACCUM_16_X, BUTTON_ACCUM_16_Y, BUTTON_ACCUM_16_WIDTH, BUTTON_ACCUM_16_HEIGHT}},
+    {LITTON_BUTTON_ACCUM_8,
+     {BUTTON_ACCUM_8_X, BUTTON_ACCUM_8_Y, BUTTON_ACCUM_8_WIDTH, BUTTON_ACCUM_8_HEIGHT}},
+    {LITTON_BUTTON_ACCUM_0,
+     {BUTTON_ACCUM_0_X, BUTTON_ACCUM_0_Y, BUTTON_ACCUM_0_WIDTH, BUTTON_ACCUM_0_HEIGHT}},
+    {LITTON_BUTTON_DRUM_LOAD,
+     {BUTTON_DRUM_LOAD_X, BUTTON_DRUM_LOAD_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_DRUM_SAVE,
+     {BUTTON_DRUM_SAVE_X, BUTTON_DRUM_SAVE_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_TAPE_IN,
+     {BUTTON_TAPE_IN_X, BUTTON_TAPE_IN_Y, BUTTON_WIDTH, BUTTON_HEIGHT}},
+    {LITTON_BUTTON_TAPE_OUT,
+     {BUTTON_TAPE_OUT_X, BUTTON_TAPE_OUT_Y, BUTTON_WIDTH, BUTTON_HEIGHT}}
+};
+#define NUM_PANEL_BUTTONS (sizeof(panel_buttons) / sizeof(panel_buttons[0]))
+
+/**
+ * @brief Finds the rectangle that contains a button.
+ *
+ * @param[in] button Identifier for the button.
+ *
+ * @return Pointer to the rectangle, or NULL if @a button is unknown.
+ */
+static const SDL_Rect *find_button_rect(uint32_t button)
+{
+    size_t index;
+    for (index = 0; index < NUM_PANEL_BUTTONS; ++index) {
+        if (panel_buttons[index].button == button) {
+            return &(panel_buttons[index].rect);
+        }
+    }
+    return 0;
+}
+
+static void draw_lamp(int level, const litton_ui_lamp_t *lamp)
 {
     SDL_Rect lamp_rect = {
-        .x = x,
-        .y = y,
+        .x = lamp->x,
+        .y = lamp->y,
         .w = LAMP_WIDTH,
         .h = LAMP_HEIGHT
     };
-    if ((lamps & lamp) != 0) {
+    if (level > 0) {
+        /* Blend the lit lamp over the unlit one to show the average
+         * brightness of lamps that are flickering */
+        SDL_SetTextureAlphaMod
+            (ui.image_lamps, (Uint8)((level * 255) / LAMP_LEVELS));
         SDL_RenderCopy(ui.renderer, ui.image_lamps, &lamp_rect, &lamp_rect);
     }
 }
 
-static void draw_pressed_button(int x, int y)
+static void draw_pressed_button(uint32_t button)
 {
-    SDL_Rect button_rect = {
-        .x = x,
-        .y = y,
-        .w = BUTTON_WIDTH,
-        .h = BUTTON_HEIGHT
-    };
-    SDL_RenderCopy(ui.renderer, ui.image_buttons, &button_rect, &button_rect);
-}
-
-static void draw_pressed_button_sized(int x, int y, int w, int h)
-{
-    SDL_Rect button_rect = {
-        .x = x,
-        .y = y,
-        .w = w,
-        .h = h
-    };
-    SDL_RenderCopy(ui.renderer, ui.image_buttons, &button_rect, &button_rect);
+    const SDL_Rect *button_rect = find_button_rect(button);
+    if (button_rect) {
+        SDL_RenderCopy(ui.renderer, ui.image_buttons, button_rect, button_rect);
+    }
 }
 
 static void draw_knob(SDL_Texture *image)
@@ -217,34 +793,239 @@ static void draw_knob(SDL_Texture *image)
     SDL_RenderCopy(ui.renderer, image, &knob_rect, &knob_rect);
 }
 
-static void draw_printer_line(int x, int y, int line)
+/**
+ * @brief Gets a line from the printer history.
+ *
+ * @param[in] line Number of the line.
+ *
+ * @return Pointer to the line, or NULL if the line has not been printed
+ * yet or it has dropped off the end of the history.
+ */
+static litton_ui_printer_line_t *printer_history_line(long line)
+{
+    if (line < 0 || line > ui.printer_line ||
+            line <= (ui.printer_line - ui.printer_history_size)) {
+        return 0;
+    }
+    return &(ui.printer_history[line % ui.printer_history_size]);
+}
+
+/**
+ * @brief Gets the number of the printer line that is visible on a row
+ * of the paper.
+ *
+ * @param[in] row The row on the paper, between 0 and PRINTER_MAX_LINES-1.
+ *
+ * @return The line number, which may be negative near the top of the
+ * paper before the first lines have been printed.
+ */
+static long printer_visible_line(int row)
 {
-    SDL_Surface *surface;
-    SDL_Texture *texture;
-    SDL_Color fg = {0, 0, 0, 255};
-    SDL_Color bg = {242, 230, 223, 255};
+    return ui.printer_line - ui.printer_scroll - (PRINTER_MAX_LINES - 1 - row);
+}
+
+/**
+ * @brief Gets the length of a printer line, without trailing spaces.
+ *
+ * @param[in] line The printer line.
+ *
+ * @return The number of characters on the line.
+ */
+static int printer_line_length(const litton_ui_printer_line_t *line)
+{
+    int len = PRINTER_LINE_SIZE;
+    while (len > 0 && line->text[len - 1] == ' ') {
+        --len;
+    }
+    return len;
+}
+
+/**
+ * @brief Draws the characters on a printer line from the glyph atlas.
+ *
+ * @param[in] x X position of the first character.
+ * @param[in] y Y position of the top of the line.
+ * @param[in] line The printer line.
+ * @param[in] len The number of characters to draw.
+ */
+static void draw_printer_glyphs
+    (int x, int y, const litton_ui_printer_line_t *line, int len)
+{
+    SDL_Rect src = {
+        .w = ui.font_width,
+        .h = ui.font_height
+    };
+    SDL_Rect dest = {
+        .x = x,
+        .y = y,
+        .w = ui.font_width,
+        .h = ui.font_height
+    };
+    int col;
+    uint8_t ch;
+    for (col = 0; col < len; ++col, dest.x += ui.font_width) {
+        ch = line->text[col];
+        if (ch <= GLYPH_FIRST || ch > GLYPH_LAST) {
+            continue;
+        }
+        src.x = (ch - GLYPH_FIRST) * ui.font_width;
+        src.y = (ui.printer_face * RIBBON_COUNT + line->ribbon[col]) *
+                ui.font_height;
+        SDL_RenderCopy(ui.renderer, ui.glyph_atlas, &src, &dest);
+    }
+}
+
+static void draw_printer_line(int x, int y, int row)
+{
+    long number = printer_visible_line(row);
+    const litton_ui_printer_line_t *line = printer_history_line(number);
+    SDL_Texture *cache;
     SDL_Rect rect = {
         .x = x,
-        .y = y + BG_HEIGHT
+        .y = y + BG_HEIGHT,
+        .h = ui.font_height
+    };
+    SDL_Rect src = {
+        .x = 0,
+        .y = 0,
+        .h = ui.font_height
     };
-    char text[PRINTER_LINE_SIZE + 1];
     int len;
-    memcpy(text, ui.printer_output[line], PRINTER_LINE_SIZE);
-    len = PRINTER_LINE_SIZE;
-    while (len > 0 && text[len - 1] == ' ') {
-        --len;
+    if (!line) {
+        return;
     }
-    text[len] = '\0';
+    len = printer_line_length(line);
     if (!len) {
         return;
     }
-    surface = TTF_RenderText_Shaded(ui.font, text, fg, bg);
-    rect.w = surface->w;
-    rect.h = surface->h;
-    texture = SDL_CreateTextureFromSurface(ui.renderer, surface);
-    SDL_RenderCopy(ui.renderer, texture, NULL, &rect);
-    SDL_DestroyTexture(texture);
-    SDL_FreeSurface(surface);
+    cache = ui.printer_cache[number % PRINTER_MAX_LINES];
+    if (!cache) {
+        /* No cache, so draw the glyphs directly onto the screen */
+        draw_printer_glyphs(rect.x, rect.y, line, len);
+        return;
+    }
+    rect.w = len * ui.font_width;
+    src.w = rect.w;
+    SDL_RenderCopy(ui.renderer, cache, &src, &rect);
+}
+
+/**
+ * @brief Re-renders the visible printer lines that have changed into
+ * their cached textures.
+ *
+ * This must be called before drawing the frame because it changes the
+ * render target.
+ */
+static void update_printer_lines(void)
+{
+    const litton_ui_printer_line_t *line;
+    SDL_Texture *cache;
+    long number;
+    int row, entry, len;
+    for (row = 0; row < PRINTER_MAX_LINES; ++row) {
+        number = printer_visible_line(row);
+        line = printer_history_line(number);
+        if (!line) {
+            continue;
+        }
+        entry = (int)(number % PRINTER_MAX_LINES);
+        cache = ui.printer_cache[entry];
+        if (!cache || (ui.printer_cache_line[entry] == number &&
+                       !ui.printer_dirty[entry])) {
+            continue;
+        }
+        len = printer_line_length(line);
+        if (len > 0) {
+            SDL_SetRenderTarget(ui.renderer, cache);
+            SDL_SetRenderDrawColor(ui.renderer, 242, 230, 223, 255);
+            SDL_RenderClear(ui.renderer);
+            draw_printer_glyphs(0, 0, line, len);
+        }
+        ui.printer_cache_line[entry] = number;
+        ui.printer_dirty[entry] = 0;
+    }
+    SDL_SetRenderTarget(ui.renderer, NULL);
+}
+
+/**
+ * @brief Marks all printer lines as needing to be re-rendered.
+ */
+static void invalidate_printer_lines(void)
+{
+    memset(ui.printer_dirty, 1, sizeof(ui.printer_dirty));
+}
+
+/**
+ * @brief Pre-renders the printer font into the glyph atlas and creates
+ * the cached textures for the printer lines.
+ */
+static void create_printer_glyphs(void)
+{
+    static const SDL_Color ribbons[RIBBON_COUNT] = {
+        {0, 0, 0, 255},         /* RIBBON_BLACK */
+        {192, 0, 0, 255}        /* RIBBON_RED */
+    };
+    SDL_Color bg = {242, 230, 223, 255};
+    SDL_Surface *atlas;
+    SDL_Surface *glyph;
+    SDL_Rect src = {
+        .x = 0,
+        .y = 0
+    };
+    SDL_Rect rect;
+    int face, ribbon, ch, line;
+
+    /* Render each glyph into its own cell so that the positions in the
+     * atlas line up exactly with the character columns on the paper.
+     * Both faces use the cell size of the bold face. */
+    atlas = SDL_CreateRGBSurfaceWithFormat
+        (0, GLYPH_COUNT * ui.font_width,
+         FACE_COUNT * RIBBON_COUNT * ui.font_height,
+         32, SDL_PIXELFORMAT_RGBA8888);
+    for (face = 0; face < FACE_COUNT; ++face) {
+        for (ribbon = 0; ribbon < RIBBON_COUNT; ++ribbon) {
+            for (ch = GLYPH_FIRST; ch <= GLYPH_LAST; ++ch) {
+                glyph = TTF_RenderGlyph_Shaded
+                    (ui.fonts[face], (Uint16)ch, ribbons[ribbon], bg);
+                if (!glyph) {
+                    continue;
+                }
+                src.w = glyph->w < ui.font_width ? glyph->w : ui.font_width;
+                src.h = glyph->h < ui.font_height ? glyph->h : ui.font_height;
+                rect.x = (ch - GLYPH_FIRST) * ui.font_width;
+                rect.y = (face * RIBBON_COUNT + ribbon) * ui.font_height;
+                rect.w = src.w;
+                rect.h = src.h;
+                SDL_BlitSurface(glyph, &src, atlas, &rect);
+                SDL_FreeSurface(glyph);
+            }
+        }
+    }
+    ui.glyph_atlas = SDL_CreateTextureFromSurface(ui.renderer, atlas);
+    SDL_FreeSurface(atlas);
+
+    /* Create the line caches.  If the renderer doesn't support rendering
+     * to textures, then the lines are drawn from the atlas every frame. */
+    for (line = 0; line < PRINTER_MAX_LINES; ++line) {
+        ui.printer_cache[line] = SDL_CreateTexture
+            (ui.renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+             PRINTER_LINE_SIZE * ui.font_width, ui.font_height);
+    }
+    invalidate_printer_lines();
+}
+
+/**
+ * @brief Destroys the glyph atlas and the printer line caches.
+ */
+static void destroy_printer_glyphs(void)
+{
+    int line;
+    for (line = 0; line < PRINTER_MAX_LINES; ++line) {
+        if (ui.printer_cache[line]) {
+            SDL_DestroyTexture(ui.printer_cache[line]);
+        }
+    }
+    SDL_DestroyTexture(ui.glyph_atlas);
 }
 
 static void draw_cursor(int x, int y)
@@ -259,7 +1040,154 @@ static void draw_cursor(int x, int y)
     SDL_RenderFillRect(ui.renderer, &rect);
 }
 
-static void draw_screen(void)
+/**
+ * @brief Adds a rectangle to the list of damaged areas to redraw.
+ *
+ * @param[in] rect The rectangle, or NULL for the whole window.
+ */
+static void add_damage(const SDL_Rect *rect)
+{
+    if (!rect || ui.num_damage >= MAX_DAMAGE_RECTS) {
+        ui.full_damage = 1;
+    } else if (!ui.full_damage) {
+        ui.damage[(ui.num_damage)++] = *rect;
+    }
+}
+
+/**
+ * @brief Marks a button as damaged.
+ *
+ * @param[in] button Identifier for the button, or zero for no button.
+ */
+static void damage_button(uint32_t button)
+{
+    const SDL_Rect *rect = find_button_rect(button);
+    if (rect) {
+        add_damage(rect);
+    }
+}
+
+/**
+ * @brief Marks the printer paper as damaged.
+ */
+static void damage_paper(void)
+{
+    SDL_Rect paper_rect = {
+        .x = 0,
+        .y = BG_HEIGHT,
+        .w = BG_WIDTH,
+        .h = PAPER_HEIGHT
+    };
+    add_damage(&paper_rect);
+}
+
+/**
+ * @brief Changes the button that is shown as pressed.
+ *
+ * @param[in] button Identifier for the button, or zero for no button.
+ */
+static void set_pressed_button(uint32_t button)
+{
+    if (button != ui.pressed_button) {
+        damage_button(ui.pressed_button);
+        damage_button(button);
+        ui.pressed_button = button;
+    }
+}
+
+/**
+ * @brief Determine how long it is until a point in time.
+ *
+ * @param[in] end The point in time in ticks.
+ * @param[in] now The current time in ticks.
+ *
+ * @return The number of milliseconds left, or zero if @a end has passed.
+ */
+static Uint32 ticks_until(Uint32 end, Uint32 now)
+{
+    return ((Sint32)(end - now) > 0) ? (end - now) : 0;
+}
+
+/**
+ * @brief Compares the latest snapshot with what is on the screen and
+ * adds the areas that have changed to the damage list.
+ */
+static void update_damage(void)
+{
+    litton_ui_snapshot_t snapshot;
+    Uint32 now = SDL_GetTicks();
+    size_t index;
+    int highlighted;
+    int level;
+
+    /* Get the state of the engine in the background thread */
+    read_snapshot(&snapshot);
+
+    /* Which lamps have changed brightness?  If the machine hasn't run
+     * since the last frame, then show the current state of the lamps. */
+    for (index = 0; index < NUM_PANEL_LAMPS; ++index) {
+        level = litton_lamp_brightness
+            (&(snapshot.lamps), &(ui.shown.lamps),
+             panel_lamps[index].lamp, LAMP_LEVELS);
+        if (level < 0) {
+            level = (snapshot.status_lights & panel_lamps[index].lamp) ?
+                    LAMP_LEVELS : 0;
+        }
+        if (level != ui.lamp_levels[index]) {
+            SDL_Rect lamp_rect = {
+                .x = panel_lamps[index].x,
+                .y = panel_lamps[index].y,
+                .w = LAMP_WIDTH,
+                .h = LAMP_HEIGHT
+            };
+            add_damage(&lamp_rect);
+            ui.lamp_levels[index] = level;
+        }
+    }
+
+    /* Has the register select knob moved? */
+    if (snapshot.selected_register != ui.shown.selected_register) {
+        SDL_Rect knob_rect = {
+            .x = KNOB_X,
+            .y = KNOB_Y,
+            .w = KNOB_WIDTH,
+            .h = KNOB_HEIGHT
+        };
+        add_damage(&knob_rect);
+    }
+
+    /* Highlight the tape buttons if there is an active request for
+     * tape input or output but no tape is currently mounted. */
+    if (snapshot.tape_input_requests != ui.seen_tape_input_requests) {
+        ui.seen_tape_input_requests = snapshot.tape_input_requests;
+        ui.tape_input_highlight_end = now + HIGHLIGHT_BUTTON_MS;
+    }
+    if (snapshot.tape_output_requests != ui.seen_tape_output_requests) {
+        ui.seen_tape_output_requests = snapshot.tape_output_requests;
+        ui.tape_output_highlight_end = now + HIGHLIGHT_BUTTON_MS;
+    }
+    highlighted =
+        ticks_until(ui.tape_input_highlight_end, now) != 0;
+    if (highlighted != ui.tape_input_highlighted) {
+        ui.tape_input_highlighted = highlighted;
+        damage_button(LITTON_BUTTON_TAPE_IN);
+    }
+    highlighted =
+        ticks_until(ui.tape_output_highlight_end, now) != 0;
+    if (highlighted != ui.tape_output_highlighted) {
+        ui.tape_output_highlighted = highlighted;
+        damage_button(LITTON_BUTTON_TAPE_OUT);
+    }
+    ui.shown = snapshot;
+}
+
+/**
+ * @brief Draws the whole front panel and printer paper.
+ *
+ * When only part of the window has been damaged, this is called with
+ * a clip rectangle set so that only the damaged area is recomposited.
+ */
+static void draw_panel(void)
 {
     SDL_Rect main_rect = {
         .x = 0,
@@ -273,21 +1201,11 @@ static void draw_screen(void)
         .w = BG_WIDTH,
         .h = PAPER_HEIGHT
     };
-    uint32_t lamps;
-    uint32_t selected_register;
+    size_t index;
     int line;
 
-    /* Get the state of the engine in the background thread */
-    SDL_LockMutex(ui.mutex);
-    litton_update_status_lights(&machine);
-    lamps = machine.status_lights;
-    selected_register = machine.selected_register;
-    SDL_UnlockMutex(ui.mutex);
-
     /* Background of the printer region is "paper write" to simulate
-     * old printer paper.  Fill the rest with black. */
-    SDL_SetRenderDrawColor(ui.renderer, 0, 0, 0, 255);
-    SDL_RenderClear(ui.renderer);
+     * old printer paper. */
     SDL_SetRenderDrawColor(ui.renderer, 242, 230, 223, 255);
     SDL_RenderFillRect(ui.renderer, &printer_rect);
 
@@ -295,25 +1213,12 @@ static void draw_screen(void)
     SDL_RenderCopy(ui.renderer, ui.image_bg, &main_rect, &main_rect);
 
     /* Draw the lamps that are currently lit */
-    draw_lamp(lamps, LITTON_STATUS_POWER, LAMP_POWER_X, LAMP_POWER_Y);
-    draw_lamp(lamps, LITTON_STATUS_READY, LAMP_READY_X, LAMP_READY_Y);
-    draw_lamp(lamps, LITTON_STATUS_RUN, LAMP_RUN_X, LAMP_RUN_Y);
-    draw_lamp(lamps, LITTON_STATUS_HALT, LAMP_HALT_X, LAMP_HALT_Y);
-    draw_lamp(lamps, LITTON_STATUS_K, LAMP_K_X, LAMP_K_Y);
-    draw_lamp(lamps, LITTON_STATUS_TRACK, LAMP_TRACK_X, LAMP_TRACK_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_0, LAMP_BIT_0_X, LAMP_BIT_0_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_1, LAMP_BIT_1_X, LAMP_BIT_1_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_2, LAMP_BIT_2_X, LAMP_BIT_2_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_3, LAMP_BIT_3_X, LAMP_BIT_3_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_4, LAMP_BIT_4_X, LAMP_BIT_4_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_5, LAMP_BIT_5_X, LAMP_BIT_5_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_6, LAMP_BIT_6_X, LAMP_BIT_6_Y);
-    draw_lamp(lamps, LITTON_STATUS_BIT_7, LAMP_BIT_7_X, LAMP_BIT_7_Y);
-    draw_lamp(lamps, LITTON_STATUS_INST, LAMP_INST_X, LAMP_INST_Y);
-    draw_lamp(lamps, LITTON_STATUS_ACCUM, LAMP_ACCUM_X, LAMP_ACCUM_Y);
+    for (index = 0; index < NUM_PANEL_LAMPS; ++index) {
+        draw_lamp(ui.lamp_levels[index], &(panel_lamps[index]));
+    }
 
     /* Draw the position of the register select knob */
-    switch (selected_register) {
+    switch (ui.shown.selected_register) {
     case LITTON_BUTTON_CONTROL_UP:
         draw_knob(ui.image_control_up);
         break;
@@ -364,165 +1269,14 @@ static void draw_screen(void)
     }
 
     /* Highlight the push button that is currently pressed */
-    switch (ui.pressed_button) {
-    case LITTON_BUTTON_POWER:
-        draw_pressed_button(BUTTON_POWER_X, BUTTON_POWER_Y);
-        break;
-
-    case LITTON_BUTTON_READY:
-        draw_pressed_button(BUTTON_READY_X, BUTTON_READY_Y);
-        break;
-
-    case LITTON_BUTTON_RUN:
-        draw_pressed_button(BUTTON_RUN_X, BUTTON_RUN_Y);
-        break;
-
-    case LITTON_BUTTON_HALT:
-        draw_pressed_button(BUTTON_HALT_X, BUTTON_HALT_Y);
-        break;
-
-    case LITTON_BUTTON_K_RESET:
-        draw_pressed_button(BUTTON_K_RESET_X, BUTTON_K_RESET_Y);
-        break;
-
-    case LITTON_BUTTON_K_SET:
-        draw_pressed_button(BUTTON_K_SET_X, BUTTON_K_SET_Y);
-        break;
-
-    case LITTON_BUTTON_RESET:
-        draw_pressed_button(BUTTON_BIT_RESET_X, BUTTON_BIT_RESET_Y);
-        break;
-
-    case LITTON_BUTTON_BIT_0:
-        draw_pressed_button(BUTTON_BIT_0_X, BUTTON_BIT_0_Y);
-        break;
-
-    case LITTON_BUTTON_BIT_1:
-        draw_pressed_button(BUTTON_BIT_1_X, BUTTON_BIT_1_Y);
-        break;
-
-    case LITTON_BUTTON_BIT_2:
-        draw_pressed_button(BUTTON_BIT_2_X, BUTTON_BIT_2_Y);
-        break;
-
-    case LITTON_BUTTON_BIT_3:
-        draw_pressed_button(BUTTON_BIT_3_X, BUTTON_BIT_3_Y);
-        break;
-
-    case LITTON_BUTTON_BIT_4:
-        draw_pressed_button(BUTTON_BIT_4_X, BUTTON_BIT_4_Y);
-        break;
-
-    case LITTON_BUTTON_BIT_5:
-        draw_pressed_button(BUTTON_BIT_5_X, BUTTON_BIT_5_Y);
-        break;
+    draw_pressed_button(ui.pressed_button);
 
-    case LITTON_BUTTON_BIT_6:
-        draw_pressed_button(BUTTON_BIT_6_X, BUTTON_BIT_6_Y);
-        break;
-
-    case LITTON_BUTTON_BIT_7:
-        draw_pressed_button(BUTTON_BIT_7_X, BUTTON_BIT_7_Y);
-        break;
-
-    case LITTON_BUTTON_CONTROL_UP:
-        draw_pressed_button_sized
-            (BUTTON_CONTROL_UP_X, BUTTON_CONTROL_UP_Y,
-             BUTTON_CONTROL_UP_WIDTH, BUTTON_CONTROL_UP_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_INST_32:
-        draw_pressed_button_sized
-            (BUTTON_INST_32_X, BUTTON_INST_32_Y,
-             BUTTON_INST_32_WIDTH, BUTTON_INST_32_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_INST_24:
-        draw_pressed_button_sized
-            (BUTTON_INST_24_X, BUTTON_INST_24_Y,
-             BUTTON_INST_24_WIDTH, BUTTON_INST_24_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_INST_16:
-        draw_pressed_button_sized
-            (BUTTON_INST_16_X, BUTTON_INST_16_Y,
-             BUTTON_INST_16_WIDTH, BUTTON_INST_16_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_INST_8:
-        draw_pressed_button_sized
-            (BUTTON_INST_8_X, BUTTON_INST_8_Y,
-             BUTTON_INST_8_WIDTH, BUTTON_INST_8_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_INST_0:
-        draw_pressed_button_sized
-            (BUTTON_INST_0_X, BUTTON_INST_0_Y,
-             BUTTON_INST_0_WIDTH, BUTTON_INST_0_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_CONTROL_DOWN:
-        draw_pressed_button_sized
-            (BUTTON_CONTROL_DOWN_X, BUTTON_CONTROL_DOWN_Y,
-             BUTTON_CONTROL_DOWN_WIDTH, BUTTON_CONTROL_DOWN_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_ACCUM_32:
-        draw_pressed_button_sized
-            (BUTTON_ACCUM_32_X, BUTTON_ACCUM_32_Y,
-             BUTTON_ACCUM_32_WIDTH, BUTTON_ACCUM_32_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_ACCUM_24:
-        draw_pressed_button_sized
-            (BUTTON_ACCUM_24_X, BUTTON_ACCUM_24_Y,
-             BUTTON_ACCUM_24_WIDTH, BUTTON_ACCUM_24_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_ACCUM_16:
-        draw_pressed_button_sized
-            (BUTTON_ACCUM_16_X, BUTTON_ACCUM_16_Y,
-             BUTTON_ACCUM_16_WIDTH, BUTTON_ACCUM_16_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_ACCUM_8:
-        draw_pressed_button_sized
-            (BUTTON_ACCUM_8_X, BUTTON_ACCUM_8_Y,
-             BUTTON_ACCUM_8_WIDTH, BUTTON_ACCUM_8_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_ACCUM_0:
-        draw_pressed_button_sized
-            (BUTTON_ACCUM_0_X, BUTTON_ACCUM_0_Y,
-             BUTTON_ACCUM_0_WIDTH, BUTTON_ACCUM_0_HEIGHT);
-        break;
-
-    case LITTON_BUTTON_DRUM_LOAD:
-        draw_pressed_button(BUTTON_DRUM_LOAD_X, BUTTON_DRUM_LOAD_Y);
-        break;
-
-    case LITTON_BUTTON_DRUM_SAVE:
-        draw_pressed_button(BUTTON_DRUM_SAVE_X, BUTTON_DRUM_SAVE_Y);
-        break;
-
-    case LITTON_BUTTON_TAPE_IN:
-        draw_pressed_button(BUTTON_TAPE_IN_X, BUTTON_TAPE_IN_Y);
-        break;
-
-    case LITTON_BUTTON_TAPE_OUT:
-        draw_pressed_button(BUTTON_TAPE_OUT_X, BUTTON_TAPE_OUT_Y);
-        break;
+    /* Highlight the tape buttons if the program is waiting for a tape */
+    if (ui.tape_input_highlighted) {
+        draw_pressed_button(LITTON_BUTTON_TAPE_IN);
     }
-
-    /* Highlight the tape buttons if there is an active request for
-     * tape input or output but no tape is currently mounted. */
-    if (ui.need_paper_tape_input > 0) {
-        draw_pressed_button(BUTTON_TAPE_IN_X, BUTTON_TAPE_IN_Y);
-        --(ui.need_paper_tape_input);
-    }
-    if (ui.need_paper_tape_output > 0) {
-        draw_pressed_button(BUTTON_TAPE_OUT_X, BUTTON_TAPE_OUT_Y);
-        --(ui.need_paper_tape_output);
+    if (ui.tape_output_highlighted) {
+        draw_pressed_button(LITTON_BUTTON_TAPE_OUT);
     }
 
     /* Draw the text for the printer output */
@@ -530,9 +1284,51 @@ static void draw_screen(void)
         draw_printer_line(5, 5 + line * ui.font_height, line);
     }
 
-    /* Draw the cursor at the current print position */
-    draw_cursor(5 + ui.printer_column * ui.font_width,
-                5 + ui.printer_line * ui.font_height);
+    /* Draw the cursor at the current print position, unless the paper
+     * has been scrolled back */
+    if (ui.printer_scroll == 0) {
+        draw_cursor(5 + ui.printer_column * ui.font_width,
+                    5 + (PRINTER_MAX_LINES - 1) * ui.font_height);
+    }
+}
+
+static void draw_screen(void)
+{
+    int index;
+
+    /* Bail out if nothing has changed since the last frame */
+    if (!ui.full_damage && !ui.num_damage) {
+        return;
+    }
+
+    /* Bring the cached printer lines up to date first, because that
+     * changes the render target */
+    update_printer_lines();
+
+    /* Recomposite the damaged areas into the panel texture, or draw
+     * everything straight to the window if there is no panel texture */
+    if (ui.panel) {
+        SDL_SetRenderTarget(ui.renderer, ui.panel);
+        if (ui.full_damage) {
+            draw_panel();
+        } else {
+            for (index = 0; index < ui.num_damage; ++index) {
+                SDL_RenderSetClipRect(ui.renderer, &(ui.damage[index]));
+                draw_panel();
+            }
+            SDL_RenderSetClipRect(ui.renderer, NULL);
+        }
+        SDL_SetRenderTarget(ui.renderer, NULL);
+    }
+    SDL_SetRenderDrawColor(ui.renderer, 0, 0, 0, 255);
+    SDL_RenderClear(ui.renderer);
+    if (ui.panel) {
+        SDL_RenderCopy(ui.renderer, ui.panel, NULL, NULL);
+    } else {
+        draw_panel();
+    }
+    ui.num_damage = 0;
+    ui.full_damage = 0;
 
     /* Flip the screen and display what we just drew */
     SDL_RenderPresent(ui.renderer);
@@ -547,162 +1343,82 @@ static int in_button_rect
 
 static uint32_t get_button(int x, int y)
 {
-    if (in_button_rect
-            (x, y, BUTTON_POWER_X, BUTTON_POWER_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_POWER;
-    } else if (in_button_rect
-            (x, y, BUTTON_READY_X, BUTTON_READY_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_READY;
-    } else if (in_button_rect
-            (x, y, BUTTON_RUN_X, BUTTON_RUN_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_RUN;
-    } else if (in_button_rect
-            (x, y, BUTTON_HALT_X, BUTTON_HALT_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_HALT;
-    } else if (in_button_rect
-            (x, y, BUTTON_K_RESET_X, BUTTON_K_RESET_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_K_RESET;
-    } else if (in_button_rect
-            (x, y, BUTTON_K_SET_X, BUTTON_K_SET_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_K_SET;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_RESET_X, BUTTON_BIT_RESET_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_RESET;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_0_X, BUTTON_BIT_0_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_0;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_1_X, BUTTON_BIT_1_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_1;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_2_X, BUTTON_BIT_2_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_2;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_3_X, BUTTON_BIT_3_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_3;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_4_X, BUTTON_BIT_4_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_4;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_5_X, BUTTON_BIT_5_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_5;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_6_X, BUTTON_BIT_6_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_6;
-    } else if (in_button_rect
-            (x, y, BUTTON_BIT_7_X, BUTTON_BIT_7_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_BIT_7;
-    } else if (in_button_rect
-            (x, y, BUTTON_CONTROL_UP_X, BUTTON_CONTROL_UP_Y,
-             BUTTON_CONTROL_UP_WIDTH, BUTTON_CONTROL_UP_HEIGHT)) {
-        return LITTON_BUTTON_CONTROL_UP;
-    } else if (in_button_rect
-            (x, y, BUTTON_CONTROL_DOWN_X, BUTTON_CONTROL_DOWN_Y,
-             BUTTON_CONTROL_DOWN_WIDTH, BUTTON_CONTROL_DOWN_HEIGHT)) {
-        return LITTON_BUTTON_CONTROL_DOWN;
-    } else if (in_button_rect
-            (x, y, BUTTON_INST_32_X, BUTTON_INST_32_Y,
-             BUTTON_INST_32_WIDTH, BUTTON_INST_32_HEIGHT)) {
-        return LITTON_BUTTON_INST_32;
-    } else if (in_button_rect
-            (x, y, BUTTON_INST_24_X, BUTTON_INST_24_Y,
-             BUTTON_INST_24_WIDTH, BUTTON_INST_24_HEIGHT)) {
-        return LITTON_BUTTON_INST_24;
-    } else if (in_button_rect
-            (x, y, BUTTON_INST_16_X, BUTTON_INST_16_Y,
-             BUTTON_INST_16_WIDTH, BUTTON_INST_16_HEIGHT)) {
-        return LITTON_BUTTON_INST_16;
-    } else if (in_button_rect
-            (x, y, BUTTON_INST_8_X, BUTTON_INST_8_Y,
-             BUTTON_INST_8_WIDTH, BUTTON_INST_8_HEIGHT)) {
-        return LITTON_BUTTON_INST_8;
-    } else if (in_button_rect
-            (x, y, BUTTON_INST_0_X, BUTTON_INST_0_Y,
-             BUTTON_INST_0_WIDTH, BUTTON_INST_0_HEIGHT)) {
-        return LITTON_BUTTON_INST_0;
-    } else if (in_button_rect
-            (x, y, BUTTON_ACCUM_32_X, BUTTON_ACCUM_32_Y,
-             BUTTON_ACCUM_32_WIDTH, BUTTON_ACCUM_32_HEIGHT)) {
-        return LITTON_BUTTON_ACCUM_32;
-    } else if (in_button_rect
-            (x, y, BUTTON_ACCUM_24_X, BUTTON_ACCUM_24_Y,
-             BUTTON_ACCUM_24_WIDTH, BUTTON_ACCUM_24_HEIGHT)) {
-        return LITTON_BUTTON_ACCUM_24;
-    } else if (in_button_rect
-            (x, y, BUTTON_ACCUM_16_X, BUTTON_ACCUM_16_Y,
-             BUTTON_ACCUM_16_WIDTH, BUTTON_ACCUM_16_HEIGHT)) {
-        return LITTON_BUTTON_ACCUM_16;
-    } else if (in_button_rect
-            (x, y, BUTTON_ACCUM_8_X, BUTTON_ACCUM_8_Y,
-             BUTTON_ACCUM_8_WIDTH, BUTTON_ACCUM_8_HEIGHT)) {
-        return LITTON_BUTTON_ACCUM_8;
-    } else if (in_button_rect
-            (x, y, BUTTON_ACCUM_0_X, BUTTON_ACCUM_0_Y,
-             BUTTON_ACCUM_0_WIDTH, BUTTON_ACCUM_0_HEIGHT)) {
-        return LITTON_BUTTON_ACCUM_0;
-    } else if (in_button_rect
-            (x, y, BUTTON_DRUM_LOAD_X, BUTTON_DRUM_LOAD_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_DRUM_LOAD;
-    } else if (in_button_rect
-            (x, y, BUTTON_DRUM_SAVE_X, BUTTON_DRUM_SAVE_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_DRUM_SAVE;
-    } else if (in_button_rect
-            (x, y, BUTTON_TAPE_IN_X, BUTTON_TAPE_IN_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_TAPE_IN;
-    } else if (in_button_rect
-            (x, y, BUTTON_TAPE_OUT_X, BUTTON_TAPE_OUT_Y,
-             BUTTON_WIDTH, BUTTON_HEIGHT)) {
-        return LITTON_BUTTON_TAPE_OUT;
+    const SDL_Rect *rect;
+    size_t index;
+    for (index = 0; index < NUM_PANEL_BUTTONS; ++index) {
+        rect = &(panel_buttons[index].rect);
+        if (in_button_rect(x, y, rect->x, rect->y, rect->w, rect->h)) {
+            return panel_buttons[index].button;
+        }
     }
     return 0;
 }
 
+/**
+ * @brief Scrolls the paper backwards or forwards through the history.
+ *
+ * @param[in] lines Number of lines to scroll back by, or negative to
+ * scroll forwards towards the current line.
+ */
+static void scroll_paper(long lines)
+{
+    long oldest = ui.printer_line - ui.printer_history_size + 1;
+    long max_scroll;
+    long scroll;
+    if (oldest < 0) {
+        oldest = 0;
+    }
+    max_scroll = ui.printer_line - oldest - (PRINTER_MAX_LINES - 1);
+    if (max_scroll < 0) {
+        max_scroll = 0;
+    }
+    scroll = ui.printer_scroll + lines;
+    if (scroll > max_scroll) {
+        scroll = max_scroll;
+    }
+    if (scroll < 0) {
+        scroll = 0;
+    }
+    if (scroll != ui.printer_scroll) {
+        ui.printer_scroll = scroll;
+        damage_paper();
+    }
+}
+
 static void print_line_feed()
 {
+    litton_ui_printer_line_t *line;
     ++(ui.printer_line);
-    if (ui.printer_line >= PRINTER_MAX_LINES) {
-        memmove(ui.printer_output[0], ui.printer_output[1],
-                (PRINTER_LINE_SIZE + 1) * (PRINTER_MAX_LINES - 1));
-        memset(ui.printer_output[PRINTER_MAX_LINES - 1], ' ',
-               PRINTER_LINE_SIZE);
-        --(ui.printer_line);
+    line = &(ui.printer_history[ui.printer_line % ui.printer_history_size]);
+    memset(line->text, ' ', PRINTER_LINE_SIZE);
+    memset(line->ribbon, RIBBON_BLACK, PRINTER_LINE_SIZE);
+    ui.printer_dirty[ui.printer_line % PRINTER_MAX_LINES] = 1;
+
+    /* Keep the view still if the paper has been scrolled back */
+    if (ui.printer_scroll > 0) {
+        scroll_paper(1);
     }
 }
 
-static void print_ascii(uint8_t ch)
+static void print_to_sink(const char *str, size_t len)
 {
     if (ui.print_to_stdout) {
-        putc(ch, stdout);
-        fflush(stdout);
+        litton_sink_write(ui.printer->sink, str, len);
     }
+}
+
+static void print_ascii(uint8_t ch)
+{
+    litton_ui_printer_line_t *line;
+    char buffer = (char)ch;
+    print_to_sink(&buffer, 1);
     if (ch == '\r') {
         ui.printer_column = 0;
     } else if (ch == '\n') {
-        if (ui.print_to_stdout) {
-            /* Space back over to the current printer column on the new line */
-            int col;
-            for (col = 0; col < ui.printer_column; ++col) {
-                putc(' ', stdout);
-            }
-            fflush(stdout);
+        /* Space back over to the current printer column on the new line */
+        int col;
+        for (col = 0; col < ui.printer_column; ++col) {
+            print_to_sink(" ", 1);
         }
         print_line_feed();
     } else if (ch == '\b') {
@@ -714,7 +1430,11 @@ static void print_ascii(uint8_t ch)
             ui.printer_column = 0;
             print_line_feed();
         }
-        ui.printer_output[ui.printer_line][ui.printer_column] = ch;
+        line = &(ui.printer_history
+                    [ui.printer_line % ui.printer_history_size]);
+        line->text[ui.printer_column] = ch;
+        line->ribbon[ui.printer_column] = ui.ribbon;
+        ui.printer_dirty[ui.printer_line % PRINTER_MAX_LINES] = 1;
         ++(ui.printer_column);
     }
 }
@@ -725,22 +1445,23 @@ static void print_string(const char *str)
         print_ascii(*str);
         ++str;
     }
+    damage_paper();
+    if (ui.print_to_stdout) {
+        litton_sink_flush(ui.printer->sink);
+    }
 }
 
-static void printer_output
-    (litton_state_t *state, litton_device_t *device,
-     uint8_t value, litton_parity_t parity)
+/**
+ * @brief Prints a character code that was sent to the printer by the
+ * machine, on the user interface thread.
+ *
+ * @param[in] value The character code, with the parity already removed.
+ * @param[in] printer_charset The printer character set that was in use
+ * when the machine sent the code.
+ */
+static void print_code(uint8_t value, litton_charset_t printer_charset)
 {
-    (void)device;
-    if (state->printer_charset == LITTON_CHARSET_EBS1231 &&
-            parity == LITTON_PARITY_NONE) {
-        /* Sometimes OPUS outputs a character with "OI" or "OA"
-         * that already has the parity bit set.  Strip it off. */
-        value = litton_remove_parity(value, LITTON_PARITY_ODD);
-    } else if (state->printer_charset != LITTON_CHARSET_HEX) {
-        value = litton_remove_parity(value, parity);
-    }
-    if (state->printer_charset == LITTON_CHARSET_EBS1231) {
+    if (printer_charset == LITTON_CHARSET_EBS1231) {
         /* Does this look like a print wheel position? */
         uint8_t position = litton_print_wheel_position(value);
         if (position != 0) {
@@ -752,7 +1473,7 @@ static void printer_output
             if (ui.print_to_stdout) {
                 while (position > ui.printer_column) {
                     if (isatty(0) && isatty(1)) {
-                        fputs("\033[C", stdout);
+                        print_to_sink("\033[C", 3);
                         ++ui.printer_column;
                     } else {
                         print_ascii(' ');
@@ -761,7 +1482,6 @@ static void printer_output
                 while (position < ui.printer_column) {
                     print_ascii('\b');
                 }
-                fflush(stdout);
             } else {
                 ui.printer_column = position;
             }
@@ -770,21 +1490,21 @@ static void printer_output
             print_ascii('\n');
         } else if (value == 056 || value == 074) {
             /* Change ribbon color */
+            ui.ribbon = (value == 056) ? RIBBON_BLACK : RIBBON_RED;
             if (ui.print_to_stdout && isatty(0) && isatty(1)) {
                 if (value == 056) {
                     /* Black ribbon print */
-                    fputs("\033[m", stdout);
+                    print_to_sink("\033[m", 3);
                 } else {
                     /* Red ribbon print */
-                    fputs("\033[31m", stdout);
+                    print_to_sink("\033[31m", 5);
                 }
-                fflush(stdout);
             }
         } else {
             /* Convert the code into its ASCII form */
             const char *string_form;
             int ch = litton_char_from_charset
-                (value, device->charset, &string_form);
+                (value, ui.printer->charset, &string_form);
             if (ch == '\f') {
                 /* Form feed; just output a carriage return and line feed */
                 print_ascii('\r');
@@ -797,7 +1517,7 @@ static void printer_output
                 /*print_string(string_form);*/
             }
         }
-    } else if (state->printer_charset == LITTON_CHARSET_HEX) {
+    } else if (printer_charset == LITTON_CHARSET_HEX) {
         /* Output bytes in hexadecimal */
         static const char hex_chars[] = "0123456789ABCDEF";
         if (ui.printer_column > 0) {
@@ -813,31 +1533,182 @@ static void printer_output
         /* Assume plain ASCII codes as input */
         print_ascii(value);
     }
+}
+
+/**
+ * @brief Prints all of the output that the run thread has queued up in
+ * the printer ring buffer.
+ *
+ * This must only be called from the user interface thread.
+ */
+static void drain_printer_output(void)
+{
+    unsigned tail = ui.printer_tail;
+    unsigned head = __atomic_load_n(&(ui.printer_head), __ATOMIC_ACQUIRE);
+    uint16_t entry;
+    if (tail == head) {
+        return;
+    }
+    while (tail != head) {
+        entry = ui.printer_ring[tail % PRINTER_RING_SIZE];
+        print_code((uint8_t)entry, (litton_charset_t)(entry >> 8));
+        ++tail;
+    }
+    __atomic_store_n(&(ui.printer_tail), tail, __ATOMIC_RELEASE);
+    damage_paper();
+    if (ui.print_to_stdout) {
+        litton_sink_flush(ui.printer->sink);
+    }
+}
+
+/**
+ * @brief Number of free entries in the printer ring buffer.
+ *
+ * This must only be called from the run thread.
+ */
+static unsigned printer_ring_space(void)
+{
+    return PRINTER_RING_SIZE -
+        (ui.printer_head -
+         __atomic_load_n(&(ui.printer_tail), __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief Queues a character code for the user interface thread to print.
+ *
+ * @param[in] value The character code, with the parity already removed.
+ * @param[in] printer_charset The printer character set for the code.
+ *
+ * This must only be called from the run thread.  The code is discarded
+ * if the ring buffer is full.
+ */
+static void queue_printer_code(uint8_t value, litton_charset_t printer_charset)
+{
+    unsigned head = ui.printer_head;
+    if (printer_ring_space() == 0) {
+        return;
+    }
+    ui.printer_ring[head % PRINTER_RING_SIZE] =
+        value | (((uint16_t)printer_charset) << 8);
+    __atomic_store_n(&(ui.printer_head), head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Queues a message for the user interface thread to print.
+ *
+ * @param[in] str The message, in ASCII.
+ *
+ * This must only be called from the run thread.
+ */
+static void queue_printer_string(const char *str)
+{
+    while (*str != '\0') {
+        queue_printer_code((uint8_t)(*str), LITTON_CHARSET_ASCII);
+        ++str;
+    }
+}
+
+static int printer_is_busy(litton_state_t *state, litton_device_t *device)
+{
+    /* Hold off the program while the user interface catches up */
+    (void)state;
+    (void)device;
+    return printer_ring_space() < PRINTER_RING_RESERVE;
+}
+
+static void printer_output
+    (litton_state_t *state, litton_device_t *device,
+     uint8_t value, litton_parity_t parity)
+{
+    (void)device;
+    if (state->printer_charset == LITTON_CHARSET_EBS1231 &&
+            parity == LITTON_PARITY_NONE) {
+        /* Sometimes OPUS outputs a character with "OI" or "OA"
+         * that already has the parity bit set.  Strip it off. */
+        value = litton_remove_parity(value, LITTON_PARITY_ODD);
+    } else if (state->printer_charset != LITTON_CHARSET_HEX) {
+        value = litton_remove_parity(value, parity);
+    }
+    queue_printer_code(value, state->printer_charset);
 
     /* Disable acceleration when printing */
     state->acceleration_counter = 0;
 }
 
+static unsigned keyboard_buffer_count(void)
+{
+    return __atomic_load_n(&(ui.keyboard_head), __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&(ui.keyboard_tail), __ATOMIC_ACQUIRE);
+}
+
+static void move_pending_input(void)
+{
+    unsigned head = ui.keyboard_head;
+    unsigned count = keyboard_buffer_count();
+    if (ui.keyboard_pending_posn >= ui.keyboard_pending_count) {
+        return;
+    }
+    if (snapshot_is_halted()) {
+        /* Keyboard input is suppressed when the machine is halted */
+        ui.keyboard_pending_count = 0;
+        ui.keyboard_pending_posn = 0;
+        return;
+    }
+    while (count < KEYBOARD_BUFFER_SIZE &&
+           ui.keyboard_pending_posn < ui.keyboard_pending_count) {
+        ui.keyboard_input[head % KEYBOARD_BUFFER_SIZE] =
+            ui.keyboard_pending[(ui.keyboard_pending_posn)++];
+        ++head;
+        ++count;
+    }
+    if (ui.keyboard_pending_posn >= ui.keyboard_pending_count) {
+        ui.keyboard_pending_count = 0;
+        ui.keyboard_pending_posn = 0;
+    }
+    __atomic_store_n(&(ui.keyboard_head), head, __ATOMIC_RELEASE);
+    wake_run_thread();
+}
+
 static void process_input_char(uint8_t value)
 {
-    if (ui.keyboard_count < KEYBOARD_BUFFER_SIZE) {
-        ui.keyboard_input[(ui.keyboard_count)++] = value;
-    } else {
-        /* Keyboard input buffer is full, so drop the oldest character */
-        memmove(ui.keyboard_input, ui.keyboard_input + 1,
-                KEYBOARD_BUFFER_SIZE - 1);
-        ui.keyboard_input[KEYBOARD_BUFFER_SIZE - 1] = value;
+    unsigned head = ui.keyboard_head;
+
+    /* Bring the current line back into view when the user types */
+    scroll_paper(-(ui.printer_scroll));
+    if (ui.keyboard_pending_count == 0 &&
+            keyboard_buffer_count() < KEYBOARD_BUFFER_SIZE) {
+        /* Add the character directly to the keyboard input buffer */
+        ui.keyboard_input[head % KEYBOARD_BUFFER_SIZE] = value;
+        __atomic_store_n(&(ui.keyboard_head), head + 1, __ATOMIC_RELEASE);
+        wake_run_thread();
+        return;
+    }
+
+    /* Buffer is full, so hold the character until there is space */
+    if (ui.keyboard_pending_count >= ui.keyboard_pending_max) {
+        size_t new_max = ui.keyboard_pending_max ?
+                         ui.keyboard_pending_max * 2 : 4096;
+        uint8_t *new_pending = realloc(ui.keyboard_pending, new_max);
+        if (!new_pending) {
+            return;
+        }
+        ui.keyboard_pending = new_pending;
+        ui.keyboard_pending_max = new_max;
     }
+    ui.keyboard_pending[(ui.keyboard_pending_count)++] = value;
 }
 
 static void process_ascii_input(char ch, int allow_control_chars)
 {
+    litton_ui_snapshot_t snapshot;
     size_t posn = 0;
     int ch2;
     if ((ch & 0xFF) < 0x20 && !allow_control_chars) {
         return;
     }
-    ch2 = litton_char_to_charset(&ch, &posn, 1, machine.keyboard_charset);
+    read_snapshot(&snapshot);
+    ch2 = litton_char_to_charset
+        (&ch, &posn, 1, (litton_charset_t)(snapshot.keyboard_charset));
     if (ch2 >= 0) {
         process_input_char((uint8_t)ch2);
     }
@@ -845,14 +1716,38 @@ static void process_ascii_input(char ch, int allow_control_chars)
 
 static void process_ebs1231_code(uint8_t value)
 {
-    if (machine.keyboard_charset == LITTON_CHARSET_EBS1231) {
+    litton_ui_snapshot_t snapshot;
+    read_snapshot(&snapshot);
+    if (snapshot.keyboard_charset == LITTON_CHARSET_EBS1231) {
         process_input_char(value);
     }
 }
 
+static void process_paste(void)
+{
+    char *text;
+    char *posn;
+    if (snapshot_is_halted() || !SDL_HasClipboardText()) {
+        return;
+    }
+    text = SDL_GetClipboardText();
+    if (!text) {
+        return;
+    }
+    for (posn = text; *posn != '\0'; ++posn) {
+        if (*posn == '\n') {
+            /* End of line in the pasted text is an ordinary ENTER */
+            process_ascii_input('\r', 1);
+        } else if (*posn != '\r') {
+            process_ascii_input(*posn, 0);
+        }
+    }
+    SDL_free(text);
+}
+
 static void process_text_input(const char *text)
 {
-    if (!litton_is_halted(&machine)) {
+    if (!snapshot_is_halted()) {
         while (*text != '\0') {
             process_ascii_input(*text, 0);
             ++text;
@@ -862,7 +1757,7 @@ static void process_text_input(const char *text)
 
 static void process_key(SDL_Keysym keysym)
 {
-    if (litton_is_halted(&machine)) {
+    if (snapshot_is_halted()) {
         /* Keyboard input is suppressed when the machine is halted */
         return;
     }
@@ -879,6 +1774,20 @@ static void process_key(SDL_Keysym keysym)
         process_ascii_input('\b', 1);
         break;
 
+    case SDLK_v:
+        /* CTRL-V - paste text from the clipboard */
+        if ((keysym.mod & KMOD_CTRL) != 0) {
+            process_paste();
+        }
+        break;
+
+    case SDLK_INSERT:
+        /* SHIFT-INSERT - paste text from the clipboard */
+        if ((keysym.mod & KMOD_SHIFT) != 0) {
+            process_paste();
+        }
+        break;
+
     case SDLK_h:
         /* CTRL-H - backspace */
         if ((keysym.mod & KMOD_CTRL) != 0) {
@@ -1052,12 +1961,17 @@ static int keyboard_input
     (litton_state_t *state, litton_device_t *device,
      uint8_t *value, litton_parity_t parity)
 {
-    (void)state;
+    unsigned tail = ui.keyboard_tail;
     (void)device;
-    if (ui.keyboard_count > 0) {
-        *value = litton_add_parity(ui.keyboard_input[0], parity);
-        --(ui.keyboard_count);
-        memmove(ui.keyboard_input, ui.keyboard_input + 1, ui.keyboard_count);
+    if (tail != __atomic_load_n(&(ui.keyboard_head), __ATOMIC_ACQUIRE)) {
+        *value = litton_add_parity
+            (ui.keyboard_input[tail % KEYBOARD_BUFFER_SIZE], parity);
+        __atomic_store_n(&(ui.keyboard_tail), tail + 1, __ATOMIC_RELEASE);
+
+        /* Stay at full speed while working through pasted text */
+        if (tail + 1 != __atomic_load_n(&(ui.keyboard_head), __ATOMIC_ACQUIRE)) {
+            litton_accelerate(state);
+        }
         return 1;
     }
     return 0;
@@ -1067,81 +1981,17 @@ static int paper_tape_input
     (litton_state_t *state, litton_device_t *device,
      uint8_t *value, litton_parity_t parity)
 {
-    char buffer[16];
-    int ch, lastch;
-    size_t posn, len;
     (void)state;
 
     /* Bail out if the paper tape input is not mounted */
-    if (device->file == NULL) {
-        /* Highlight the tape input button */
-        ui.need_paper_tape_input = HIGHLIGHT_BUTTON_FRAMES;
+    if (device->tape_data == NULL) {
+        /* Ask the user interface to highlight the tape input button */
+        ++(ui.tape_input_requests);
         return 0;
     }
 
-    /* Read the next character from the tape and decode it */
-    ch = getc(device->file);
-    if (ch != EOF) {
-        if (device->charset == LITTON_CHARSET_EBS1231) {
-            buffer[0] = (char)ch;
-            len = 1;
-            if (ch == '[') {
-                /* Special function key sequence [x] */
-                lastch = ']';
-            } else if (ch == '{') {
-                /* Printer position sequence {n} */
-                lastch = '}';
-            } else {
-                /* Singleton character */
-                lastch = 0;
-            }
-            while (lastch && len < sizeof(buffer)) {
-                ch = getc(device->file);
-                if (ch == EOF) {
-                    break;
-                } else if (ch == lastch) {
-                    buffer[len++] = (char)ch;
-                    break;
-                }
-                buffer[len++] = (char)ch;
-            }
-            posn = 0;
-            ch = litton_char_to_charset
-                (buffer, &posn, len, LITTON_CHARSET_EBS1231);
-            if (ch >= 0) {
-                /* Add parity and return the character to the caller */
-                *value = litton_add_parity(ch, parity);
-
-                /* Lookahead to the next input byte and close the file
-                 * now if we have reached EOF.  OPUS stops reading a
-                 * tape when it sees ',' and we don't want to leave the
-                 * file open if no more reading will occur. */
-                ch = getc(device->file);
-                if (ch == EOF) {
-                    fclose(device->file);
-                    device->file = 0;
-                } else {
-                    ungetc(ch, device->file);
-                }
-                return 1;
-            }
-            return 0;
-        } else {
-            /* Plain ASCII tape */
-            if (device->charset == LITTON_CHARSET_UASCII) {
-                if (ch >= 'a' && ch <= 'z') {
-                    ch = ch - 'a' + 'A';
-                }
-            }
-            *value = litton_add_parity(ch, parity);
-            return 1;
-        }
-    }
-
-    /* File is exhausted, so close it */
-    fclose(device->file);
-    device->file = 0;
-    return 0;
+    /* Read the next character from the tape */
+    return litton_read_input_tape(device, value, parity);
 }
 
 static int paper_tape_output_is_busy
@@ -1155,7 +2005,7 @@ static int paper_tape_output_is_busy
         return 0;
     } else {
         /* No paper tape output file mounted */
-        ui.need_paper_tape_output = HIGHLIGHT_BUTTON_FRAMES;
+        ++(ui.tape_output_requests);
         return 1;
     }
 }
@@ -1165,17 +2015,19 @@ static void paper_tape_output
      uint8_t value, litton_parity_t parity)
 {
     int ch;
+    char buffer;
     const char *string_form;
     if (device->file != 0) {
-        /* Convert the value into the right character set and output it */
+        /* Convert the value into the right character set and write it
+         * to the tape file's sink */
         value = litton_remove_parity(value, parity);
         ch = litton_char_from_charset(value, device->charset, &string_form);
         if (ch == -2) {
-            fputs(string_form, device->file);
+            litton_sink_write(device->sink, string_form, strlen(string_form));
         } else {
-            putc(ch, device->file);
+            buffer = (char)ch;
+            litton_sink_write(device->sink, &buffer, 1);
         }
-        fflush(device->file);
 
         /* Accelerate the machine when writing to tape files */
         litton_accelerate(state);
@@ -1185,6 +2037,7 @@ static void paper_tape_output
 static void create_devices(void)
 {
     litton_device_t *device;
+    int line;
 
     /* Create the printer device for redirecting output to the UI */
     device = calloc(1, sizeof(litton_device_t));
@@ -1192,16 +2045,26 @@ static void create_devices(void)
     device->supports_input = 0;
     device->supports_output = 1;
     device->charset = machine.printer_charset;
+    device->is_busy = printer_is_busy;
     device->output = printer_output;
+    if (ui.print_to_stdout) {
+        litton_set_device_sink(device, litton_create_file_sink(stdout, 0));
+    }
     litton_add_device(&machine, device);
-    memset(ui.printer_output, ' ', sizeof(ui.printer_output));
+    ui.printer = device;
 
     /* Start at the bottom of the print area and gradually scroll up */
     ui.printer_column = 0;
-    ui.printer_line = PRINTER_MAX_LINES - 1;
+    ui.printer_line = 0;
+    ui.printer_scroll = 0;
+    memset(ui.printer_history[0].text, ' ', PRINTER_LINE_SIZE);
+    for (line = 0; line < PRINTER_MAX_LINES; ++line) {
+        ui.printer_cache_line[line] = -1;
+    }
 
     /* Create the keyboard device for redirecting input from the UI */
-    ui.keyboard_count = 0;
+    ui.keyboard_head = 0;
+    ui.keyboard_tail = 0;
     device = calloc(1, sizeof(litton_device_t));
     device->id = LITTON_DEVICE_KEYBOARD;
     device->supports_input = 1;
@@ -1233,8 +2096,9 @@ static void create_devices(void)
 /* Use the external tool "zenity" to handle the file dialog */
 #define DRUM_LOAD_CMD "zenity --file-selection --file-filter='*.drum'"
 #define DRUM_SAVE_CMD "zenity --file-selection --save --confirm-overwrite --file-filter='*.drum'"
-#define TAPE_IN_CMD "zenity --file-selection --file-filter='*.tape'"
+#define TAPE_IN_CMD "zenity --file-selection --file-filter='*.tape *.bin *.raw'"
 #define TAPE_OUT_CMD "zenity --file-selection --save --confirm-overwrite --file-filter='*.tape'"
+#define PRINTER_SAVE_CMD "zenity --file-selection --save --confirm-overwrite --file-filter='*.txt'"
 
 static char *ask_for_filename(const char *cmdline)
 {
@@ -1259,139 +2123,400 @@ static char *ask_for_filename(const char *cmdline)
     return strdup(buffer);
 }
 
+/**
+ * @brief Saves the printer history to a text file.
+ *
+ * @param[in] filename Name of the file to save to.
+ *
+ * @return Non-zero if the history was saved, or zero on error.
+ */
+static int save_printer_history(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    const litton_ui_printer_line_t *line;
+    long number = ui.printer_line - ui.printer_history_size + 1;
+    int ok;
+    if (!file) {
+        return 0;
+    }
+    if (number < 0) {
+        number = 0;
+    }
+    for (; number <= ui.printer_line; ++number) {
+        line = printer_history_line(number);
+        fwrite(line->text, 1, printer_line_length(line), file);
+        putc('\n', file);
+    }
+    ok = !ferror(file);
+    ok &= (fclose(file) == 0);
+    return ok;
+}
+
+/**
+ * @brief Asks the user for a filename and then saves the printer
+ * history to it.
+ */
+static void export_printer_history(void)
+{
+    char *filename = ask_for_filename(PRINTER_SAVE_CMD);
+    if (filename) {
+        print_string(filename);
+        if (save_printer_history(filename)) {
+            print_string(" saved\r\n");
+        } else {
+            print_string(" failed to save\r\n");
+        }
+        free(filename);
+    }
+}
+
+/**
+ * @brief Handles keys that control the printer paper rather than being
+ * passed to the machine.
+ *
+ * @param[in] keysym The key that was pressed.
+ *
+ * @return Non-zero if the key was handled, or zero if it is for the machine.
+ */
+static int process_paper_key(SDL_Keysym keysym)
+{
+    if (keysym.sym == SDLK_s && (keysym.mod & KMOD_CTRL) != 0) {
+        /* CTRL-S - save the printer history to a file */
+        export_printer_history();
+        return 1;
+    } else if (keysym.sym == SDLK_PAGEUP && (keysym.mod & KMOD_SHIFT) != 0) {
+        /* SHIFT-PAGEUP - scroll back through the printer history */
+        scroll_paper(PRINTER_MAX_LINES - 1);
+        return 1;
+    } else if (keysym.sym == SDLK_PAGEDOWN &&
+               (keysym.mod & KMOD_SHIFT) != 0) {
+        /* SHIFT-PAGEDOWN - scroll forward through the printer history */
+        scroll_paper(-(PRINTER_MAX_LINES - 1));
+        return 1;
+    }
+    return 0;
+}
+
 static void handle_other_button(uint32_t button)
 {
-    char *filename = 0;
+    char *filename;
     switch (button) {
     case LITTON_BUTTON_DRUM_LOAD:
-        if (!litton_is_halted(&machine)) {
+        if (!snapshot_is_halted()) {
             /* Machine must be halted for this */
             break;;
         }
         filename = ask_for_filename(DRUM_LOAD_CMD);
         if (filename) {
-            SDL_LockMutex(ui.mutex);
-            litton_clear_memory(&machine);
-            if (litton_load_drum(&machine, filename, 0)) {
-                litton_reset(&machine);
-                SDL_UnlockMutex(ui.mutex);
-                print_string(filename);
-                print_string(" loaded\r\n");
-            } else {
-                SDL_UnlockMutex(ui.mutex);
-                print_string(filename);
-                print_string(" failed to load\r\n");
-            }
+            send_command(UI_COMMAND_LOAD_DRUM, 0, filename);
         }
         break;
 
     case LITTON_BUTTON_DRUM_SAVE:
-        if (!litton_is_halted(&machine)) {
+        if (!snapshot_is_halted()) {
             /* Machine must be halted for this */
             break;;
         }
         filename = ask_for_filename(DRUM_SAVE_CMD);
         if (filename) {
-            SDL_LockMutex(ui.mutex);
-            if (litton_save_drum(&machine, filename)) {
-                SDL_UnlockMutex(ui.mutex);
-                print_string(filename);
-                print_string(" saved\r\n");
-            } else {
-                SDL_UnlockMutex(ui.mutex);
-                print_string(filename);
-                print_string(" failed to save\r\n");
-            }
+            send_command(UI_COMMAND_SAVE_DRUM, 0, filename);
         }
         break;
 
     case LITTON_BUTTON_TAPE_IN:
         filename = ask_for_filename(TAPE_IN_CMD);
-        SDL_LockMutex(ui.mutex);
-        litton_close_input_tape(&machine);
-        if (filename) {
-            litton_set_input_tape(&machine, filename);
-        }
-        SDL_UnlockMutex(ui.mutex);
+        send_command(UI_COMMAND_TAPE_IN, 0, filename);
         break;
 
     case LITTON_BUTTON_TAPE_OUT:
         filename = ask_for_filename(TAPE_OUT_CMD);
-        SDL_LockMutex(ui.mutex);
-        litton_close_output_tape(&machine);
-        if (filename) {
-            litton_set_output_tape(&machine, filename, 0);
+        send_command(UI_COMMAND_TAPE_OUT, 0, filename);
+        break;
+    }
+}
+
+/**
+ * @brief Executes a command from the user interface on the run thread.
+ *
+ * @param[in,out] state Points to the machine state.
+ * @param[in] command The command to execute.
+ */
+static void run_command(litton_state_t *state, litton_ui_command_t *command)
+{
+    switch (command->type) {
+    case UI_COMMAND_PRESS_BUTTON:
+        litton_press_button(state, command->button);
+        break;
+
+    case UI_COMMAND_LOAD_DRUM:
+        if (!litton_is_halted(state)) {
+            /* Machine was started again before the command arrived */
+            break;
+        }
+        litton_clear_memory(state);
+        queue_printer_string(command->filename);
+        if (litton_load_drum(state, command->filename, 0)) {
+            litton_reset(state);
+            queue_printer_string(" loaded\r\n");
+        } else {
+            queue_printer_string(" failed to load\r\n");
+        }
+        break;
+
+    case UI_COMMAND_SAVE_DRUM:
+        if (!litton_is_halted(state)) {
+            /* Machine was started again before the command arrived */
+            break;
+        }
+        queue_printer_string(command->filename);
+        if (litton_save_drum(state, command->filename)) {
+            queue_printer_string(" saved\r\n");
+        } else {
+            queue_printer_string(" failed to save\r\n");
+        }
+        break;
+
+    case UI_COMMAND_TAPE_IN:
+        litton_close_input_tape(state);
+        if (command->filename) {
+            litton_set_input_tape(state, command->filename);
+        }
+        break;
+
+    case UI_COMMAND_TAPE_OUT:
+        litton_close_output_tape(state);
+        if (command->filename) {
+            litton_set_output_tape(state, command->filename, 0);
         }
-        SDL_UnlockMutex(ui.mutex);
         break;
     }
-    if (filename) {
-        free(filename);
+    free(command->filename);
+}
+
+/**
+ * @brief Executes all of the commands that are waiting in the queue
+ * from the user interface thread.
+ *
+ * @param[in,out] state Points to the machine state.
+ *
+ * @return Non-zero if at least one command was executed.
+ */
+static int run_commands(litton_state_t *state)
+{
+    unsigned tail = ui.command_tail;
+    unsigned head = __atomic_load_n(&(ui.command_head), __ATOMIC_ACQUIRE);
+    if (tail == head) {
+        return 0;
+    }
+    while (tail != head) {
+        run_command(state, &(ui.commands[tail % COMMAND_QUEUE_SIZE]));
+        ++tail;
     }
+    __atomic_store_n(&(ui.command_tail), tail, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * @brief Waits for the user interface thread to wake up the run thread.
+ *
+ * @param[in] timeout Maximum number of milliseconds to wait.
+ */
+static void wait_for_wakeup(Uint32 timeout)
+{
+    SDL_SemWaitTimeout(ui.wakeup, timeout);
+    __atomic_store_n(&(ui.wakeup_pending), 0, __ATOMIC_SEQ_CST);
 }
 
+/**
+ * @brief Number of machine cycles to run before publishing a new snapshot
+ * of the machine state and checking for commands from the user interface
+ * thread, when the speed is unlimited.
+ */
+#define RUN_SLICE_CYCLES 10000
+
+/**
+ * @brief Maximum number of milliseconds to wait for input when the
+ * program is idle before checking again.
+ */
+#define IDLE_WAIT_MS 100
+
+/**
+ * @brief Maximum number of milliseconds to wait for a command from the
+ * user interface when the machine is halted before checking again.
+ */
+#define HALTED_WAIT_MS 20
+
 static int run_litton(void *data)
 {
     litton_state_t *state = (litton_state_t *)data;
+    litton_run_reason_t reason;
     int was_running = 0;
-    uint64_t elapsed_ns;
-    uint64_t checkpoint_counter;
-    struct timespec checkpoint_time;
-    struct timespec sleep_to_time;
-    struct timespec now_time;
+    uint64_t slice;
+
+    litton_pacer_init(&ui.pacer, state, ui.speed);
+    slice = litton_pacer_quantum_cycles(&ui.pacer);
+    if (!slice) {
+        slice = RUN_SLICE_CYCLES;
+    }
 
-    checkpoint_counter = state->cycle_counter;
-    clock_gettime(CLOCK_MONOTONIC, &checkpoint_time);
+    /* Stop running when the program is idle, waiting for input */
+    state->stop_on_idle = 1;
 
-    while (!ui.quit) {
-        SDL_LockMutex(ui.mutex);
+    while (!__atomic_load_n(&(ui.quit), __ATOMIC_ACQUIRE)) {
+        /* Execute button presses and other commands from the user */
+        if (run_commands(state)) {
+            publish_snapshot(state, 0);
+        }
         if (litton_is_halted(state)) {
             /* Nothing to do if we are not currently running */
-            SDL_UnlockMutex(ui.mutex);
-            usleep(20000); /* Sleep for 20ms and check again */
+            wait_for_wakeup(HALTED_WAIT_MS);
             was_running = 0;
 
             /* Keyboard input is suppressed when halted */
-            ui.keyboard_count = 0;
+            __atomic_store_n(&(ui.keyboard_tail),
+                             __atomic_load_n(&(ui.keyboard_head),
+                                             __ATOMIC_ACQUIRE),
+                             __ATOMIC_RELEASE);
         } else {
             /* Re-establish the checkpoint if we just started running */
             if (!was_running) {
-                checkpoint_counter = state->cycle_counter;
-                clock_gettime(CLOCK_MONOTONIC, &checkpoint_time);
+                litton_pacer_resync(&ui.pacer, state);
                 was_running = 1;
             }
 
-            /* Run a single instruction step */
-            litton_step(state);
-            litton_update_status_lights(state);
-            SDL_UnlockMutex(ui.mutex);
-
-            /* Simulate the actual speed of the computer */
-            elapsed_ns = (state->cycle_counter - checkpoint_counter) * 1000;
-            sleep_to_time = checkpoint_time;
-            sleep_to_time.tv_nsec += elapsed_ns % 1000000000;
-            sleep_to_time.tv_sec += elapsed_ns / 1000000000;
-            while (sleep_to_time.tv_nsec >= 1000000000) {
-                sleep_to_time.tv_nsec -= 1000000000;
-                ++(sleep_to_time.tv_sec);
+            /* Run a quantum of instructions.  Illegal instructions and
+             * spinning are ignored; we keep going until halted. */
+            reason = litton_run(state, slice, 0, NULL);
+            litton_flush_devices(state);
+            publish_snapshot(state, reason == LITTON_RUN_IDLE);
+
+            /* If the program is idle, then sleep until the user interface
+             * has new input for us and then resynchronise the clock */
+            if (reason == LITTON_RUN_IDLE) {
+                wait_for_wakeup(IDLE_WAIT_MS);
+                litton_pacer_resync(&ui.pacer, state);
+                continue;
             }
-            clock_gettime(CLOCK_MONOTONIC, &now_time);
-            if (state->acceleration_counter != 0 ||
-                    now_time.tv_sec > sleep_to_time.tv_sec ||
-                    (now_time.tv_sec == sleep_to_time.tv_sec &&
-                     now_time.tv_nsec >= sleep_to_time.tv_nsec)) {
-                /* Deadline has already passed, so resynchronise on "now" */
-                checkpoint_counter = state->cycle_counter;
-                checkpoint_time = now_time;
+
+            /* Simulate the actual speed of the computer, unless we
+             * are working through pasted text */
+            if (keyboard_buffer_count() > 1) {
+                litton_pacer_resync(&ui.pacer, state);
             } else {
-                clock_nanosleep
-                    (CLOCK_MONOTONIC, TIMER_ABSTIME, &sleep_to_time, NULL);
+                litton_pacer_wait(&ui.pacer, state);
             }
         }
     }
     return 0;
 }
 
+/**
+ * @brief Handles an event from SDL.
+ *
+ * @param[in] event The event.
+ */
+static void handle_event(const SDL_Event *event)
+{
+    if (event->type == SDL_QUIT) {
+        __atomic_store_n(&(ui.quit), 1, __ATOMIC_RELEASE);
+    } else if (event->type == SDL_MOUSEBUTTONDOWN &&
+               ui.selected_button == 0) {
+        ui.selected_button = get_button(event->button.x, event->button.y);
+        set_pressed_button(ui.selected_button);
+    } else if (event->type == SDL_MOUSEBUTTONUP &&
+               ui.selected_button != 0) {
+        if (ui.pressed_button == ui.selected_button) {
+            send_command(UI_COMMAND_PRESS_BUTTON, ui.selected_button, NULL);
+            handle_other_button(ui.selected_button);
+        }
+        set_pressed_button(0);
+        ui.selected_button = 0;
+    } else if (event->type == SDL_MOUSEMOTION &&
+               ui.selected_button != 0) {
+        if (get_button(event->button.x, event->button.y) ==
+                ui.selected_button) {
+            set_pressed_button(ui.selected_button);
+        } else {
+            set_pressed_button(0);
+        }
+    } else if (event->type == SDL_RENDER_TARGETS_RESET) {
+        /* The contents of the panel and line caches have been lost */
+        invalidate_printer_lines();
+        add_damage(NULL);
+    } else if (event->type == SDL_WINDOWEVENT) {
+        /* Redraw everything if the window is exposed or resized */
+        add_damage(NULL);
+    } else if (event->type == SDL_MOUSEWHEEL) {
+        /* Scroll the printer paper; positive is away from the user */
+        long lines = event->wheel.y;
+        if (event->wheel.direction == SDL_MOUSEWHEEL_FLIPPED) {
+            lines = -lines;
+        }
+        scroll_paper(lines * PRINTER_WHEEL_LINES);
+    } else if (event->type == SDL_TEXTINPUT) {
+        process_text_input(event->text.text);
+    } else if (event->type == SDL_KEYDOWN) {
+        if (!process_paper_key(event->key.keysym)) {
+            process_key(event->key.keysym);
+        }
+    }
+}
+
+/**
+ * @brief Determine how long to wait for events before the next frame.
+ *
+ * @return The number of milliseconds to wait.
+ *
+ * While the machine is running, frames are drawn at a fixed rate and
+ * presenting them is also paced by vsync.  When the machine is halted
+ * or the program is idle, the user interface thread blocks until there
+ * is an event or the run thread tells it that something has changed.
+ */
+static int frame_timeout(void)
+{
+    Uint32 now = SDL_GetTicks();
+    Uint32 timeout, left;
+
+    /* Keep going if there is held-back input to move into the buffer */
+    if (ui.keyboard_pending_count > 0) {
+        return FRAME_MS;
+    }
+
+    /* Wait for the next frame while the machine is running */
+    if (!ui.shown.halted && !ui.shown.idle) {
+        if (!ticks_until(ui.next_frame, now)) {
+            ui.next_frame += FRAME_MS;
+            if (!ticks_until(ui.next_frame, now)) {
+                /* We have fallen behind, so start counting again */
+                ui.next_frame = now + FRAME_MS;
+            }
+        }
+        return (int)ticks_until(ui.next_frame, now);
+    }
+
+    /* Block until the next event, but wake up when the tape button
+     * highlights are due to expire */
+    timeout = IDLE_FRAME_MS;
+    left = ticks_until(ui.tape_input_highlight_end, now);
+    if (left != 0 && left < timeout) {
+        timeout = left;
+    }
+    left = ticks_until(ui.tape_output_highlight_end, now);
+    if (left != 0 && left < timeout) {
+        timeout = left;
+    }
+
+    /* Ask the run thread to wake us up if the state changes, and then
+     * check that it didn't change while we were deciding to block */
+    __atomic_store_n(&(ui.ui_sleeping), 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(ui.snapshot.sequence), __ATOMIC_SEQ_CST) !=
+            ui.shown.sequence) {
+        __atomic_store_n(&(ui.ui_sleeping), 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return (int)timeout;
+}
+
 int main(int argc, char *argv[])
 {
     const char *progname = argv[0];
@@ -1400,22 +2525,60 @@ int main(int argc, char *argv[])
     int exit_status = 0;
     int width, height;
     int wait_status;
+    const char *io_timings[MAX_IO_TIMINGS];
+    int num_io_timings = 0;
+    int n;
     int opt;
+    char *endptr;
     SDL_Event event;
     SDL_Color color = {0, 0, 0, 255};
     SDL_Surface *surface;
 
     /* Initialize the machine */
     litton_init(&machine);
+    ui.speed = 1;
 
     /* Process the command-line options */
-    while ((opt = getopt(argc, argv, "mvs")) != -1) {
+    ui.printer_history_size = PRINTER_HISTORY_LINES;
+    ui.printer_face = FACE_BOLD;
+    while ((opt = getopt(argc, argv, "mvsr:H:I:F:")) != -1) {
         if (opt == 'm') {
             maximized_mode = 1;
         } else if (opt == 'v') {
             machine.disassemble = 1;
         } else if (opt == 's') {
             ui.print_to_stdout = 1;
+        } else if (opt == 'r') {
+            if (!litton_speed_from_name(&ui.speed, optarg, strlen(optarg))) {
+                fprintf(stderr, "%s: invalid speed\n", optarg);
+                litton_free(&machine);
+                return 1;
+            }
+        } else if (opt == 'H') {
+            ui.printer_history_size = strtol(optarg, &endptr, 10);
+            if (*optarg == '\0' || *endptr != '\0' ||
+                    ui.printer_history_size < PRINTER_MAX_LINES) {
+                fprintf(stderr, "%s: invalid history size\n", optarg);
+                litton_free(&machine);
+                return 1;
+            }
+        } else if (opt == 'I') {
+            if (num_io_timings >= MAX_IO_TIMINGS) {
+                fprintf(stderr, "%s: too many I/O timing options\n", progname);
+                litton_free(&machine);
+                return 1;
+            }
+            io_timings[num_io_timings++] = optarg;
+        } else if (opt == 'F') {
+            if (!strcmp(optarg, "regular")) {
+                ui.printer_face = FACE_REGULAR;
+            } else if (!strcmp(optarg, "bold")) {
+                ui.printer_face = FACE_BOLD;
+            } else {
+                fprintf(stderr, "%s: invalid font face\n", optarg);
+                litton_free(&machine);
+                return 1;
+            }
         } else {
             usage(progname);
             litton_free(&machine);
@@ -1434,6 +2597,23 @@ int main(int argc, char *argv[])
         /* No drum image, so load the default OPUS image instead */
         litton_load_opus(&machine);
     }
+
+    /* Apply the I/O timing options, which override the drum image */
+    for (n = 0; n < num_io_timings; ++n) {
+        if (!litton_parse_io_timing
+                (&machine, io_timings[n], strlen(io_timings[n]))) {
+            fprintf(stderr, "%s: invalid I/O timing\n", io_timings[n]);
+            litton_free(&machine);
+            return 1;
+        }
+    }
+    ui.printer_history = calloc
+        (ui.printer_history_size, sizeof(litton_ui_printer_line_t));
+    if (!ui.printer_history) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        litton_free(&machine);
+        return 1;
+    }
     create_devices();
 
     /* Create the SDL infrastructure for video output */
@@ -1528,69 +2708,79 @@ int main(int argc, char *argv[])
          SDL_RWFromConstMem(front_panel_knob_I_32_png,
                             front_panel_knob_I_32_png_len), 1);
 
+    /* The lit lamps are blended over the background at varying levels */
+    SDL_SetTextureBlendMode(ui.image_lamps, SDL_BLENDMODE_BLEND);
+
     /* Need text input to get ASCII out of the keypresses */
     SDL_StartTextInput();
 
-    /* Load the font for the printer output */
+    /* Load the fonts for the printer output */
     TTF_Init();
-    ui.font = TTF_OpenFontRW
+    ui.fonts[FACE_REGULAR] = TTF_OpenFontRW
+        (SDL_RWFromConstMem(___fonts_DotMatrix_Regular_ttf,
+                            ___fonts_DotMatrix_Regular_ttf_len), 1, 14);
+    ui.fonts[FACE_BOLD] = TTF_OpenFontRW
         (SDL_RWFromConstMem(___fonts_DotMatrix_Bold_ttf,
                             ___fonts_DotMatrix_Bold_ttf_len), 1, 14);
-    surface = TTF_RenderText_Solid(ui.font, "LITTON", color);
+    surface = TTF_RenderText_Solid(ui.fonts[FACE_BOLD], "LITTON", color);
     ui.font_width = surface->w / 6;
     ui.font_height = surface->h;
     SDL_FreeSurface(surface);
+    create_printer_glyphs();
+
+    /* Create the texture for compositing the panel into, and draw the
+     * whole window on the first frame */
+    ui.panel = SDL_CreateTexture
+        (ui.renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+         width, height);
+    add_damage(NULL);
 
-    /* Create the background thread for running Litton programs */
-    ui.mutex = SDL_CreateMutex();
+    /* Create the semaphore for waking up the background thread, and the
+     * event for the background thread to wake up the user interface */
+    ui.wakeup = SDL_CreateSemaphore(0);
+    ui.refresh_event = SDL_RegisterEvents(1);
 
-    /* Reset the machine */
+    /* Reset the machine and publish its initial state */
     litton_reset(&machine);
+    litton_lamp_sampler_init(&(ui.lamp_sampler), &machine);
+    publish_snapshot(&machine, 0);
 
     /* Create the run thread */
     ui.run_thread = SDL_CreateThread(run_litton, "litton", &machine);
 
     /* Main SDL loop */
-    ui.quit = 0;
+    ui.next_frame = SDL_GetTicks();
     while (!ui.quit) {
-        /* Draw the current screen contents */
+        /* Move held-back input into the keyboard buffer as space frees up */
+        move_pending_input();
+
+        /* Print the output that the machine has produced since last time */
+        drain_printer_output();
+
+        /* Redraw the parts of the screen that have changed */
+        update_damage();
         draw_screen();
 
-        /* Process input events */
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                ui.quit = 1;
-            } else if (event.type == SDL_MOUSEBUTTONDOWN &&
-                       ui.selected_button == 0) {
-                ui.selected_button = get_button(event.button.x, event.button.y);
-                ui.pressed_button = ui.selected_button;
-            } else if (event.type == SDL_MOUSEBUTTONUP &&
-                       ui.selected_button != 0) {
-                if (ui.pressed_button == ui.selected_button) {
-                    SDL_LockMutex(ui.mutex);
-                    litton_press_button(&machine, ui.selected_button);
-                    SDL_UnlockMutex(ui.mutex);
-                    handle_other_button(ui.selected_button);
-                }
-                ui.pressed_button = 0;
-                ui.selected_button = 0;
-            } else if (event.type == SDL_MOUSEMOTION &&
-                       ui.selected_button != 0) {
-                ui.pressed_button = get_button(event.button.x, event.button.y);
-                if (ui.pressed_button != ui.selected_button) {
-                    ui.pressed_button = 0;
-                }
-            } else if (event.type == SDL_TEXTINPUT) {
-                process_text_input(event.text.text);
-            } else if (event.type == SDL_KEYDOWN) {
-                process_key(event.key.keysym);
-            }
+        /* Wait for the next frame or an input event */
+        if (SDL_WaitEventTimeout(&event, frame_timeout())) {
+            do {
+                handle_event(&event);
+            } while (SDL_PollEvent(&event));
         }
+        __atomic_store_n(&(ui.ui_sleeping), 0, __ATOMIC_RELAXED);
     }
 
     /* Wait for the background thread to stop */
+    wake_run_thread();
     SDL_WaitThread(ui.run_thread, &wait_status);
 
+    /* Print any output that was left behind by the background thread,
+     * and free the filenames in any commands that were never executed */
+    drain_printer_output();
+    while (ui.command_tail != ui.command_head) {
+        free(ui.commands[(ui.command_tail)++ % COMMAND_QUEUE_SIZE].filename);
+    }
+
     /* Clean up and exit */
     SDL_DestroyTexture(ui.image_bg);
     SDL_DestroyTexture(ui.image_lamps);
@@ -1607,11 +2797,18 @@ int main(int argc, char *argv[])
     SDL_DestroyTexture(ui.image_knob_I16);
     SDL_DestroyTexture(ui.image_knob_I24);
     SDL_DestroyTexture(ui.image_knob_I32);
-    TTF_CloseFont(ui.font);
+    if (ui.panel) {
+        SDL_DestroyTexture(ui.panel);
+    }
+    destroy_printer_glyphs();
+    TTF_CloseFont(ui.fonts[FACE_REGULAR]);
+    TTF_CloseFont(ui.fonts[FACE_BOLD]);
     SDL_DestroyRenderer(ui.renderer);
     SDL_DestroyWindow(ui.window);
-    SDL_DestroyMutex(ui.mutex);
+    SDL_DestroySemaphore(ui.wakeup);
     TTF_Quit();
     litton_free(&machine);
+    free(ui.keyboard_pending);
+    free(ui.printer_history);
     return exit_status;
 }
@@ -25,7 +25,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
-#include <time.h>
 
 static void usage(const char *progname)
 {
@@ -33,6 +32,9 @@ static void usage(const char *progname)
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "    -f\n");
     fprintf(stderr, "        Fast mode; do not slow down to the original speed.\n");
+    fprintf(stderr, "    -r SPEED\n");
+    fprintf(stderr, "        Run at a multiple of the original speed; e.g. 1x, 2x, 10x,\n");
+    fprintf(stderr, "        or unlimited.  The default is 1x.\n");
     fprintf(stderr, "    -e ENTRY\n");
     fprintf(stderr, "        Set the entry point to the drum image, in hexadecimal.\n");
     fprintf(stderr, "    -s SIZE\n");
@@ -40,37 +42,73 @@ static void usage(const char *progname)
     fprintf(stderr, "    -v\n");
     fprintf(stderr, "        Verbose disassembly of instructions as they are executed.\n");
     fprintf(stderr, "    -t\n");
-    fprintf(stderr, "        Print elapsed machine time when the program halts.\n");
+    fprintf(stderr, "        Print elapsed machine time and pacing statistics when the\n");
+    fprintf(stderr, "        program halts.\n");
     fprintf(stderr, "    -i INPUT\n");
     fprintf(stderr, "        Specific an input tape file to use when running the program .\n");
+    fprintf(stderr, "    -T FORMAT\n");
+    fprintf(stderr, "        Set the format of the input tape: auto, text, punched, or raw.\n");
+    fprintf(stderr, "        The default is auto.\n");
+    fprintf(stderr, "    -p PRINTOUT\n");
+    fprintf(stderr, "        Write the printer output to a file instead of stdout, or\n");
+    fprintf(stderr, "        pipe it to a command if PRINTOUT starts with '|'.\n");
+    fprintf(stderr, "    -I [DEVICE=]TIMING\n");
+    fprintf(stderr, "        Set the I/O timing for all devices, or for DEVICE: realistic,\n");
+    fprintf(stderr, "        instant, NNNcps, or NNNbaud.  May be given more than once.\n");
+    fprintf(stderr, "    -x ENGINE\n");
+    fprintf(stderr, "        Set the execution engine: reference, cached, threaded,\n");
+    fprintf(stderr, "        trace, or jit.\n");
+    fprintf(stderr, "    -b ADDR\n");
+    fprintf(stderr, "        Stop when the program jumps to ADDR, in hexadecimal.\n");
 }
 
+/**
+ * @brief Number of machine cycles to run between flushes of the printer
+ * output when the speed is unlimited.
+ */
+#define FLUSH_SLICE_CYCLES 100000
+
+/** Maximum number of -I options on the command-line */
+#define MAX_IO_TIMINGS 16
+
 static litton_state_t machine;
+static litton_pacer_t pacer;
 
 int main(int argc, char *argv[])
 {
     const char *progname = argv[0];
-    litton_step_result_t step;
-    int fast_mode = 0;
+    litton_run_reason_t reason;
+    unsigned speed = 1;
     int exit_status = 0;
     int print_elapsed = 0;
     const char *input_tape = 0;
+    litton_tape_format_t input_format = LITTON_TAPE_AUTO;
+    const char *printout = 0;
+    litton_device_t *printer;
+    litton_sink_t *sink;
+    FILE *file;
+    const char *io_timings[MAX_IO_TIMINGS];
+    int num_io_timings = 0;
+    int n;
+    litton_engine_t engine = LITTON_ENGINE_REFERENCE;
+    uint64_t slice;
     int opt;
-    uint64_t elapsed_ns;
-    uint64_t checkpoint_counter;
-    struct timespec checkpoint_time;
-    struct timespec sleep_to_time;
-    struct timespec now_time;
 
     /* Initialize the machine */
     litton_init(&machine);
 
     /* Process the command-line options */
-    while ((opt = getopt(argc, argv, "fe:s:vti:")) != -1) {
+    while ((opt = getopt(argc, argv, "fr:e:s:vti:T:p:b:x:I:")) != -1) {
         if (opt == 'e') {
             litton_set_entry_point(&machine, strtoul(optarg, NULL, 16));
         } else if (opt == 'f') {
-            fast_mode = 1;
+            speed = LITTON_SPEED_UNLIMITED;
+        } else if (opt == 'r') {
+            if (!litton_speed_from_name(&speed, optarg, strlen(optarg))) {
+                fprintf(stderr, "%s: invalid speed\n", optarg);
+                litton_free(&machine);
+                return 1;
+            }
         } else if (opt == 's') {
             litton_set_drum_size(&machine, strtoul(optarg, NULL, 0));
         } else if (opt == 'v') {
@@ -79,6 +117,30 @@ int main(int argc, char *argv[])
             print_elapsed = 1;
         } else if (opt == 'i') {
             input_tape = optarg;
+        } else if (opt == 'T') {
+            if (!litton_tape_format_from_name
+                    (&input_format, optarg, strlen(optarg))) {
+                fprintf(stderr, "%s: unknown tape format\n", optarg);
+                litton_free(&machine);
+                return 1;
+            }
+        } else if (opt == 'p') {
+            printout = optarg;
+        } else if (opt == 'b') {
+            litton_set_breakpoint(&machine, strtoul(optarg, NULL, 16), 1);
+        } else if (opt == 'I') {
+            if (num_io_timings >= MAX_IO_TIMINGS) {
+                fprintf(stderr, "%s: too many I/O timing options\n", progname);
+                litton_free(&machine);
+                return 1;
+            }
+            io_timings[num_io_timings++] = optarg;
+        } else if (opt == 'x') {
+            if (!litton_engine_from_name(&engine, optarg, strlen(optarg))) {
+                fprintf(stderr, "%s: unknown execution engine\n", optarg);
+                litton_free(&machine);
+                return 1;
+            }
         } else {
             usage(progname);
             litton_free(&machine);
@@ -96,6 +158,16 @@ int main(int argc, char *argv[])
         litton_load_opus(&machine);
     }
 
+    /* Apply the I/O timing options, which override the drum image */
+    for (n = 0; n < num_io_timings; ++n) {
+        if (!litton_parse_io_timing
+                (&machine, io_timings[n], strlen(io_timings[n]))) {
+            fprintf(stderr, "%s: invalid I/O timing\n", io_timings[n]);
+            litton_free(&machine);
+            return 1;
+        }
+    }
+
     /* Create the standard devices */
     litton_create_default_devices(&machine);
     litton_add_tape_punch
@@ -103,6 +175,32 @@ int main(int argc, char *argv[])
     litton_add_tape_reader
         (&machine, LITTON_DEVICE_READER, LITTON_CHARSET_EBS1231);
 
+    /* Redirect the printer output to a file or a command if requested */
+    printer = litton_find_device(&machine, machine.printer_id);
+    if (printout && printer) {
+        if (printout[0] == '|') {
+            sink = litton_create_pipe_sink(printout + 1);
+        } else if ((file = fopen(printout, "w")) != NULL) {
+            sink = litton_create_file_sink(file, 1);
+        } else {
+            perror(printout);
+            sink = 0;
+        }
+        if (!sink) {
+            litton_free(&machine);
+            return 1;
+        }
+        litton_set_device_sink(printer, sink);
+    }
+
+    /* Select the execution engine */
+    if (!litton_set_engine(&machine, engine)) {
+        fprintf(stderr, "%s: execution engine is not supported\n",
+                litton_engine_to_name(engine));
+        litton_free(&machine);
+        return 1;
+    }
+
     /* Reset the machine */
     litton_reset(&machine);
 
@@ -113,48 +211,44 @@ int main(int argc, char *argv[])
 
     /* Load the input tape if specified */
     if (input_tape) {
-        if (!litton_set_input_tape(&machine, input_tape)) {
+        if (!litton_set_input_tape_format
+                (&machine, input_tape, input_format)) {
             litton_free(&machine);
             return 1;
         }
     }
 
-    /* Keep running the program until halt, illegal instruction, or spinning */
-    checkpoint_counter = machine.cycle_counter;
-    clock_gettime(CLOCK_MONOTONIC, &checkpoint_time);
+    /* Stop running when the program is idle so that we can block on
+     * the keyboard rather than spinning in the program's polling loop */
+    machine.stop_on_idle = 1;
+
+    /* Keep running the program until halt, illegal instruction, spinning,
+     * or breakpoint.  We run a quantum of a few milliseconds of machine
+     * time at a time and then sleep until real time catches up.  If the
+     * speed is unlimited, we only stop to flush partial printer lines. */
+    litton_pacer_init(&pacer, &machine, speed);
+    slice = litton_pacer_quantum_cycles(&pacer);
+    if (!slice) {
+        slice = FLUSH_SLICE_CYCLES;
+    }
     for (;;) {
-        /* Step the next instruction */
-        if ((step = litton_step(&machine)) != LITTON_STEP_OK) {
-            break;
+        reason = litton_run(&machine, slice, 0, NULL);
+        if (reason == LITTON_RUN_IDLE) {
+            /* Wait for keyboard input and then resynchronise the clock */
+            litton_wait_for_keyboard(&machine);
+            litton_pacer_resync(&pacer, &machine);
+            continue;
         }
-
-        /* Simulate the actual speed of the computer */
-        if (!fast_mode) {
-            elapsed_ns = (machine.cycle_counter - checkpoint_counter) * 1000;
-            sleep_to_time = checkpoint_time;
-            sleep_to_time.tv_nsec += elapsed_ns % 1000000000;
-            sleep_to_time.tv_sec += elapsed_ns / 1000000000;
-            while (sleep_to_time.tv_nsec >= 1000000000) {
-                sleep_to_time.tv_nsec -= 1000000000;
-                ++(sleep_to_time.tv_sec);
-            }
-            clock_gettime(CLOCK_MONOTONIC, &now_time);
-            if (machine.acceleration_counter != 0 ||
-                    now_time.tv_sec > sleep_to_time.tv_sec ||
-                    (now_time.tv_sec == sleep_to_time.tv_sec &&
-                     now_time.tv_nsec >= sleep_to_time.tv_nsec)) {
-                /* Deadline has already passed, so resynchronise on "now" */
-                checkpoint_counter = machine.cycle_counter;
-                checkpoint_time = now_time;
-            } else {
-                clock_nanosleep
-                    (CLOCK_MONOTONIC, TIMER_ABSTIME, &sleep_to_time, NULL);
-            }
+        if (reason != LITTON_RUN_BUDGET) {
+            break;
         }
+        litton_flush_devices(&machine);
+        litton_pacer_wait(&pacer, &machine);
     }
-    switch (step) {
-    case LITTON_STEP_OK:
-    case LITTON_STEP_HALT:
+    litton_flush_devices(&machine);
+    switch (reason) {
+    case LITTON_RUN_BUDGET:
+    case LITTON_RUN_HALT:
         /* If the halt code is 0, assume everything is OK.
          * Otherwise report a message and change the exit status. */
         if (machine.halt_code != 0) {
@@ -164,20 +258,42 @@ int main(int argc, char *argv[])
         }
         break;
 
-    case LITTON_STEP_ILLEGAL:
+    case LITTON_RUN_ILLEGAL:
         fprintf(stderr, "Illegal instruction at address %03X\n",
                 (unsigned)(machine.PC));
         exit_status = 1;
         break;
 
-    case LITTON_STEP_SPINNING:
+    case LITTON_RUN_SPINNING:
         fprintf(stderr, "Spinning out of control at address %03X\n",
                 (unsigned)(machine.PC));
         exit_status = 1;
         break;
+
+    case LITTON_RUN_IO_WAIT:
+        /* Not reported because stop_on_io_wait is not set */
+        break;
+
+    case LITTON_RUN_IDLE:
+        /* Handled in the run loop above */
+        break;
+
+    case LITTON_RUN_BREAKPOINT:
+        fprintf(stderr, "Breakpoint at address %03X\n",
+                (unsigned)(machine.PC));
+        exit_status = 1;
+        break;
     }
     if (print_elapsed) {
         printf("\r\nelapsed = %fs\r\n", machine.cycle_counter / 1000000.0);
+        if (pacer.sleeps != 0) {
+            printf("sleeps = %llu, resyncs = %llu, "
+                   "jitter = %.1fus average, %.1fus maximum\r\n",
+                   (unsigned long long)(pacer.sleeps),
+                   (unsigned long long)(pacer.resyncs),
+                   pacer.total_jitter_ns / 1000.0 / pacer.sleeps,
+                   pacer.max_jitter_ns / 1000.0);
+        }
     }
     litton_free(&machine);
     return exit_status;
@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs a program on one of the alternative execution engines in lockstep
+ * with the reference interpreter, and reports any differences in the
+ * machine state.  Can also be used to benchmark an engine against the
+ * reference interpreter.
+ */
+
+#include <litton/litton.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+/** Maximum number of instructions to execute in a single batch */
+#define MAX_BATCH 256
+
+/** Maximum number of cycles to execute in a single batch */
+#define MAX_BATCH_CYCLES (MAX_BATCH * LITTON_WORD_BITS * 8)
+
+/** Maximum amount of printer or punch output to capture */
+#define MAX_OUTPUT 65536
+
+/** Maximum number of times to restart the program when benchmarking */
+#define MAX_BENCHMARK_RUNS 100000
+
+/**
+ * @brief Information about one of the machines being compared.
+ */
+typedef struct
+{
+    /** State of the machine */
+    litton_state_t state;
+
+    /** Output that was sent to the printer or punch */
+    char output[MAX_OUTPUT];
+
+    /** Length of the output */
+    size_t output_len;
+
+    /** Keyboard input to supply to the program */
+    const char *keys;
+
+    /** Position within the keyboard input */
+    size_t keys_posn;
+
+} check_machine_t;
+
+static check_machine_t reference;
+static check_machine_t engine;
+
+static check_machine_t *get_machine(litton_state_t *state)
+{
+    return (state == &(reference.state)) ? &reference : &engine;
+}
+
+static void capture_output
+    (litton_state_t *state, litton_device_t *device,
+     uint8_t value, litton_parity_t parity)
+{
+    check_machine_t *machine = get_machine(state);
+    (void)device;
+    (void)parity;
+    if (machine->output_len < MAX_OUTPUT) {
+        machine->output[(machine->output_len)++] = (char)value;
+    }
+}
+
+static int supply_input
+    (litton_state_t *state, litton_device_t *device,
+     uint8_t *value, litton_parity_t parity)
+{
+    check_machine_t *machine = get_machine(state);
+    int ch;
+    if (!(machine->keys) || machine->keys[machine->keys_posn] == '\0') {
+        return 0;
+    }
+    ch = litton_char_to_charset
+        (machine->keys, &(machine->keys_posn), strlen(machine->keys),
+         device->charset);
+    if (ch < 0) {
+        return 0;
+    }
+    *value = litton_add_parity((uint8_t)ch, parity);
+    return 1;
+}
+
+static void add_device
+    (litton_state_t *state, uint8_t id, litton_charset_t charset, int input)
+{
+    litton_device_t *device = calloc(1, sizeof(litton_device_t));
+    device->id = id;
+    device->charset = charset;
+    if (input) {
+        device->supports_input = 1;
+        device->input = supply_input;
+    } else {
+        device->supports_output = 1;
+        device->output = capture_output;
+    }
+    litton_add_device(state, device);
+}
+
+static void start_machine(check_machine_t *machine)
+{
+    litton_state_t *state = &(machine->state);
+    machine->output_len = 0;
+    machine->keys_posn = 0;
+    litton_reset(state);
+    litton_press_button(state, LITTON_BUTTON_HALT);
+    litton_press_button(state, LITTON_BUTTON_READY);
+    litton_press_button(state, LITTON_BUTTON_RUN);
+}
+
+static int init_machine
+    (check_machine_t *machine, const char *drum_image, const char *keys)
+{
+    litton_state_t *state = &(machine->state);
+    litton_init(state);
+    if (drum_image) {
+        if (!litton_load_drum(state, drum_image, NULL)) {
+            return 0;
+        }
+    } else {
+        litton_load_opus(state);
+    }
+    if (state->printer_id != 0) {
+        add_device(state, state->printer_id, state->printer_charset, 0);
+    }
+    if (state->keyboard_id != 0) {
+        add_device(state, state->keyboard_id, state->keyboard_charset, 1);
+    }
+    add_device(state, LITTON_DEVICE_PUNCH, LITTON_CHARSET_EBS1231, 0);
+    machine->keys = keys;
+    start_machine(machine);
+    return 1;
+}
+
+#define CHECK_FIELD(name) \
+    do { \
+        if (s1->name != s2->name) { \
+            fprintf(stderr, "%s differs: reference %llX, engine %llX\n", \
+                    #name, (unsigned long long)(s1->name), \
+                    (unsigned long long)(s2->name)); \
+            ok = 0; \
+        } \
+    } while (0)
+
+static int compare_machines(void)
+{
+    const litton_state_t *s1 = &(reference.state);
+    const litton_state_t *s2 = &(engine.state);
+    litton_drum_loc_t addr;
+    int ok = 1;
+    CHECK_FIELD(CR);
+    CHECK_FIELD(I);
+    CHECK_FIELD(A);
+    CHECK_FIELD(B);
+    CHECK_FIELD(K);
+    CHECK_FIELD(P);
+    CHECK_FIELD(PC);
+    CHECK_FIELD(last_address);
+    CHECK_FIELD(halt_code);
+    CHECK_FIELD(cycle_counter);
+    CHECK_FIELD(io_word_times);
+    CHECK_FIELD(output_busy);
+    CHECK_FIELD(next_event);
+    CHECK_FIELD(rotation_predictor);
+    CHECK_FIELD(spin_counter);
+    CHECK_FIELD(acceleration_counter);
+    CHECK_FIELD(jumped);
+    CHECK_FIELD(io_wait);
+    CHECK_FIELD(idle);
+    CHECK_FIELD(idle_polls);
+    CHECK_FIELD(status_lights);
+    for (addr = 0; addr < LITTON_DRUM_RESERVED_SECTORS; ++addr) {
+        CHECK_FIELD(block_interchange_loop[addr]);
+    }
+    for (addr = 0; addr < LITTON_DRUM_MAX_SIZE; ++addr) {
+        if (litton_get_memory(&(reference.state), addr) !=
+                litton_get_memory(&(engine.state), addr)) {
+            fprintf(stderr, "drum word %03X differs\n", (unsigned)addr);
+            ok = 0;
+            break;
+        }
+    }
+    if (reference.output_len != engine.output_len ||
+            memcmp(reference.output, engine.output, reference.output_len) != 0) {
+        fprintf(stderr, "output differs\n");
+        ok = 0;
+    }
+    return ok;
+}
+
+static litton_run_reason_t step_to_reason(litton_step_result_t step)
+{
+    switch (step) {
+    case LITTON_STEP_OK:        break;
+    case LITTON_STEP_HALT:      return LITTON_RUN_HALT;
+    case LITTON_STEP_ILLEGAL:   return LITTON_RUN_ILLEGAL;
+    case LITTON_STEP_SPINNING:  return LITTON_RUN_SPINNING;
+    }
+    return LITTON_RUN_BUDGET;
+}
+
+static double elapsed_seconds
+    (const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static int benchmark
+    (const char *drum_image, const char *keys, litton_engine_t engine_type,
+     uint64_t max_instructions)
+{
+    static litton_word_t initial_drum[LITTON_DRUM_MAX_SIZE];
+    litton_state_t *state = &(engine.state);
+    litton_run_result_t result;
+    struct timespec start, end;
+    litton_drum_loc_t addr;
+    uint64_t total = 0;
+    unsigned runs = 0;
+    double seconds = 0;
+
+    if (!init_machine(&engine, drum_image, keys)) {
+        return 0;
+    }
+    if (!litton_set_engine(state, engine_type)) {
+        fprintf(stderr, "%s: execution engine is not supported\n",
+                litton_engine_to_name(engine_type));
+        litton_free(state);
+        return 0;
+    }
+    for (addr = 0; addr < LITTON_DRUM_MAX_SIZE; ++addr) {
+        initial_drum[addr] = litton_get_memory(state, addr);
+    }
+
+    /* Run the program repeatedly from the start until we have executed
+     * the requested number of instructions.  Only the time spent in
+     * litton_run() is measured. */
+    while (total < max_instructions && runs < MAX_BENCHMARK_RUNS) {
+        if (runs > 0) {
+            for (addr = 0; addr < LITTON_DRUM_MAX_SIZE; ++addr) {
+                litton_set_memory(state, addr, initial_drum[addr]);
+            }
+            start_machine(&engine);
+        }
+        ++runs;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do {
+            litton_run(state, 0, max_instructions - total, &result);
+            total += result.instructions;
+        } while (total < max_instructions &&
+                 (result.reason == LITTON_RUN_BUDGET ||
+                  result.reason == LITTON_RUN_ILLEGAL));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        seconds += elapsed_seconds(&start, &end);
+    }
+    litton_free(state);
+    printf("%-10s %12llu instructions, %8.3f seconds, %8.2f Minsn/s\n",
+           litton_engine_to_name(engine_type), (unsigned long long)total,
+           seconds, seconds > 0 ? total / seconds / 1000000.0 : 0.0);
+    return 1;
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] [image.drum]\n\n", progname);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "    -x ENGINE\n");
+    fprintf(stderr, "        Execution engine to check; default is cached.\n");
+    fprintf(stderr, "    -n COUNT\n");
+    fprintf(stderr, "        Maximum number of instructions to execute.\n");
+    fprintf(stderr, "    -k KEYS\n");
+    fprintf(stderr, "        Keyboard input to supply to the program.\n");
+    fprintf(stderr, "    -i\n");
+    fprintf(stderr, "        Stop when the program is idle, waiting for input.\n");
+    fprintf(stderr, "    -b\n");
+    fprintf(stderr, "        Benchmark the engine against the reference instead.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    const char *drum_image = 0;
+    const char *keys = 0;
+    litton_engine_t engine_type = LITTON_ENGINE_CACHED;
+    uint64_t max_instructions = 100000000ULL;
+    uint64_t total = 0;
+    uint32_t seed = 1;
+    litton_run_result_t result;
+    litton_run_result_t ref_result;
+    litton_run_reason_t ref_reason;
+    uint64_t max_cycles;
+    uint64_t count;
+    int exit_status = 0;
+    int stop_on_idle = 0;
+    int bench = 0;
+    int idle_count = 0;
+    int opt;
+
+    /* Process the command-line options */
+    while ((opt = getopt(argc, argv, "x:n:k:ib")) != -1) {
+        if (opt == 'x') {
+            if (!litton_engine_from_name(&engine_type, optarg, strlen(optarg))) {
+                fprintf(stderr, "%s: unknown execution engine\n", optarg);
+                return 1;
+            }
+        } else if (opt == 'n') {
+            max_instructions = strtoull(optarg, NULL, 0);
+        } else if (opt == 'k') {
+            keys = optarg;
+        } else if (opt == 'i') {
+            stop_on_idle = 1;
+        } else if (opt == 'b') {
+            bench = 1;
+        } else {
+            usage(progname);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        drum_image = argv[optind];
+    }
+
+    /* Time the reference interpreter and the engine separately */
+    if (bench) {
+        if (!benchmark(drum_image, keys, LITTON_ENGINE_REFERENCE,
+                       max_instructions) ||
+                !benchmark(drum_image, keys, engine_type, max_instructions)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    /* Initialize the two machines */
+    if (!init_machine(&reference, drum_image, keys) ||
+            !init_machine(&engine, drum_image, keys)) {
+        return 1;
+    }
+    if (!litton_set_engine(&(engine.state), engine_type)) {
+        fprintf(stderr, "%s: execution engine is not supported\n",
+                litton_engine_to_name(engine_type));
+        return 1;
+    }
+    reference.state.stop_on_idle = stop_on_idle;
+    engine.state.stop_on_idle = stop_on_idle;
+
+    /* Run batches of instructions of varying sizes on the engine and then
+     * step the same number of instructions on the reference interpreter */
+    while (total < max_instructions) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed & 0x1000) != 0) {
+            /* Run both machines for the same number of cycles, which
+             * should stop them after the same number of instructions */
+            max_cycles = ((seed >> 16) % MAX_BATCH_CYCLES) + 1;
+            litton_run(&(engine.state), max_cycles, 0, &result);
+            litton_run(&(reference.state), max_cycles, 0, &ref_result);
+            ref_reason = ref_result.reason;
+            if (result.instructions != ref_result.instructions) {
+                fprintf(stderr, "instruction count differs: reference %llu, engine %llu\n",
+                        (unsigned long long)(ref_result.instructions),
+                        (unsigned long long)(result.instructions));
+                exit_status = 1;
+            }
+        } else {
+            litton_run(&(engine.state), 0, ((seed >> 16) % MAX_BATCH) + 1, &result);
+            ref_reason = LITTON_RUN_BUDGET;
+            for (count = 0; count < result.instructions; ++count) {
+                ref_reason = step_to_reason(litton_step(&(reference.state)));
+            }
+            if (result.reason == LITTON_RUN_SPINNING) {
+                ref_reason = step_to_reason(litton_step(&(reference.state)));
+            }
+            if (ref_reason == LITTON_RUN_BUDGET && reference.state.io_wait &&
+                    reference.state.idle && stop_on_idle) {
+                ref_reason = LITTON_RUN_IDLE;
+            }
+        }
+        if (result.reason == LITTON_RUN_IDLE) {
+            ++idle_count;
+        }
+        total += result.instructions;
+        if (result.reason != ref_reason) {
+            fprintf(stderr, "stop reason differs: reference %d, engine %d\n",
+                    (int)ref_reason, (int)(result.reason));
+            exit_status = 1;
+        }
+        if (!compare_machines()) {
+            exit_status = 1;
+        }
+        if (exit_status != 0) {
+            fprintf(stderr, "%s engine differs from reference after %llu instructions\n",
+                    litton_engine_to_name(engine_type),
+                    (unsigned long long)total);
+            break;
+        }
+        if (result.reason == LITTON_RUN_HALT ||
+                result.reason == LITTON_RUN_SPINNING) {
+            break;
+        }
+    }
+    if (stop_on_idle && !idle_count && !exit_status) {
+        fprintf(stderr, "program did not become idle\n");
+        exit_status = 1;
+    }
+    litton_free(&(reference.state));
+    litton_free(&(engine.state));
+    return exit_status;
+}
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2025 Rhys Weatherley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks the binary and decimal shift kernels in the core against the
+ * original versions that shift one bit or digit at a time, for every
+ * shift count and carry input.
+ */
+
+#include <litton/litton.h>
+#include "core/litton-internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Largest shift count to check; instructions can shift by up to 128 */
+#define MAX_SHIFT 200
+
+/** Number of random words to check for each shift count and carry */
+#define NUM_RANDOM 200
+
+static void reference_single_left_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word;
+    litton_word_t final_K = 0;
+    while (N > 0) {
+        A = (A << 1) | K;
+        final_K = (A >> LITTON_WORD_BITS);
+        A &= LITTON_WORD_MASK;
+        K = 0;
+        --N;
+    }
+    *word = A;
+    state->K = final_K;
+}
+
+static void reference_double_left_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word1;
+    litton_word_t B = *word2;
+    litton_word_t final_K = 0;
+    while (N > 0) {
+        B = (B << 1) | K;
+        final_K = (B >> LITTON_WORD_BITS);
+        B &= LITTON_WORD_MASK;
+        A = (A << 1) | final_K;
+        final_K = (A >> LITTON_WORD_BITS);
+        A &= LITTON_WORD_MASK;
+        K = 0;
+        --N;
+    }
+    *word1 = A;
+    *word2 = B;
+    state->K = final_K;
+}
+
+static void reference_single_right_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word;
+    litton_word_t final_K = 0;
+    while (N > 0) {
+        final_K = A & 1;
+        A = (A >> 1) | (K << (LITTON_WORD_BITS - 1));
+        --N;
+    }
+    *word = A;
+    state->K = final_K;
+}
+
+static void reference_double_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word1;
+    litton_word_t B = *word2;
+    litton_word_t final_K = 0;
+    litton_word_t carry_K = 0;
+    while (N > 0) {
+        carry_K = A & 1;
+        A = (A >> 1) | (K << (LITTON_WORD_BITS - 1));
+        final_K = B & 1;
+        B = (B >> 1) | (carry_K << (LITTON_WORD_BITS - 1));
+        --N;
+    }
+    *word1 = A;
+    *word2 = B;
+    state->K = final_K;
+}
+
+static void reference_single_decimal_left_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word;
+    while (N > 0) {
+        A = A * 10 + K;
+        A &= LITTON_WORD_MASK;
+        K = 0;
+        --N;
+    }
+    *word = A;
+    state->K = K;
+}
+
+static void reference_single_decimal_right_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word;
+    (void)K;
+    while (N > 0) {
+        A = A / 10;
+        --N;
+    }
+    *word = A;
+    state->K = 0;
+}
+
+static void reference_double_times_2
+    (litton_word_t *word1, litton_word_t *word2)
+{
+    *word1 <<= 1;
+    *word2 <<= 1;
+    *word1 += (*word2) >> LITTON_WORD_BITS;
+    *word1 &= LITTON_WORD_MASK;
+    *word2 &= LITTON_WORD_MASK;
+}
+
+static void reference_double_mul_10
+    (litton_word_t *word1, litton_word_t *word2)
+{
+    litton_word_t tword1, tword2;
+    reference_double_times_2(word1, word2);
+    tword1 = *word1;
+    tword2 = *word2;
+    reference_double_times_2(word1, word2);
+    reference_double_times_2(word1, word2);
+    *word1 += tword1;
+    *word2 += tword2;
+    *word1 += (*word2) >> LITTON_WORD_BITS;
+    *word1 &= LITTON_WORD_MASK;
+    *word2 &= LITTON_WORD_MASK;
+}
+
+static void reference_double_decimal_left_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word1;
+    litton_word_t B = *word2;
+    while (N > 0) {
+        reference_double_mul_10(&A, &B);
+        B += K;
+        K = 0;
+        --N;
+    }
+    *word1 = A;
+    *word2 = B;
+    state->K = K;
+}
+
+static void reference_double_div_10
+    (litton_word_t *word1, litton_word_t *word2)
+{
+    int bit;
+    litton_word_t remainder = 0;
+    for (bit = 0; bit < 80; ++bit) {
+        remainder <<= 1;
+        if (((*word1) & LITTON_WORD_MSB) != 0) {
+            remainder |= 1;
+        }
+        reference_double_times_2(word1, word2);
+        if (remainder >= 10) {
+            remainder -= 10;
+            *word2 |= 1;
+        }
+    }
+}
+
+static void reference_double_decimal_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
+{
+    litton_word_t A = *word1;
+    litton_word_t B = *word2;
+    (void)K;
+    while (N > 0) {
+        reference_double_div_10(&A, &B);
+        --N;
+    }
+    *word1 = A;
+    *word2 = B;
+    state->K = 0;
+}
+
+/* The decimal right shifts in the core don't take K, so adapt them to
+ * the same signature as the other shifts */
+
+static void single_decimal_right_shift
+    (litton_state_t *state, litton_word_t *word, litton_word_t K, uint16_t N)
+{
+    (void)K;
+    litton_single_decimal_right_shift(state, word, N);
+}
+
+static void double_decimal_right_shift
+    (litton_state_t *state, litton_word_t *word1, litton_word_t *word2,
+     litton_word_t K, uint16_t N)
+{
+    (void)K;
+    litton_double_decimal_right_shift(state, word1, word2, N);
+}
+
+/** Words with interesting bit patterns to check before the random words */
+static const litton_word_t patterns[] = {
+    0x0000000000ULL,
+    0x0000000001ULL,
+    0x8000000000ULL,
+    0xFFFFFFFFFFULL,
+    0xAAAAAAAAAAULL,
+    0x5555555555ULL,
+    0x8000000001ULL,
+    0x7FFFFFFFFEULL,
+    0x123456789AULL
+};
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+static litton_state_t state;
+static litton_state_t ref_state;
+static uint32_t seed = 1;
+
+static litton_word_t random_word(void)
+{
+    litton_word_t word = 0;
+    int index;
+    for (index = 0; index < 3; ++index) {
+        seed = seed * 1103515245 + 12345;
+        word = (word << 16) ^ (seed >> 8);
+    }
+    return word & LITTON_WORD_MASK;
+}
+
+static int check_single
+    (const char *name,
+     void (*func)(litton_state_t *, litton_word_t *, litton_word_t, uint16_t),
+     void (*ref)(litton_state_t *, litton_word_t *, litton_word_t, uint16_t),
+     litton_word_t word, litton_word_t K, uint16_t N)
+{
+    litton_word_t result = word;
+    litton_word_t ref_result = word;
+    state.K = 2;
+    ref_state.K = 2;
+    (*func)(&state, &result, K, N);
+    (*ref)(&ref_state, &ref_result, K, N);
+    if (result != ref_result || state.K != ref_state.K) {
+        fprintf(stderr, "%s(%010llX, K=%d, N=%d): expected %010llX K=%d, "
+                        "got %010llX K=%d\n", name,
+                (unsigned long long)word, (int)K, (int)N,
+                (unsigned long long)ref_result, (int)(ref_state.K),
+                (unsigned long long)result, (int)(state.K));
+        return 0;
+    }
+    return 1;
+}
+
+static int check_double
+    (const char *name,
+     void (*func)(litton_state_t *, litton_word_t *, litton_word_t *,
+                  litton_word_t, uint16_t),
+     void (*ref)(litton_state_t *, litton_word_t *, litton_word_t *,
+                 litton_word_t, uint16_t),
+     litton_word_t word1, litton_word_t word2, litton_word_t K, uint16_t N)
+{
+    litton_word_t result1 = word1;
+    litton_word_t result2 = word2;
+    litton_word_t ref_result1 = word1;
+    litton_word_t ref_result2 = word2;
+    state.K = 2;
+    ref_state.K = 2;
+    (*func)(&state, &result1, &result2, K, N);
+    (*ref)(&ref_state, &ref_result1, &ref_result2, K, N);
+    if (result1 != ref_result1 || result2 != ref_result2 ||
+            state.K != ref_state.K) {
+        fprintf(stderr, "%s(%010llX:%010llX, K=%d, N=%d): "
+                        "expected %010llX:%010llX K=%d, "
+                        "got %010llX:%010llX K=%d\n", name,
+                (unsigned long long)word1, (unsigned long long)word2,
+                (int)K, (int)N,
+                (unsigned long long)ref_result1,
+                (unsigned long long)ref_result2, (int)(ref_state.K),
+                (unsigned long long)result1,
+                (unsigned long long)result2, (int)(state.K));
+        return 0;
+    }
+    return 1;
+}
+
+static int check_words
+    (litton_word_t word1, litton_word_t word2, litton_word_t K, uint16_t N)
+{
+    return check_single("litton_single_left_shift",
+                        litton_single_left_shift,
+                        reference_single_left_shift, word1, K, N) &&
+           check_single("litton_single_right_shift",
+                        litton_single_right_shift,
+                        reference_single_right_shift, word1, K, N) &&
+           check_double("litton_double_left_shift",
+                        litton_double_left_shift,
+                        reference_double_left_shift, word1, word2, K, N) &&
+           check_double("litton_double_right_shift",
+                        litton_double_right_shift,
+                        reference_double_right_shift, word1, word2, K, N) &&
+           check_single("litton_single_decimal_left_shift",
+                        litton_single_decimal_left_shift,
+                        reference_single_decimal_left_shift, word1, K, N) &&
+           check_single("litton_single_decimal_right_shift",
+                        single_decimal_right_shift,
+                        reference_single_decimal_right_shift, word1, K, N) &&
+           check_double("litton_double_decimal_left_shift",
+                        litton_double_decimal_left_shift,
+                        reference_double_decimal_left_shift,
+                        word1, word2, K, N) &&
+           check_double("litton_double_decimal_right_shift",
+                        double_decimal_right_shift,
+                        reference_double_decimal_right_shift,
+                        word1, word2, K, N);
+}
+
+int main(void)
+{
+    uint16_t N;
+    litton_word_t K;
+    unsigned index1, index2;
+
+    for (N = 0; N <= MAX_SHIFT; ++N) {
+        for (K = 0; K <= 1; ++K) {
+            for (index1 = 0; index1 < NUM_PATTERNS; ++index1) {
+                for (index2 = 0; index2 < NUM_PATTERNS; ++index2) {
+                    if (!check_words(patterns[index1], patterns[index2], K, N)) {
+                        return 1;
+                    }
+                }
+            }
+            for (index1 = 0; index1 < NUM_RANDOM; ++index1) {
+                if (!check_words(random_word(), random_word(), K, N)) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}